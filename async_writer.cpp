@@ -0,0 +1,347 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <async_writer.hpp>
+#include <cerrno>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+
+
+namespace ledpp {
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    async_writer::async_writer (unsigned queue_depth)
+        : epoll_fd (-1),
+          timer_fd (-1),
+          event_fd (-1),
+          quit (false),
+          signalled (false),
+          num_busy (0),
+          stats (),
+          batch (queue_depth)
+    {
+        epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+        timer_fd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        event_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epoll_fd < 0  ||  timer_fd < 0  ||  event_fd < 0) {
+            int errnum = errno;
+            for (int fd : {epoll_fd, timer_fd, event_fd}) {
+                if (fd >= 0)
+                    close (fd);
+            }
+            throw std::system_error (errnum, std::generic_category());
+        }
+
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = timer_fd;
+        epoll_ctl (epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev);
+        ev.data.fd = event_fd;
+        epoll_ctl (epoll_fd, EPOLL_CTL_ADD, event_fd, &ev);
+
+        worker = std::thread ([this](){ run(); });
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    async_writer::~async_writer ()
+    {
+        {
+            std::lock_guard<std::mutex> lock (mutex);
+            quit = true;
+        }
+        wakeup ();
+        worker.join ();
+        close (event_fd);
+        close (timer_fd);
+        close (epoll_fd);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void async_writer::wakeup ()
+    {
+        uint64_t one = 1;
+        [[maybe_unused]] auto result = write (event_fd, &one, sizeof(one));
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Mark a field of a LED as pending, and queue the LED for the
+    // worker if it has nothing else pending. Called with the mutex locked.
+    //--------------------------------------------------------------------------
+    async_writer::slot& async_writer::post (led& l, unsigned field)
+    {
+        auto [i, inserted] = slots.try_emplace (&l);
+        slot& s = i->second;
+        if (inserted) {
+            s.pending = 0;
+            s.brightness = 0;
+            s.min_interval = clock::duration::zero ();
+            s.queued = false;
+            s.busy = false;
+        }
+        ++stats.posted;
+        if (s.pending & field)
+            ++stats.merged;
+        s.pending |= field;
+        if (!s.queued) {
+            s.queued = true;
+            ready.emplace_back (&l);
+        }
+        // Wake up the worker only once until it has looked at the queue
+        if (!signalled) {
+            signalled = true;
+            wakeup ();
+        }
+        return s;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void async_writer::brightness (led& l, unsigned value)
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        post(l, pending_brightness).brightness = value;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void async_writer::color_intensity (led& l, std::span<const unsigned> values)
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        auto& s = post (l, pending_intensity);
+        s.intensity.assign (values.begin(), values.end());
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void async_writer::trigger (led& l, std::string_view name)
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        post(l, pending_trigger).trigger = name;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void async_writer::rate_limit (led& l, std::chrono::microseconds min_interval)
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        auto [i, inserted] = slots.try_emplace (&l);
+        slot& s = i->second;
+        if (inserted) {
+            s.pending = 0;
+            s.brightness = 0;
+            s.queued = false;
+            s.busy = false;
+        }
+        s.min_interval = min_interval;
+        // Let the worker recalculate its deadline
+        if (s.queued)
+            wakeup ();
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void async_writer::cancel (led& l)
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+        // A post() while waiting may rehash the slots, so
+        // an iterator can't be kept across the wait
+        idle_cond.wait (lock, [this, &l](){
+                auto i = slots.find (&l);
+                return i == slots.end()  ||  !i->second.busy;
+            });
+        auto i = slots.find (&l);
+        if (i == slots.end())
+            return;
+        if (i->second.queued)
+            std::erase (ready, &l);
+        slots.erase (i);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    size_t async_writer::pending ()
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        return ready.size() + num_busy;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void async_writer::wait ()
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+        idle_cond.wait (lock, [this](){ return ready.empty() && num_busy == 0; });
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    async_writer::counters async_writer::get_counters ()
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        return stats;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void async_writer::on_complete (std::function<void(led&, int)> callback)
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        complete_cb = callback;
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Move the pending changes of all LEDs that may be written now
+    // to the batch. LEDs held back by a rate limit stay queued, and
+    // 'deadline' is set to the earliest time one of them may be
+    // written. Called with the mutex locked.
+    // Returns true if there is anything to write.
+    //--------------------------------------------------------------------------
+    bool async_writer::take (clock::time_point now, bool all, clock::time_point& deadline)
+    {
+        deadline = clock::time_point::max ();
+        size_t kept = 0;
+        for (auto l : ready) {
+            slot& s = slots[l];
+            if (!all  &&  s.next_write > now) {
+                if (s.next_write < deadline)
+                    deadline = s.next_write;
+                ready[kept++] = l;
+                continue;
+            }
+            if (s.pending & pending_trigger)
+                batch.trigger (*l, s.trigger);
+            if (s.pending & pending_intensity)
+                batch.color_intensity (*l, s.intensity);
+            if (s.pending & pending_brightness)
+                batch.brightness (*l, s.brightness);
+            s.pending = 0;
+            s.queued = false;
+            s.busy = true;
+            s.next_write = now + s.min_interval;
+            ++num_busy;
+        }
+        ready.resize (kept);
+        return !batch.empty ();
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void async_writer::arm_timer (clock::time_point deadline)
+    {
+        itimerspec its {};
+        if (deadline != clock::time_point::max()) {
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds> (deadline.time_since_epoch());
+            its.it_value.tv_sec = ns.count() / 1000000000;
+            its.it_value.tv_nsec = ns.count() % 1000000000;
+            if (its.it_value.tv_sec == 0  &&  its.it_value.tv_nsec == 0)
+                its.it_value.tv_nsec = 1; // Zero would disarm the timer
+        }
+        timerfd_settime (timer_fd, TFD_TIMER_ABSTIME, &its, nullptr);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void async_writer::run ()
+    {
+        epoll_event events[2];
+        std::vector<led_batch::result> results;
+
+        while (true) {
+            int num = epoll_wait (epoll_fd, events, 2, -1);
+            if (num < 0  &&  errno != EINTR)
+                break;
+            for (int i=0; i<num; ++i) {
+                uint64_t counter;
+                [[maybe_unused]] auto result = read (events[i].data.fd, &counter, sizeof(counter));
+            }
+
+            bool stopping;
+            {
+                std::lock_guard<std::mutex> lock (mutex);
+                stopping = quit;
+                signalled = false;
+                clock::time_point deadline;
+                if (!take(clock::now(), stopping, deadline)) {
+                    arm_timer (deadline);
+                    if (stopping)
+                        break;
+                    continue;
+                }
+                arm_timer (deadline);
+            }
+
+            // Write without holding the mutex, so posting
+            // changes never waits for LED I/O
+            batch.commit ();
+            results = batch.results ();
+
+            std::function<void(led&, int)> cb;
+            {
+                std::lock_guard<std::mutex> lock (mutex);
+                cb = complete_cb;
+            }
+
+            // The LEDs are still busy while the callbacks run, so
+            // cancel() and wait() can't return before they are done
+            if (cb) {
+                for (auto& r : results)
+                    cb (*r.target, r.errnum);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock (mutex);
+                for (auto& r : results) {
+                    auto i = slots.find (r.target);
+                    if (i != slots.end())
+                        i->second.busy = false;
+                    ++stats.writes;
+                    if (r.errnum)
+                        ++stats.errors;
+                }
+                num_busy = 0;
+                idle_cond.notify_all ();
+            }
+            if (stopping)
+                break;
+        }
+    }
+
+
+}
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEDPP_ASYNC_WRITER_HPP
+#define LEDPP_ASYNC_WRITER_HPP
+
+#include <led++.hpp>
+#include <led_batch.hpp>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+
+namespace ledpp {
+
+
+    /**
+     * Write LED changes in a background thread.
+     *
+     * Callers post the wanted brightness, color intensity, or trigger
+     * of a LED and return at once, a worker thread does the writing.
+     * Changes posted to a LED that hasn't been written yet are merged,
+     * so only the newest value of each attribute is written. This
+     * keeps a thread that updates LEDs behind slow I2C or SPI
+     * controllers from being stalled by the writes, and the number
+     * of writes bounded by what the LEDs can take.
+     *
+     * The worker writes all LEDs with pending changes at once using
+     * a led_batch. A minimum time between two writes to the same LED
+     * can be set using rate_limit(); changes posted in the meantime
+     * are merged and written when the time has passed.
+     *
+     * Posting a change never waits for LED I/O. The led objects must
+     * remain valid until the writer is destroyed or cancel() is
+     * called for them, and should not be written to by other threads
+     * in the meantime.
+     *
+     * All methods are thread-safe.
+     */
+    class async_writer {
+    public:
+        /**
+         * Clock used for rate limits.
+         */
+        using clock = std::chrono::steady_clock;
+
+        /**
+         * Counters of an async_writer.
+         */
+        struct counters {
+            uint64_t posted; /**< Number of posted changes. */
+            uint64_t writes; /**< Number of times a LED has been written. */
+            uint64_t merged; /**< Number of changes replaced by a newer one before being written. */
+            uint64_t errors; /**< Number of failed writes. */
+        };
+
+        /**
+         * Start the writer thread.
+         * @param queue_depth The maximum number of writes
+         *                    submitted in one system call.
+         * @throw std::system_error If the thread can't be created.
+         */
+        async_writer (unsigned queue_depth=256);
+
+        /**
+         * Write all pending changes, ignoring rate limits,
+         * and stop the writer thread.
+         */
+        ~async_writer ();
+
+        async_writer (const async_writer&) = delete;
+        async_writer& operator= (const async_writer&) = delete;
+
+        /**
+         * Post a brightness value for a LED.
+         * @param l The LED.
+         * @param value The brightness value.
+         */
+        void brightness (led& l, unsigned value);
+
+        /**
+         * Post color intensity values for a multicolor LED.
+         * @param l The LED.
+         * @param values The color intensity values.
+         */
+        void color_intensity (led& l, std::span<const unsigned> values);
+
+        /**
+         * Post a trigger for a LED.
+         * @param l The LED.
+         * @param name The name of the trigger.
+         */
+        void trigger (led& l, std::string_view name);
+
+        /**
+         * Set the minimum time between two writes to a LED.
+         * @param l The LED.
+         * @param min_interval The minimum time. 0 means no limit,
+         *                     which is the default.
+         */
+        void rate_limit (led& l, std::chrono::microseconds min_interval);
+
+        /**
+         * Drop pending changes of a LED and forget about it.
+         * If the LED is being written, this method waits until
+         * the write, and the completion callback for it, has
+         * finished. When this method returns, the
+         * writer will not use the LED again unless new changes
+         * are posted.
+         * @param l The LED.
+         */
+        void cancel (led& l);
+
+        /**
+         * Return the number of LEDs with changes not yet written.
+         */
+        size_t pending ();
+
+        /**
+         * Wait until all posted changes have been written, and the
+         * completion callbacks for them have returned.
+         */
+        void wait ();
+
+        /**
+         * Return the counters of the writer.
+         */
+        counters get_counters ();
+
+        /**
+         * Set a function that is called each time the pending
+         * changes of a LED have been written. The callback is
+         * called from the writer thread, and must not call
+         * cancel() or wait().
+         * @param callback A function called with the LED and 0 on
+         *                 success, or an error number on failure.
+         */
+        void on_complete (std::function<void(led&, int)> callback);
+
+
+    private:
+        enum : unsigned {
+            pending_brightness = 0x01,
+            pending_intensity  = 0x02,
+            pending_trigger    = 0x04,
+        };
+
+        struct slot {
+            unsigned pending;
+            unsigned brightness;
+            std::vector<unsigned> intensity;
+            std::string trigger;
+            clock::duration min_interval;
+            clock::time_point next_write;
+            bool queued;
+            bool busy;
+        };
+
+        int epoll_fd;
+        int timer_fd;
+        int event_fd;
+        bool quit;
+        bool signalled;
+        std::mutex mutex;
+        std::condition_variable idle_cond;
+        std::unordered_map<led*, slot> slots;
+        std::vector<led*> ready;
+        size_t num_busy;
+        counters stats;
+        std::function<void(led&, int)> complete_cb;
+        led_batch batch;
+        std::thread worker;
+
+        slot& post (led& l, unsigned field);
+        void wakeup ();
+        void run ();
+        bool take (clock::time_point now, bool all, clock::time_point& deadline);
+        void arm_timer (clock::time_point deadline);
+    };
+
+
+}
+#endif
@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <getopt.h>
+#include <led++.hpp>
+#include <led_color.hpp>
+#include "fake-sysfs.hpp"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+
+struct appargs_t {
+    unsigned num_leds;
+    unsigned rounds;
+
+    appargs_t (int argc, char* argv[]);
+    void print_usage (const char* argv0);
+};
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void appargs_t::print_usage (const char* argv0)
+{
+    cout << endl;
+    cout << "Usage: " << argv0 << " [OPTIONS]" << endl;
+    cout << "  Benchmark color conversion of many multicolor LEDs." << endl;
+    cout << endl;
+    cout << "Options:" << endl;
+    cout << "  -n, --leds=NUM     Number of LEDs in the synthetic tree (default 512)." << endl;
+    cout << "  -r, --rounds=NUM   Number of conversions of all LEDs (default 2000)." << endl;
+    cout << "  -h, --help         Print this help message." << endl;
+    cout << endl;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+appargs_t::appargs_t (int argc, char* argv[])
+    : num_leds (512),
+      rounds (2000)
+{
+    static struct option long_options[] = {
+        { "leds",      required_argument, 0, 'n'},
+        { "rounds",    required_argument, 0, 'r'},
+        { "help",      no_argument,       0, 'h'},
+        { 0, 0, 0, 0}
+    };
+    static const char* arg_format = "n:r:h";
+
+    while (1) {
+        int c = getopt_long (argc, argv, arg_format, long_options, NULL);
+        if (c == -1)
+            break;
+        switch (c) {
+        case 'n':
+            num_leds = std::strtoul (optarg, nullptr, 0);
+            break;
+        case 'r':
+            rounds = std::strtoul (optarg, nullptr, 0);
+            break;
+        case 'h':
+            print_usage (argv[0]);
+            exit (0);
+            break;
+        default:
+            cerr << "Use option -h for help." << endl;
+            exit (1);
+        }
+    }
+    if (optind < argc  ||  num_leds == 0  ||  rounds == 0) {
+        cerr << "Error: Invalid arguments, use option -h for help." << endl;
+        exit (1);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Run a conversion of all LEDs a number of times and
+// print the average time per LED.
+//------------------------------------------------------------------------------
+static double run (const std::string& what, unsigned rounds, unsigned num_leds,
+                   const std::function<void()>& func)
+{
+    func (); // Warm up
+    auto start = std::chrono::steady_clock::now ();
+    for (unsigned i=0; i<rounds; ++i)
+        func ();
+    auto stop = std::chrono::steady_clock::now ();
+    std::chrono::duration<double, std::nano> elapsed = stop - start;
+    double ns = elapsed.count() / rounds / num_leds;
+    cout << std::left << std::setw(28) << what << std::right
+         << std::fixed << std::setprecision(2)
+         << std::setw(12) << ns
+         << std::setprecision(0)
+         << std::setw(16) << (1e9 / ns)
+         << endl;
+    return ns;
+}
+
+
+//------------------------------------------------------------------------------
+// Straightforward per LED HSV conversion, used as reference.
+// The max brightness and color names are read in advance,
+// so only the conversion itself is measured.
+//------------------------------------------------------------------------------
+static void naive_hsv (float scale, const std::vector<std::string>& names,
+                       const ledpp::hsv_color& c, std::vector<unsigned>& out)
+{
+    float h = std::fmod (c.h, 360.0f);
+    if (h < 0)
+        h += 360.0f;
+    float s = std::clamp (c.s, 0.0f, 1.0f);
+    float v = std::clamp (c.v, 0.0f, 1.0f);
+    float chroma = v * s;
+    float x = chroma * (1.0f - std::fabs(std::fmod(h / 60.0f, 2.0f) - 1.0f));
+    float m = v - chroma;
+    float r, g, b;
+    switch ((int)(h / 60.0f)) {
+    case 0:  r = chroma; g = x;      b = 0;      break;
+    case 1:  r = x;      g = chroma; b = 0;      break;
+    case 2:  r = 0;      g = chroma; b = x;      break;
+    case 3:  r = 0;      g = x;      b = chroma; break;
+    case 4:  r = x;      g = 0;      b = chroma; break;
+    default: r = chroma; g = 0;      b = x;      break;
+    }
+    r += m;
+    g += m;
+    b += m;
+
+    out.resize (names.size());
+    for (size_t i=0; i<names.size(); ++i) {
+        float value = 0;
+        if (names[i] == "red")
+            value = r;
+        else if (names[i] == "green")
+            value = g;
+        else if (names[i] == "blue")
+            value = b;
+        else if (names[i] == "white")
+            value = std::min ({r, g, b});
+        out[i] = (unsigned) (value * scale + 0.5f);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int main (int argc, char* argv[])
+{
+    appargs_t opt (argc, argv);
+
+    //
+    // Create the synthetic LED tree. Every fourth LED is an RGBW LED,
+    // the rest are RGB LEDs.
+    //
+    fake_sysfs sysfs;
+    std::vector<std::unique_ptr<ledpp::led>> leds;
+    std::vector<ledpp::led*> ptrs;
+    for (unsigned i=0; i<opt.num_leds; ++i) {
+        auto name = "bench:multi:color" + std::to_string (i);
+        if (i % 4 == 3)
+            sysfs.add_led (name, 255, {"red", "green", "blue", "white"});
+        else
+            sysfs.add_led (name, 255, {"red", "green", "blue"});
+        leds.emplace_back (std::make_unique<ledpp::led>(name, sysfs.path()));
+        ptrs.emplace_back (leds.back().get());
+    }
+    ledpp::color_mapper mapper (ptrs);
+
+    std::vector<ledpp::rgb_color> rgb (opt.num_leds);
+    std::vector<ledpp::hsv_color> hsv (opt.num_leds);
+    std::vector<float> kelvin (opt.num_leds);
+    for (unsigned i=0; i<opt.num_leds; ++i) {
+        float f = (float) i / opt.num_leds;
+        rgb[i] = {f, 1.0f - f, 0.5f};
+        hsv[i] = {f * 720.0f, 1.0f, 0.75f};
+        kelvin[i] = 1500.0f + f * 8000.0f;
+    }
+
+    cout << "LEDs: " << opt.num_leds << ", rounds: " << opt.rounds << endl;
+    cout << std::left << std::setw(28) << "Conversion" << std::right
+         << std::setw(12) << "ns/LED"
+         << std::setw(16) << "LEDs/s"
+         << endl;
+
+    std::vector<float> scale;
+    std::vector<std::vector<std::string>> names;
+    for (auto& l : leds) {
+        scale.emplace_back ((float) l->max_brightness());
+        names.emplace_back (l->color_names());
+    }
+    std::vector<unsigned> out;
+    double naive = run ("hsv, per LED (reference)", opt.rounds, opt.num_leds, [&]{
+        for (unsigned i=0; i<opt.num_leds; ++i)
+            naive_hsv (scale[i], names[i], hsv[i], out);
+    });
+    double batched = run ("color_mapper hsv", opt.rounds, opt.num_leds, [&]{
+        mapper.convert (std::span<const ledpp::hsv_color>(hsv));
+    });
+    run ("color_mapper rgb", opt.rounds, opt.num_leds, [&]{
+        mapper.convert (std::span<const ledpp::rgb_color>(rgb));
+    });
+    run ("color_mapper kelvin", opt.rounds, opt.num_leds, [&]{
+        mapper.convert_kelvin (kelvin, 0.8f);
+    });
+
+    cout << endl << "hsv speedup: " << std::setprecision(1) << (naive / batched) << 'x' << endl;
+    return 0;
+}
@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <chrono>
+#include <functional>
+#include <new>
+#include <cstdlib>
+#include <led++.hpp>
+#include "fake-sysfs.hpp"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+
+//------------------------------------------------------------------------------
+// Count heap allocations, to verify that the allocation-free
+// methods really don't allocate.
+//------------------------------------------------------------------------------
+static size_t num_allocs = 0;
+
+void* operator new (size_t size)
+{
+    ++num_allocs;
+    void* ptr = malloc (size ? size : 1);
+    if (!ptr)
+        throw std::bad_alloc ();
+    return ptr;
+}
+
+void operator delete (void* ptr) noexcept
+{
+    free (ptr);
+}
+
+void operator delete (void* ptr, size_t) noexcept
+{
+    free (ptr);
+}
+
+
+struct result_t {
+    double ns;     // Average time per call in nanoseconds
+    double allocs; // Average number of heap allocations per call
+};
+
+
+//------------------------------------------------------------------------------
+// Run a function a number of times and return the average time
+// and number of heap allocations per call.
+//------------------------------------------------------------------------------
+static result_t run (unsigned iterations, const std::function<void(unsigned)>& func)
+{
+    func (0); // Warm up, let internal buffers grow
+    size_t allocs = num_allocs;
+    auto start = std::chrono::steady_clock::now ();
+    for (unsigned i=0; i<iterations; ++i)
+        func (i);
+    auto stop = std::chrono::steady_clock::now ();
+    allocs = num_allocs - allocs;
+    std::chrono::duration<double, std::nano> elapsed = stop - start;
+    return result_t {elapsed.count() / iterations, (double)allocs / iterations};
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static void report (const std::string& what, const result_t& reopen, const result_t& fd)
+{
+    cout << std::left << std::setw(28) << what << std::right
+         << std::fixed << std::setprecision(0)
+         << std::setw(12) << reopen.ns
+         << std::setw(10) << fd.ns
+         << std::setprecision(2)
+         << std::setw(9) << (reopen.ns / fd.ns) << 'x'
+         << std::setw(12) << reopen.allocs
+         << std::setw(10) << fd.allocs
+         << endl;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int main (int argc, char* argv[])
+{
+    unsigned iterations = 100000;
+    if (argc > 1)
+        iterations = std::strtoul (argv[1], nullptr, 0);
+    if (iterations == 0) {
+        cerr << "Usage: " << argv[0] << " [ITERATIONS]" << endl;
+        return 1;
+    }
+
+    fake_sysfs sysfs;
+    sysfs.add_led ("bench:white:status", 255);
+    sysfs.add_led ("bench:rgb:status", 255, {"red", "green", "blue"});
+
+    ledpp::led s_led ("bench:white:status", sysfs.path());
+    ledpp::led f_led ("bench:white:status", sysfs.path(), ledpp::led::keep_open);
+    ledpp::led s_rgb ("bench:rgb:status", sysfs.path());
+    ledpp::led f_rgb ("bench:rgb:status", sysfs.path(), ledpp::led::keep_open);
+    std::vector<unsigned> ci {255, 128, 0};
+    std::array<unsigned, 3> ci_buf;
+    volatile unsigned sink = 0;
+
+    cout << "Iterations: " << iterations << endl;
+    cout << std::left << std::setw(28) << "Operation" << std::right
+         << std::setw(12) << "reopen ns"
+         << std::setw(10) << "fd ns"
+         << std::setw(10) << "speedup"
+         << std::setw(12) << "reopen a/op"
+         << std::setw(10) << "fd a/op"
+         << endl;
+
+    report ("brightness()",
+            run(iterations, [&](unsigned){ sink = sink + s_led.brightness(); }),
+            run(iterations, [&](unsigned){ sink = sink + f_led.brightness(); }));
+    report ("brightness(value)",
+            run(iterations, [&](unsigned i){ s_led.brightness(i & 0xff); }),
+            run(iterations, [&](unsigned i){ f_led.brightness(i & 0xff); }));
+    report ("max_brightness()",
+            run(iterations, [&](unsigned){ sink = sink + s_led.max_brightness(); }),
+            run(iterations, [&](unsigned){ sink = sink + f_led.max_brightness(); }));
+    report ("color_intensity()",
+            run(iterations, [&](unsigned){ sink = sink + s_rgb.color_intensity().size(); }),
+            run(iterations, [&](unsigned){ sink = sink + f_rgb.color_intensity().size(); }));
+    report ("color_intensity(values)",
+            run(iterations, [&](unsigned i){ ci[0] = i & 0xff; s_rgb.color_intensity(ci); }),
+            run(iterations, [&](unsigned i){ ci[0] = i & 0xff; f_rgb.color_intensity(ci); }));
+    report ("read_color_intensity(span)",
+            run(iterations, [&](unsigned){ sink = sink + s_rgb.read_color_intensity(ci_buf); }),
+            run(iterations, [&](unsigned){ sink = sink + f_rgb.read_color_intensity(ci_buf); }));
+    report ("trigger()",
+            run(iterations, [&](unsigned){ sink = sink + s_led.trigger().size(); }),
+            run(iterations, [&](unsigned){ sink = sink + f_led.trigger().size(); }));
+    report ("read_trigger()",
+            run(iterations, [&](unsigned){ sink = sink + s_led.read_trigger().size(); }),
+            run(iterations, [&](unsigned){ sink = sink + f_led.read_trigger().size(); }));
+    report ("trigger(name)",
+            run(iterations, [&](unsigned){ s_led.trigger(std::string_view("none")); }),
+            run(iterations, [&](unsigned){ f_led.trigger(std::string_view("none")); }));
+
+    return 0;
+}
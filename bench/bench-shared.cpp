@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+#include <getopt.h>
+#include <led++.hpp>
+#include <shared_led.hpp>
+#include "fake-sysfs.hpp"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+
+struct appargs_t {
+    unsigned num_leds;
+    unsigned ops;
+    unsigned max_threads;
+    unsigned write_percent;
+
+    appargs_t (int argc, char* argv[]);
+    void print_usage (const char* argv0);
+};
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void appargs_t::print_usage (const char* argv0)
+{
+    cout << endl;
+    cout << "Usage: " << argv0 << " [OPTIONS]" << endl;
+    cout << "  Benchmark LEDs shared by many threads, and check that" << endl;
+    cout << "  the remembered state matches the LEDs afterwards." << endl;
+    cout << endl;
+    cout << "Options:" << endl;
+    cout << "  -n, --leds=NUM     Number of LEDs in the synthetic tree (default 16)." << endl;
+    cout << "  -r, --ops=NUM      Number of operations per thread (default 200000)." << endl;
+    cout << "  -t, --threads=NUM  Max number of threads (default: number of CPUs)." << endl;
+    cout << "  -w, --writes=PCT   Percentage of operations that are writes (default 10)." << endl;
+    cout << "  -h, --help         Print this help message." << endl;
+    cout << endl;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+appargs_t::appargs_t (int argc, char* argv[])
+    : num_leds (16),
+      ops (200000),
+      max_threads (std::max(1u, std::thread::hardware_concurrency())),
+      write_percent (10)
+{
+    static struct option long_options[] = {
+        { "leds",      required_argument, 0, 'n'},
+        { "ops",       required_argument, 0, 'r'},
+        { "threads",   required_argument, 0, 't'},
+        { "writes",    required_argument, 0, 'w'},
+        { "help",      no_argument,       0, 'h'},
+        { 0, 0, 0, 0}
+    };
+    static const char* arg_format = "n:r:t:w:h";
+
+    while (1) {
+        int c = getopt_long (argc, argv, arg_format, long_options, NULL);
+        if (c == -1)
+            break;
+        switch (c) {
+        case 'n':
+            num_leds = std::strtoul (optarg, nullptr, 0);
+            break;
+        case 'r':
+            ops = std::strtoul (optarg, nullptr, 0);
+            break;
+        case 't':
+            max_threads = std::strtoul (optarg, nullptr, 0);
+            break;
+        case 'w':
+            write_percent = std::strtoul (optarg, nullptr, 0);
+            break;
+        case 'h':
+            print_usage (argv[0]);
+            exit (0);
+            break;
+        default:
+            cerr << "Use option -h for help." << endl;
+            exit (1);
+        }
+    }
+    if (optind < argc  ||  num_leds == 0  ||  ops == 0  ||
+        max_threads == 0  ||  write_percent > 100)
+    {
+        cerr << "Error: Invalid arguments, use option -h for help." << endl;
+        exit (1);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Small and fast pseudo random numbers, one generator per thread.
+//------------------------------------------------------------------------------
+static inline uint32_t xorshift (uint32_t& x)
+{
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+
+//------------------------------------------------------------------------------
+// Run a number of threads that each do 'ops' random operations
+// on random LEDs, and return the total number of operations per second.
+// op(thread, led index, write, value) returns false on error.
+//------------------------------------------------------------------------------
+static double run (unsigned num_threads, const appargs_t& opt,
+                   const std::function<bool(unsigned, unsigned, bool, unsigned)>& op)
+{
+    std::atomic<unsigned> ready {0};
+    std::atomic<bool> go {false};
+    std::atomic<unsigned> errors {0};
+    std::vector<std::thread> threads;
+
+    for (unsigned t=0; t<num_threads; ++t) {
+        threads.emplace_back ([&, t]{
+            uint32_t x = 2463534242u + t * 7919u;
+            ready.fetch_add (1);
+            while (!go.load(std::memory_order_acquire))
+                std::this_thread::yield ();
+            for (unsigned i=0; i<opt.ops; ++i) {
+                uint32_t r = xorshift (x);
+                bool write = (r >> 8) % 100 < opt.write_percent;
+                if (!op(t, r % opt.num_leds, write, (r >> 16) & 0xff))
+                    errors.fetch_add (1, std::memory_order_relaxed);
+            }
+        });
+    }
+    while (ready.load() < num_threads)
+        std::this_thread::yield ();
+
+    auto start = std::chrono::steady_clock::now ();
+    go.store (true, std::memory_order_release);
+    for (auto& th : threads)
+        th.join ();
+    auto stop = std::chrono::steady_clock::now ();
+
+    if (errors.load())
+        cerr << "Warning: " << errors.load() << " operations failed" << endl;
+    std::chrono::duration<double> elapsed = stop - start;
+    return (double) num_threads * opt.ops / elapsed.count ();
+}
+
+
+//------------------------------------------------------------------------------
+// Check that the remembered brightness of each shared LED
+// is the brightness read from the LED by a separate object.
+//------------------------------------------------------------------------------
+static unsigned check_state (const std::vector<std::shared_ptr<ledpp::shared_led>>& leds,
+                             const fake_sysfs& sysfs)
+{
+    unsigned mismatches = 0;
+    for (auto& l : leds) {
+        ledpp::led reference (l->name(), sysfs.path());
+        if (l->brightness() != reference.brightness())
+            ++mismatches;
+    }
+    return mismatches;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int main (int argc, char* argv[])
+{
+    appargs_t opt (argc, argv);
+
+    fake_sysfs sysfs;
+    std::vector<std::string> names;
+    for (unsigned i=0; i<opt.num_leds; ++i) {
+        names.emplace_back ("bench:green:shared" + std::to_string(i));
+        sysfs.add_led (names.back(), 255);
+    }
+
+    // Baseline: plain led objects guarded by one global mutex
+    std::vector<std::unique_ptr<ledpp::led>> plain;
+    for (auto& name : names)
+        plain.emplace_back (std::make_unique<ledpp::led>(name, sysfs.path(), ledpp::led::keep_open));
+    std::mutex global_mutex;
+
+    std::vector<std::shared_ptr<ledpp::shared_led>> shared;
+    std::vector<std::shared_ptr<ledpp::shared_led>> shadowed;
+    for (auto& name : names) {
+        shared.emplace_back (ledpp::shared_led::open(name, sysfs.path()));
+        shadowed.emplace_back (ledpp::shared_led::open(name, sysfs.path(),
+                                                       ledpp::led::shadow_state));
+    }
+
+    std::vector<unsigned> thread_counts;
+    for (unsigned n=1; n<opt.max_threads; n*=2)
+        thread_counts.emplace_back (n);
+    thread_counts.emplace_back (opt.max_threads);
+
+    cout << "LEDs: " << opt.num_leds << ", operations per thread: " << opt.ops
+         << ", writes: " << opt.write_percent << '%' << endl;
+    cout << std::setw(8) << "Threads"
+         << std::setw(18) << "global mutex"
+         << std::setw(18) << "shared_led"
+         << std::setw(18) << "shadow_state"
+         << "   (operations/s)" << endl;
+
+    unsigned mismatches = 0;
+    for (auto num_threads : thread_counts) {
+        double global = run (num_threads, opt, [&](unsigned, unsigned i, bool write, unsigned value) {
+            std::lock_guard<std::mutex> lock (global_mutex);
+            if (write)
+                return plain[i]->brightness(value) == 0;
+            return plain[i]->brightness() >= 0;
+        });
+        double per_led = run (num_threads, opt, [&](unsigned, unsigned i, bool write, unsigned value) {
+            if (write)
+                return shared[i]->brightness(value) == 0;
+            return shared[i]->brightness() >= 0;
+        });
+        for (auto& l : shadowed)
+            l->invalidate ();
+        double shadow = run (num_threads, opt, [&](unsigned, unsigned i, bool write, unsigned value) {
+            if (write)
+                return shadowed[i]->brightness(value) == 0;
+            return shadowed[i]->brightness() >= 0;
+        });
+        mismatches += check_state (shadowed, sysfs);
+
+        cout << std::setw(8) << num_threads << std::fixed << std::setprecision(0)
+             << std::setw(18) << global
+             << std::setw(18) << per_led
+             << std::setw(18) << shadow
+             << endl;
+    }
+
+    if (mismatches) {
+        cerr << "Error: " << mismatches << " remembered states don't match the LED" << endl;
+        return 1;
+    }
+    cout << "Remembered state matches the LEDs after each run." << endl;
+    return 0;
+}
@@ -0,0 +1,288 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <cstdlib>
+#include <cstdint>
+#include <getopt.h>
+#include <led++.hpp>
+#include "fake-sysfs.hpp"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+
+struct appargs_t {
+    unsigned num_leds;
+    unsigned rounds;
+    unsigned flags;
+
+    appargs_t (int argc, char* argv[]);
+    void print_usage (const char* argv0);
+};
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void appargs_t::print_usage (const char* argv0)
+{
+    cout << endl;
+    cout << "Usage: " << argv0 << " [OPTIONS]" << endl;
+    cout << "  Benchmark led++ against a synthetic LED class directory." << endl;
+    cout << endl;
+    cout << "Options:" << endl;
+    cout << "  -n, --leds=NUM     Number of LEDs in the synthetic tree (default 256)." << endl;
+    cout << "  -r, --rounds=NUM   Number of times each operation is run on each LED (default 10)." << endl;
+    cout << "  -k, --keep-open    Create the led objects with flag keep_open." << endl;
+    cout << "  -h, --help         Print this help message." << endl;
+    cout << endl;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+appargs_t::appargs_t (int argc, char* argv[])
+    : num_leds (256),
+      rounds (10),
+      flags (0)
+{
+    static struct option long_options[] = {
+        { "leds",      required_argument, 0, 'n'},
+        { "rounds",    required_argument, 0, 'r'},
+        { "keep-open", no_argument,       0, 'k'},
+        { "help",      no_argument,       0, 'h'},
+        { 0, 0, 0, 0}
+    };
+    static const char* arg_format = "n:r:kh";
+
+    while (1) {
+        int c = getopt_long (argc, argv, arg_format, long_options, NULL);
+        if (c == -1)
+            break;
+        switch (c) {
+        case 'n':
+            num_leds = std::strtoul (optarg, nullptr, 0);
+            break;
+        case 'r':
+            rounds = std::strtoul (optarg, nullptr, 0);
+            break;
+        case 'k':
+            flags |= ledpp::led::keep_open;
+            break;
+        case 'h':
+            print_usage (argv[0]);
+            exit (0);
+            break;
+        default:
+            cerr << "Use option -h for help." << endl;
+            exit (1);
+        }
+    }
+    if (optind < argc  ||  num_leds == 0  ||  rounds == 0) {
+        cerr << "Error: Invalid arguments, use option -h for help." << endl;
+        exit (1);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Latency samples of one operation, in nanoseconds.
+//------------------------------------------------------------------------------
+class samples {
+public:
+    void add (uint64_t ns) {
+        values.emplace_back (ns);
+    }
+
+    void report (const std::string& what) {
+        if (values.empty())
+            return;
+        std::sort (values.begin(), values.end());
+        uint64_t total = 0;
+        for (auto v : values)
+            total += v;
+        double ops_per_sec = total ? values.size() * 1e9 / total : 0.0;
+        cout << std::left << std::setw(22) << what << std::right
+             << std::setw(9) << values.size()
+             << std::setw(12) << (uint64_t)ops_per_sec
+             << std::setw(10) << percentile(50)
+             << std::setw(10) << percentile(90)
+             << std::setw(10) << percentile(99)
+             << std::setw(10) << values.back()
+             << endl;
+    }
+
+private:
+    std::vector<uint64_t> values;
+
+    uint64_t percentile (unsigned p) {
+        size_t i = (values.size() - 1) * p / 100;
+        return values[i];
+    }
+};
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static void measure (samples& s, const std::function<void()>& func)
+{
+    auto start = std::chrono::steady_clock::now ();
+    func ();
+    auto stop = std::chrono::steady_clock::now ();
+    s.add (std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+}
+
+
+//------------------------------------------------------------------------------
+// A trigger list resembling the one found on a typical embedded board.
+//------------------------------------------------------------------------------
+static std::vector<std::string> make_triggers ()
+{
+    std::vector<std::string> triggers {
+        "none", "kbd-scrolllock", "kbd-numlock", "kbd-capslock", "kbd-kanalock",
+        "kbd-shiftlock", "kbd-altgrlock", "kbd-ctrllock", "kbd-altlock",
+        "kbd-shiftllock", "kbd-shiftrlock", "kbd-ctrlllock", "kbd-ctrlrlock",
+        "timer", "oneshot", "heartbeat", "backlight", "gpio", "default-on",
+        "transient", "flash", "torch", "panic", "pattern", "audio-mute",
+        "audio-micmute", "disk-activity", "disk-read", "disk-write", "netdev",
+        "rfkill-any", "rfkill-none", "activity", "mtd", "nand-disk",
+    };
+    for (unsigned i=0; i<16; ++i)
+        triggers.emplace_back ("cpu" + std::to_string(i));
+    for (unsigned i=0; i<4; ++i) {
+        triggers.emplace_back ("mmc" + std::to_string(i));
+        triggers.emplace_back ("phy" + std::to_string(i) + "rx");
+        triggers.emplace_back ("phy" + std::to_string(i) + "tx");
+        triggers.emplace_back ("phy" + std::to_string(i) + "assoc");
+        triggers.emplace_back ("phy" + std::to_string(i) + "radio");
+        triggers.emplace_back ("phy" + std::to_string(i) + "tpt");
+    }
+    for (unsigned i=0; i<40; ++i)
+        triggers.emplace_back ("stmmac-" + std::to_string(i/8) + ":0" + std::to_string(i%8) + ":link");
+    return triggers;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int main (int argc, char* argv[])
+{
+    appargs_t opt (argc, argv);
+
+    //
+    // Create the synthetic LED tree. Every fourth LED is a multicolor LED.
+    //
+    fake_sysfs sysfs;
+    auto triggers = make_triggers ();
+    std::vector<std::string> names;
+    for (unsigned i=0; i<opt.num_leds; ++i) {
+        std::string name;
+        if (i % 4 == 3) {
+            name = "bench" + std::to_string(i) + ":multicolor:status";
+            if (i % 8 == 7)
+                sysfs.add_led (name, 255, {"red", "green", "blue", "white"}, triggers);
+            else
+                sysfs.add_led (name, 255, {"red", "green", "blue"}, triggers);
+        }else{
+            name = "bench" + std::to_string(i) + ":green:status";
+            sysfs.add_led (name, 1, {}, triggers);
+        }
+        names.emplace_back (name);
+    }
+    setenv (ledpp::led::leds_dir_env, sysfs.path().c_str(), 1);
+
+    cout << "LEDs: " << opt.num_leds
+         << ", triggers per LED: " << triggers.size()
+         << ", rounds: " << opt.rounds
+         << ", keep_open: " << ((opt.flags & ledpp::led::keep_open) ? "yes" : "no")
+         << endl;
+    cout << std::left << std::setw(22) << "Operation" << std::right
+         << std::setw(9) << "count"
+         << std::setw(12) << "ops/s"
+         << std::setw(10) << "p50 ns"
+         << std::setw(10) << "p90 ns"
+         << std::setw(10) << "p99 ns"
+         << std::setw(10) << "max ns"
+         << endl;
+
+    samples s_enum;
+    samples s_snapshot;
+    samples s_snapshot_serial;
+    samples s_ctor;
+    samples s_br_read;
+    samples s_br_write;
+    samples s_max_read;
+    samples s_ci_read;
+    samples s_ci_write;
+    samples s_triggers;
+    samples s_trigger;
+    samples s_trigger_parse;
+    samples s_active_trigger;
+    volatile size_t sink = 0;
+
+    std::vector<std::unique_ptr<ledpp::led>> leds;
+    for (unsigned r=0; r<opt.rounds; ++r) {
+        measure (s_enum, [&](){ sink = sink + ledpp::led::led_names().size(); });
+        measure (s_snapshot, [&](){ sink = sink + ledpp::led::snapshot_all().size(); });
+        measure (s_snapshot_serial, [&](){ sink = sink + ledpp::led::snapshot_all(1).size(); });
+
+        leds.clear ();
+        for (auto& name : names)
+            measure (s_ctor, [&](){ leds.emplace_back (std::make_unique<ledpp::led>(name, opt.flags)); });
+
+        for (auto& l : leds) {
+            measure (s_br_read, [&](){ sink = sink + l->brightness(); });
+            measure (s_br_write, [&](){ l->brightness(r & 1); });
+            measure (s_max_read, [&](){ sink = sink + l->max_brightness(); });
+            if (l->is_multicolor()) {
+                std::vector<unsigned> values (l->color_names().size(), r & 0xff);
+                measure (s_ci_read, [&](){ sink = sink + l->color_intensity().size(); });
+                measure (s_ci_write, [&](){ l->color_intensity(values); });
+            }
+            l->reload_triggers ();
+            measure (s_trigger_parse, [&](){ sink = sink + l->available_triggers().size(); });
+            measure (s_active_trigger, [&](){ sink = sink + l->active_trigger(); });
+            measure (s_triggers, [&](){ sink = sink + l->triggers().size(); });
+            measure (s_trigger, [&](){ sink = sink + l->trigger().size(); });
+        }
+    }
+
+    s_enum.report ("led_names()");
+    s_snapshot.report ("snapshot_all()");
+    s_snapshot_serial.report ("snapshot_all(1)");
+    s_ctor.report ("construct");
+    s_br_read.report ("brightness()");
+    s_br_write.report ("brightness(value)");
+    s_max_read.report ("max_brightness()");
+    s_ci_read.report ("color_intensity()");
+    s_ci_write.report ("color_intensity(values)");
+    s_trigger_parse.report ("trigger list parse");
+    s_active_trigger.report ("active_trigger()");
+    s_triggers.report ("triggers()");
+    s_trigger.report ("trigger()");
+
+    return 0;
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEDPP_BENCH_FAKE_SYSFS_HPP
+#define LEDPP_BENCH_FAKE_SYSFS_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdlib>
+#include <cerrno>
+#include <filesystem>
+#include <system_error>
+
+
+/**
+ * A fake LED class directory in a temporary location,
+ * mimicking the layout of /sys/class/leds.
+ * The directory is removed when the object is destroyed.
+ */
+class fake_sysfs {
+public:
+    fake_sysfs () {
+        const char* tmp = getenv ("TMPDIR");
+        std::string templ = std::string(tmp ? tmp : "/tmp") + "/ledpp-bench-XXXXXX";
+        if (mkdtemp(templ.data()) == nullptr)
+            throw std::system_error (errno, std::generic_category());
+        root = templ;
+    }
+
+    ~fake_sysfs () {
+        std::error_code ec;
+        std::filesystem::remove_all (root, ec);
+    }
+
+    fake_sysfs (const fake_sysfs&) = delete;
+    fake_sysfs& operator= (const fake_sysfs&) = delete;
+
+    const std::filesystem::path& path () const {
+        return root;
+    }
+
+    void add_led (const std::string& name,
+                  unsigned max_brightness,
+                  const std::vector<std::string>& colors = {},
+                  const std::vector<std::string>& triggers = {"none"})
+    {
+        auto dir = root / name;
+        std::filesystem::create_directory (dir);
+        write_file (dir / "brightness", "0\n");
+        write_file (dir / "max_brightness", std::to_string(max_brightness) + "\n");
+
+        std::string txt;
+        for (size_t i=0; i<triggers.size(); ++i) {
+            if (i)
+                txt.push_back (' ');
+            if (i == 0)
+                txt.append ("[" + triggers[i] + "]");
+            else
+                txt.append (triggers[i]);
+        }
+        write_file (dir / "trigger", txt + "\n");
+
+        if (!colors.empty()) {
+            std::string idx;
+            std::string intensity;
+            for (size_t i=0; i<colors.size(); ++i) {
+                if (i) {
+                    idx.push_back (' ');
+                    intensity.push_back (' ');
+                }
+                idx.append (colors[i]);
+                intensity.append (std::to_string(max_brightness));
+            }
+            write_file (dir / "multi_index", idx + "\n");
+            write_file (dir / "multi_intensity", intensity + "\n");
+        }
+    }
+
+
+private:
+    std::filesystem::path root;
+
+    static void write_file (const std::filesystem::path& pathname, const std::string& content) {
+        std::ofstream s (pathname);
+        s << content;
+        if (s.fail())
+            throw std::system_error (errno, std::generic_category());
+    }
+};
+
+
+#endif
@@ -0,0 +1,510 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <effect_engine.hpp>
+#include <vector>
+#include <cmath>
+#include <cerrno>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+
+
+namespace ledpp {
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    static double ease (effect_engine::easing curve, double x)
+    {
+        switch (curve) {
+        case effect_engine::easing::ease_in:
+            return x * x;
+        case effect_engine::easing::ease_out:
+            return 1.0 - (1.0-x) * (1.0-x);
+        case effect_engine::easing::ease_in_out:
+            return x * x * (3.0 - 2.0*x);
+        default:
+            return x;
+        }
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Time between updates so that the brightness changes by about
+    // one step per update, but not more often than min_interval.
+    //--------------------------------------------------------------------------
+    static effect_engine::clock::duration step_interval (effect_engine::clock::duration time,
+                                                         unsigned from,
+                                                         unsigned to,
+                                                         std::chrono::microseconds min_interval)
+    {
+        unsigned steps = from > to ? from - to : to - from;
+        auto interval = time / (steps ? steps : 1);
+        if (interval < min_interval)
+            interval = min_interval;
+        return interval;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    effect_engine::effect_engine (std::chrono::microseconds min_interval_arg,
+                                  std::chrono::microseconds slack_arg)
+        : min_interval (min_interval_arg),
+          slack (slack_arg),
+          epoll_fd (-1),
+          timer_fd (-1),
+          event_fd (-1),
+          quit (false),
+          in_callbacks (false)
+    {
+        epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+        timer_fd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        event_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epoll_fd < 0  ||  timer_fd < 0  ||  event_fd < 0) {
+            int errnum = errno;
+            for (int fd : {epoll_fd, timer_fd, event_fd}) {
+                if (fd >= 0)
+                    close (fd);
+            }
+            throw std::system_error (errnum, std::generic_category());
+        }
+
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = timer_fd;
+        epoll_ctl (epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev);
+        ev.data.fd = event_fd;
+        epoll_ctl (epoll_fd, EPOLL_CTL_ADD, event_fd, &ev);
+
+        worker = std::thread ([this](){ run(); });
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    effect_engine::~effect_engine ()
+    {
+        {
+            std::lock_guard<std::mutex> lock (mutex);
+            quit = true;
+        }
+        wakeup ();
+        worker.join ();
+        close (event_fd);
+        close (timer_fd);
+        close (epoll_fd);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void effect_engine::wakeup ()
+    {
+        uint64_t one = 1;
+        [[maybe_unused]] auto result = write (event_fd, &one, sizeof(one));
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void effect_engine::start (led& l, effect&& e)
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        remove (&l);
+        e.start = clock::now ();
+        e.deadline = e.start;
+        e.last_value = -1;
+        effects.insert_or_assign (&l, std::move(e));
+        wakeup ();
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Remove the effect on a LED. An effect run by the kernel
+    // is stopped by removing the trigger.
+    //--------------------------------------------------------------------------
+    void effect_engine::remove (led* l)
+    {
+        auto i = effects.find (l);
+        if (i == effects.end())
+            return;
+        if (i->second.type == kind::kernel)
+            l->trigger ("none");
+        effects.erase (i);
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Let the kernel run an endless blink or breathe effect.
+    // Returns false if the LED doesn't have the needed trigger.
+    //--------------------------------------------------------------------------
+    bool effect_engine::offload (led& l, bool blink, duration period, double duty,
+                                 unsigned low, unsigned high)
+    {
+        auto ms = period.count ();
+        std::lock_guard<std::mutex> lock (mutex);
+        remove (&l);
+
+        if (blink) {
+            unsigned on_time = (unsigned) std::lround (ms * duty);
+            if (on_time == 0  ||  on_time >= ms  ||  high == 0  ||  !l.has_trigger("timer"))
+                return false;
+            // Set the brightness after the trigger, it sets the blink brightness
+            if (l.timer(on_time, ms - on_time)  ||  l.brightness(high))
+                return false;
+        }else{
+            if (ms < 2  ||  !l.has_trigger("pattern"))
+                return false;
+            led::pattern_step steps[2] = {
+                {low,  (unsigned) ms / 2},
+                {high, (unsigned) (ms - ms / 2)},
+            };
+            if (l.pattern(steps, -1))
+                return false;
+        }
+
+        effect e;
+        e.type = kind::kernel;
+        e.curve = easing::linear;
+        e.from = low;
+        e.to = high;
+        e.period = period;
+        e.duty = duty;
+        e.count = 0;
+        e.start = clock::now ();
+        e.deadline = clock::time_point::max ();
+        e.interval = clock::duration::zero ();
+        e.last_value = -1;
+        effects.insert_or_assign (&l, std::move(e));
+        return true;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void effect_engine::fade_to (led& l, unsigned target, duration time, easing curve)
+    {
+        unsigned from = 0;
+        {
+            // Make sure the engine isn't writing to the LED while reading it
+            std::lock_guard<std::mutex> lock (mutex);
+            remove (&l);
+            int value = l.brightness ();
+            if (value > 0)
+                from = value;
+        }
+        ramp (l, from, target, time, curve, 1);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void effect_engine::ramp (led& l, unsigned from, unsigned to, duration time,
+                              easing curve, unsigned count)
+    {
+        effect e;
+        e.type = kind::ramp;
+        e.curve = curve;
+        e.from = from;
+        e.to = to;
+        e.period = time;
+        e.duty = 0.0;
+        e.count = count;
+        e.interval = step_interval (time, from, to, min_interval);
+        start (l, std::move(e));
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void effect_engine::breathe (led& l, unsigned low, unsigned high, duration period, unsigned count)
+    {
+        if (count == 0  &&  offload(l, false, period, 0.0, low, high))
+            return;
+
+        effect e;
+        e.type = kind::breathe;
+        e.curve = easing::linear;
+        e.from = low;
+        e.to = high;
+        e.period = period;
+        e.duty = 0.0;
+        e.count = count;
+        e.interval = step_interval (period/2, low, high, min_interval);
+        start (l, std::move(e));
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void effect_engine::blink (led& l, duration period, double duty, unsigned on_value,
+                               unsigned off_value, unsigned count)
+    {
+        duty = duty<0.0 ? 0.0 : (duty>1.0 ? 1.0 : duty);
+        if (count == 0  &&  off_value == 0  &&  offload(l, true, period, duty, off_value, on_value))
+            return;
+
+        effect e;
+        e.type = kind::blink;
+        e.curve = easing::linear;
+        e.from = off_value;
+        e.to = on_value;
+        e.period = period;
+        e.duty = duty;
+        e.count = count;
+        e.interval = period;
+        start (l, std::move(e));
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void effect_engine::stop (led& l)
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        remove (&l);
+        if (effects.empty())
+            idle_cond.notify_all ();
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void effect_engine::stop_all ()
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        while (!effects.empty())
+            remove (effects.begin()->first);
+        idle_cond.notify_all ();
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    bool effect_engine::running (led& l)
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        return effects.find(&l) != effects.end();
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    bool effect_engine::offloaded (led& l)
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        auto i = effects.find (&l);
+        return i != effects.end()  &&  i->second.type == kind::kernel;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    size_t effect_engine::size ()
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        return effects.size ();
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void effect_engine::wait ()
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+        idle_cond.wait (lock, [this](){ return effects.empty()  &&  !in_callbacks; });
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void effect_engine::on_error (std::function<void(led&, int)> callback)
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        error_cb = callback;
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Calculate the brightness of an effect at a point in time,
+    // and the deadline of the next update.
+    // Returns true if the effect has finished.
+    //--------------------------------------------------------------------------
+    bool effect_engine::step (effect& e, clock::time_point now, unsigned& value)
+    {
+        clock::duration period = e.period;
+        clock::duration t = now - e.start;
+
+        if (period <= clock::duration::zero()  ||
+            (e.count  &&  t >= period * e.count))
+        {
+            // The effect has finished
+            value = e.type==kind::ramp ? e.to : e.from;
+            return true;
+        }
+
+        auto cycle = t / period;
+        auto phase = t % period;
+        clock::time_point cycle_start = e.start + cycle * period;
+        double x = std::chrono::duration<double>(phase) / std::chrono::duration<double>(period);
+        double range = (double)e.to - (double)e.from;
+
+        switch (e.type) {
+        case kind::ramp:
+            value = (unsigned) std::lround (e.from + range * ease(e.curve, x));
+            e.deadline = now + e.interval;
+            break;
+
+        case kind::breathe:
+            value = (unsigned) std::lround (e.from + range * (1.0 - std::cos(2.0*M_PI*x)) / 2.0);
+            e.deadline = now + e.interval;
+            break;
+
+        case kind::blink:
+            {
+                auto on_time = std::chrono::duration_cast<clock::duration> (period * e.duty);
+                if (phase < on_time) {
+                    value = e.to;
+                    e.deadline = cycle_start + on_time;
+                }else{
+                    value = e.from;
+                    e.deadline = cycle_start + period;
+                }
+            }
+            break;
+
+        case kind::kernel:
+            // Run by the kernel, never updated by the engine
+            value = e.to;
+            e.deadline = clock::time_point::max ();
+            break;
+        }
+
+        // Don't overshoot the end of the effect
+        if (e.count) {
+            auto end = e.start + period * e.count;
+            if (e.deadline > end)
+                e.deadline = end;
+        }
+        return false;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void effect_engine::update (clock::time_point now)
+    {
+        std::vector<led*> finished;
+        auto horizon = now + slack;
+
+        for (auto& [l, e] : effects) {
+            if (e.deadline > horizon)
+                continue;
+            unsigned value = 0;
+            if (step(e, e.deadline > now ? e.deadline : now, value))
+                finished.emplace_back (l);
+            if ((int)value != e.last_value) {
+                batch.brightness (*l, value);
+                e.last_value = value;
+            }
+        }
+        batch.commit ();
+        for (auto l : finished)
+            effects.erase (l);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void effect_engine::arm_timer ()
+    {
+        itimerspec its {};
+        auto deadline = clock::time_point::max ();
+        for (auto& entry : effects) {
+            if (entry.second.deadline < deadline)
+                deadline = entry.second.deadline;
+        }
+        if (deadline != clock::time_point::max()) {
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds> (deadline.time_since_epoch());
+            its.it_value.tv_sec = ns.count() / 1000000000;
+            its.it_value.tv_nsec = ns.count() % 1000000000;
+            if (its.it_value.tv_sec == 0  &&  its.it_value.tv_nsec == 0)
+                its.it_value.tv_nsec = 1; // Zero would disarm the timer
+        }
+        timerfd_settime (timer_fd, TFD_TIMER_ABSTIME, &its, nullptr);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void effect_engine::run ()
+    {
+        epoll_event events[2];
+        std::vector<std::pair<led*, int>> errors;
+
+        while (true) {
+            int num = epoll_wait (epoll_fd, events, 2, -1);
+            if (num < 0  &&  errno != EINTR)
+                break;
+            for (int i=0; i<num; ++i) {
+                uint64_t counter;
+                [[maybe_unused]] auto result = read (events[i].data.fd, &counter, sizeof(counter));
+            }
+
+            std::function<void(led&, int)> cb;
+            {
+                std::lock_guard<std::mutex> lock (mutex);
+                if (quit)
+                    break;
+
+                update (clock::now());
+
+                // Stop effects on LEDs that can't be written to
+                errors.clear ();
+                for (auto& r : batch.results()) {
+                    if (r.errnum) {
+                        effects.erase (r.target);
+                        errors.emplace_back (r.target, r.errnum);
+                    }
+                }
+                arm_timer ();
+                cb = error_cb;
+
+                // Don't let wait() return before the callbacks have run
+                in_callbacks = cb  &&  !errors.empty();
+                if (effects.empty()  &&  !in_callbacks)
+                    idle_cond.notify_all ();
+            }
+
+            if (in_callbacks) {
+                for (auto& [l, errnum] : errors)
+                    cb (*l, errnum);
+                std::lock_guard<std::mutex> lock (mutex);
+                in_callbacks = false;
+                if (effects.empty())
+                    idle_cond.notify_all ();
+            }
+        }
+    }
+
+
+}
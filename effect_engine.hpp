@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEDPP_EFFECT_ENGINE_HPP
+#define LEDPP_EFFECT_ENGINE_HPP
+
+#include <led++.hpp>
+#include <led_batch.hpp>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <unordered_map>
+
+
+namespace ledpp {
+
+
+    /**
+     * Run brightness effects on any number of LEDs using a single thread.
+     *
+     * The engine thread sleeps on one timer that is armed to the
+     * earliest deadline of all running effects. When it wakes up,
+     * all effects with deadlines within a small slack window are
+     * updated at the same time, and only brightness values that
+     * have changed are written. The writes of one wakeup are
+     * committed together using a led_batch.
+     *
+     * Endless blink and breathe effects are handed over to the
+     * kernel using the <code>timer</code> and <code>pattern</code>
+     * triggers if the LED has them, so they cause no wakeups at all.
+     * Otherwise they run in the engine thread like all other effects.
+     *
+     * Each LED can run one effect at a time. Starting a new effect
+     * on a LED replaces the current one. The led objects must remain
+     * valid for as long as an effect is running on them, and should
+     * not be written to by other threads in the meantime.
+     *
+     * All methods are thread-safe.
+     */
+    class effect_engine {
+    public:
+        /**
+         * Clock used for effect timing.
+         */
+        using clock = std::chrono::steady_clock;
+
+        /**
+         * Duration type used by effects.
+         */
+        using duration = std::chrono::milliseconds;
+
+        /**
+         * Easing curves for fades and ramps.
+         */
+        enum class easing {
+            linear,      /**< Constant rate of change. */
+            ease_in,     /**< Start slow, end fast. */
+            ease_out,    /**< Start fast, end slow. */
+            ease_in_out, /**< Start and end slow. */
+        };
+
+        /**
+         * Start the effect engine thread.
+         * @param min_interval The shortest time between two updates
+         *                     of one LED.
+         * @param slack Effects with deadlines this close to each other
+         *              are updated in the same wakeup.
+         * @throw std::system_error If the timer or thread can't be created.
+         */
+        effect_engine (std::chrono::microseconds min_interval = std::chrono::milliseconds(10),
+                       std::chrono::microseconds slack = std::chrono::milliseconds(1));
+
+        /**
+         * Stop the effect engine thread.
+         * Running effects are stopped where they are.
+         * Effects run by the kernel keep running until another
+         * trigger is set on the LED.
+         */
+        ~effect_engine ();
+
+        effect_engine (const effect_engine&) = delete;
+        effect_engine& operator= (const effect_engine&) = delete;
+
+        /**
+         * Fade from the current brightness to a target brightness.
+         * @param l The LED.
+         * @param target The brightness at the end of the fade.
+         * @param time The duration of the fade.
+         * @param curve The easing curve.
+         */
+        void fade_to (led& l, unsigned target, duration time, easing curve=easing::linear);
+
+        /**
+         * Ramp the brightness from one value to another.
+         * @param l The LED.
+         * @param from The brightness at the start of the ramp.
+         * @param to The brightness at the end of the ramp.
+         * @param time The duration of one ramp.
+         * @param curve The easing curve.
+         * @param count The number of times to run the ramp.
+         *              0 means repeat until stopped.
+         */
+        void ramp (led& l, unsigned from, unsigned to, duration time,
+                   easing curve=easing::linear, unsigned count=1);
+
+        /**
+         * Smoothly pulse the brightness up and down.
+         * @param l The LED.
+         * @param low The lowest brightness.
+         * @param high The highest brightness.
+         * @param period The duration of one full cycle.
+         * @param count The number of cycles. 0 means repeat until stopped,
+         *              and the effect is run by the kernel if the LED
+         *              has the <code>pattern</code> trigger. The kernel
+         *              changes the brightness linearly instead of along
+         *              a sine curve.
+         */
+        void breathe (led& l, unsigned low, unsigned high, duration period, unsigned count=0);
+
+        /**
+         * Turn the LED on and off.
+         * @param l The LED.
+         * @param period The duration of one on/off cycle.
+         * @param duty The fraction of the period the LED is on, 0.0 - 1.0.
+         * @param on_value The brightness when the LED is on.
+         * @param off_value The brightness when the LED is off.
+         * @param count The number of cycles. 0 means repeat until stopped,
+         *              and if <code>off_value</code> is 0 the effect is
+         *              run by the kernel if the LED has the
+         *              <code>timer</code> trigger.
+         */
+        void blink (led& l, duration period, double duty, unsigned on_value,
+                    unsigned off_value=0, unsigned count=0);
+
+        /**
+         * Stop any running effect on a LED.
+         * The LED keeps its current brightness, except for
+         * effects run by the kernel, where the trigger is
+         * removed and the LED is turned off.
+         * When this method returns, the engine will not write
+         * to the LED again.
+         * @param l The LED.
+         */
+        void stop (led& l);
+
+        /**
+         * Stop all running effects.
+         */
+        void stop_all ();
+
+        /**
+         * Check if an effect is running on a LED.
+         */
+        bool running (led& l);
+
+        /**
+         * Check if the effect on a LED is run by the kernel.
+         */
+        bool offloaded (led& l);
+
+        /**
+         * Return the number of running effects.
+         */
+        size_t size ();
+
+        /**
+         * Wait until all effects have finished, and any error
+         * callbacks for failed effects have returned.
+         * Note that effects with a count of 0 never finish
+         * unless stopped.
+         */
+        void wait ();
+
+        /**
+         * Set a function that is called if writing to a LED fails.
+         * The effect on that LED is stopped when this happens.
+         * The callback is called from the engine thread.
+         * @param callback A function called with the LED and
+         *                 an error number.
+         */
+        void on_error (std::function<void(led&, int)> callback);
+
+
+    private:
+        enum class kind { ramp, breathe, blink, kernel };
+
+        struct effect {
+            kind type;
+            easing curve;
+            unsigned from;
+            unsigned to;
+            duration period;
+            double duty;
+            unsigned count;
+            clock::time_point start;
+            clock::time_point deadline;
+            clock::duration interval;
+            int last_value;
+        };
+
+        std::chrono::microseconds min_interval;
+        std::chrono::microseconds slack;
+        int epoll_fd;
+        int timer_fd;
+        int event_fd;
+        bool quit;
+        bool in_callbacks;
+        std::mutex mutex;
+        std::condition_variable idle_cond;
+        std::unordered_map<led*, effect> effects;
+        std::function<void(led&, int)> error_cb;
+        led_batch batch;
+        std::thread worker;
+
+        void start (led& l, effect&& e);
+        bool offload (led& l, bool blink, duration period, double duty,
+                      unsigned low, unsigned high);
+        void remove (led* l);
+        void wakeup ();
+        void run ();
+        void update (clock::time_point now);
+        bool step (effect& e, clock::time_point now, unsigned& value);
+        void arm_timer ();
+    };
+
+
+}
+#endif
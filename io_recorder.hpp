@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEDPP_IO_RECORDER_HPP
+#define LEDPP_IO_RECORDER_HPP
+
+#include <led_stats.hpp>
+#include <atomic>
+#include <string>
+#include <ctime>
+#include <cstdint>
+#include <sys/types.h>
+
+
+namespace ledpp::detail {
+
+
+    /**
+     * Counters of one LED, updated concurrently by any number of
+     * led objects. This is internal and not part of the public API.
+     */
+    struct io_entry {
+        struct slot {
+            std::atomic<uint64_t> ops;
+            std::atomic<uint64_t> bytes;
+            std::atomic<uint64_t> errors;
+            std::atomic<uint64_t> total_ns;
+            std::atomic<uint64_t> max_ns;
+            std::atomic<uint64_t> histogram[io_counters::num_buckets];
+        };
+
+        std::string name;
+        slot open;
+        slot read[led_io_stats::num_attributes];
+        slot write[led_io_stats::num_attributes];
+    };
+
+
+#ifndef LEDPP_NO_STATS
+    extern std::atomic<bool> io_stats_on;
+#endif
+
+
+    /**
+     * Return a start timestamp for an operation if statistics are
+     * collected, otherwise 0. This is the only cost of the
+     * instrumentation when it is disabled.
+     */
+    inline uint64_t io_start ()
+    {
+#ifdef LEDPP_NO_STATS
+        return 0;
+#else
+        if (!io_stats_on.load(std::memory_order_relaxed)) [[likely]]
+            return 0;
+        timespec ts;
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec + 1;
+#endif
+    }
+
+    /**
+     * Return the counters of a LED, they are created on first use
+     * and never freed. Returns nullptr if out of memory.
+     */
+    io_entry* io_lookup (const std::string& name) noexcept;
+
+    /**
+     * Add one operation that started at <code>start</code>
+     * (returned by io_start()) to a slot. A negative result
+     * is counted as an error, otherwise as a number of bytes.
+     */
+    void io_record (io_entry::slot& s, uint64_t start, ssize_t result) noexcept;
+
+
+}
+#endif
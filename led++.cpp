@@ -17,11 +17,20 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 #include <led++.hpp>
-#include <fstream>
+#include <io_recorder.hpp>
 #include <cstring>
 #include <cerrno>
+#include <cstdlib>
 #include <filesystem>
-#include <sstream>
+#include <charconv>
+#include <algorithm>
+#include <utility>
+#include <mutex>
+#include <shared_mutex>
+#include <deque>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <iostream>
 
@@ -29,73 +38,645 @@ namespace ledpp {
 
 
     //--------------------------------------------------------------------------
+    // The names and ids of the trigger registry. Created on first use,
+    // so that triggers can be interned from static initializers in
+    // other files.
     //--------------------------------------------------------------------------
-    led::led (const std::string& name_arg)
-        : led_name (name_arg)
+    namespace {
+        struct trigger_table {
+            std::shared_mutex mutex;
+            std::deque<std::string> names;
+            std::unordered_map<std::string_view, trigger_id> ids;
+        };
+    }
+
+    static trigger_table& triggers ()
+    {
+        static trigger_table table;
+        return table;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    trigger_id trigger_registry::intern (std::string_view name)
+    {
+        auto& t = triggers ();
+        {
+            std::shared_lock<std::shared_mutex> lock (t.mutex);
+            auto i = t.ids.find (name);
+            if (i != t.ids.end())
+                return i->second;
+        }
+        std::unique_lock<std::shared_mutex> lock (t.mutex);
+        auto i = t.ids.find (name);
+        if (i != t.ids.end())
+            return i->second;
+        trigger_id id = t.names.size ();
+        t.names.emplace_back (name);
+        t.ids.emplace (t.names.back(), id);
+        return id;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int trigger_registry::find (std::string_view name)
+    {
+        auto& t = triggers ();
+        std::shared_lock<std::shared_mutex> lock (t.mutex);
+        auto i = t.ids.find (name);
+        return i==t.ids.end() ? -1 : (int)i->second;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    std::string_view trigger_registry::name (trigger_id id)
+    {
+        auto& t = triggers ();
+        std::shared_lock<std::shared_mutex> lock (t.mutex);
+        if (id >= t.names.size())
+            return {};
+        return t.names[id];
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    size_t trigger_registry::size ()
+    {
+        auto& t = triggers ();
+        std::shared_lock<std::shared_mutex> lock (t.mutex);
+        return t.names.size ();
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    std::filesystem::path led::leds_dir ()
+    {
+        const char* dir = getenv (leds_dir_env);
+        if (dir  &&  *dir)
+            return dir;
+        return default_leds_dir;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    led::led (const std::string& name_arg, unsigned flags)
+        : led (name_arg, leds_dir(), flags)
+    {
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    led::led (const std::string& name_arg,
+              const std::filesystem::path& leds_dir,
+              unsigned flags)
+        : led (name_arg, flags, std::nothrow)
+    {
+        int errnum = open_dir (leds_dir);
+        if (errnum)
+            throw std::system_error (errnum, std::generic_category());
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Initialize an object without opening the LED directory.
+    //--------------------------------------------------------------------------
+    led::led (const std::string& name_arg, unsigned flags, std::nothrow_t) noexcept
+        : led_name (name_arg),
+          led_flags (flags),
+          dir_fd (-1),
+          max_value (-1),
+          stats_entry (nullptr),
+          colors_valid (false),
+          trigger_list_valid (false),
+          shadow ()
+    {
+        if (led_flags & defer_writes)
+            led_flags |= shadow_state;
+
+        std::fill_n (attr_fds, attr_count, -1);
+        std::fill_n (attr_modes, attr_count, 0);
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Open the LED directory. Returns 0 on success, otherwise an error number.
+    //--------------------------------------------------------------------------
+    int led::open_dir (const std::filesystem::path& leds_dir) noexcept
     {
         if (led_name.empty())
-            throw std::system_error (EINVAL, std::generic_category());
+            return EINVAL;
 
         // Make sure the LED name is just a name, and not an absolute or relative path
-        std::filesystem::path device_pathname (led_name);
-        if (device_pathname.parent_path().empty() == false)
-            throw std::system_error (ENODEV, std::generic_category());
+        if (led_name.find('/') != std::string::npos  ||  led_name == "."  ||  led_name == "..")
+            return ENODEV;
 
-        device_pathname = "/sys/class/leds" / device_pathname;
+        // Attribute files are opened relative to the LED directory
+        // when first used, so this is the only system call needed.
+        uint64_t start = detail::io_start ();
+        dir_fd = ::open ((leds_dir / led_name).c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+        if (start)
+            record_open (start, dir_fd);
+        if (dir_fd < 0)
+            return (errno==ENOENT || errno==ENOTDIR) ? ENODEV : errno;
+        return 0;
+    }
 
-        // Make sure the path to the led device exists
-        if (!std::filesystem::exists(device_pathname)) {
-            int errnum = errno==ENOENT ? ENODEV : errno;
-            throw std::system_error (errnum, std::generic_category());
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    led::led (const led& l)
+        : led_name (l.led_name),
+          led_flags (l.led_flags),
+          dir_fd (-1),
+          max_value (l.max_value),
+          stats_entry (l.stats_entry.load()),
+          colors (l.colors),
+          colors_valid (l.colors_valid),
+          trigger_list (l.trigger_list),
+          trigger_list_valid (l.trigger_list_valid),
+          shadow (l.shadow)
+    {
+        std::fill_n (attr_fds, attr_count, -1);
+        std::fill_n (attr_modes, attr_count, 0);
+        if (l.dir_fd >= 0) {
+            dir_fd = fcntl (l.dir_fd, F_DUPFD_CLOEXEC, 0);
+            if (dir_fd < 0) {
+                int errnum = errno;
+                throw std::system_error (errnum, std::generic_category());
+            }
         }
+    }
 
-        path_brightness = device_pathname / "brightness";
-        path_max_brightness = device_pathname / "max_brightness";
-        path_multi_intensity = device_pathname / "multi_intensity";
-        path_trigger = device_pathname / "trigger";
 
-        std::filesystem::path path_multi_index = device_pathname / "multi_index";
-        if (std::filesystem::exists(path_multi_index)) {
-            std::ifstream s (path_multi_index);
-            while (s.good()) {
-                std::string color_name;
-                s >> color_name;
-                if (!s.fail()) {
-                    colors.emplace_back (color_name);
-                }
-                else if (!s.eof()) {
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    led::led (led&& l) noexcept
+        : led_name (std::move(l.led_name)),
+          led_flags (l.led_flags),
+          dir_fd (l.dir_fd),
+          max_value (l.max_value),
+          stats_entry (l.stats_entry.load()),
+          colors (std::move(l.colors)),
+          colors_valid (l.colors_valid),
+          trigger_list (std::move(l.trigger_list)),
+          trigger_list_valid (l.trigger_list_valid),
+          shadow (std::move(l.shadow))
+    {
+        std::copy_n (l.attr_fds, attr_count, attr_fds);
+        std::copy_n (l.attr_modes, attr_count, attr_modes);
+        std::fill_n (l.attr_fds, attr_count, -1);
+        std::fill_n (l.attr_modes, attr_count, 0);
+        l.dir_fd = -1;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    led::~led ()
+    {
+        close_files ();
+        if (dir_fd >= 0)
+            close (dir_fd);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    led& led::operator= (const led& l)
+    {
+        if (this != &l) {
+            int fd = -1;
+            if (l.dir_fd >= 0) {
+                fd = fcntl (l.dir_fd, F_DUPFD_CLOEXEC, 0);
+                if (fd < 0) {
                     int errnum = errno;
                     throw std::system_error (errnum, std::generic_category());
                 }
             }
+            close_files ();
+            if (dir_fd >= 0)
+                close (dir_fd);
+            dir_fd = fd;
+            led_name = l.led_name;
+            led_flags = l.led_flags;
+            max_value = l.max_value;
+            stats_entry = l.stats_entry.load ();
+            colors = l.colors;
+            colors_valid = l.colors_valid;
+            trigger_list = l.trigger_list;
+            trigger_list_valid = l.trigger_list_valid;
+            shadow = l.shadow;
+        }
+        return *this;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    led& led::operator= (led&& l) noexcept
+    {
+        if (this != &l) {
+            close_files ();
+            if (dir_fd >= 0)
+                close (dir_fd);
+            dir_fd = l.dir_fd;
+            l.dir_fd = -1;
+            led_name = std::move (l.led_name);
+            led_flags = l.led_flags;
+            max_value = l.max_value;
+            stats_entry = l.stats_entry.load ();
+            colors = std::move (l.colors);
+            colors_valid = l.colors_valid;
+            trigger_list = std::move (l.trigger_list);
+            trigger_list_valid = l.trigger_list_valid;
+            shadow = std::move (l.shadow);
+            std::copy_n (l.attr_fds, attr_count, attr_fds);
+            std::copy_n (l.attr_modes, attr_count, attr_modes);
+            std::fill_n (l.attr_fds, attr_count, -1);
+            std::fill_n (l.attr_modes, attr_count, 0);
+        }
+        return *this;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led::close_files ()
+    {
+        for (unsigned i=0; i<attr_count; ++i) {
+            if (attr_fds[i] >= 0) {
+                close (attr_fds[i]);
+                attr_fds[i] = -1;
+                attr_modes[i] = 0;
+            }
+        }
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    const char* led::attr_name (attr_t attr)
+    {
+        switch (attr) {
+        case attr_brightness:
+            return "brightness";
+        case attr_max_brightness:
+            return "max_brightness";
+        case attr_multi_intensity:
+            return "multi_intensity";
+        default:
+            return "trigger";
+        }
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Read the color names of a multicolor LED from multi_index.
+    // A LED without multi_index has no colors.
+    //--------------------------------------------------------------------------
+    void led::load_colors () const
+    {
+        colors.clear ();
+        int fd = open_attr ("multi_index", O_RDONLY);
+        if (fd < 0) {
+            colors_valid = errno == ENOENT;
+            return;
+        }
+        char buf[4096];
+        ssize_t len;
+        uint64_t start = detail::io_start ();
+        do {
+            len = pread (fd, buf, sizeof(buf), 0);
+        } while (len < 0  &&  errno == EINTR);
+        int errnum = errno;
+        if (start)
+            record_io (false, led_io_stats::multi_index, start, len);
+        close (fd);
+        if (len < 0) {
+            errno = errnum;
+            return;
+        }
+
+        std::string_view list (buf, len);
+        size_t pos = 0;
+        while ((pos = list.find_first_not_of(" \t\n", pos)) != std::string_view::npos) {
+            size_t end = list.find_first_of (" \t\n", pos);
+            if (end == std::string_view::npos)
+                end = list.size ();
+            colors.emplace_back (list.substr(pos, end-pos));
+            pos = end;
+        }
+        colors_valid = true;
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Open any attribute file of the LED device.
+    //--------------------------------------------------------------------------
+    int led::open_attr (const char* attr_name, int flags) const
+    {
+        uint64_t start = detail::io_start ();
+        int fd = openat (dir_fd, attr_name, flags | O_CLOEXEC);
+        if (start)
+            record_open (start, fd);
+        return fd;
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Return the statistics entry of the LED, looking it up when first
+    // needed. The entry is atomic since objects shared between threads,
+    // like shared_led, record I/O from several threads at once.
+    //--------------------------------------------------------------------------
+    detail::io_entry* led::stats_io_entry () const
+    {
+        auto entry = stats_entry.load (std::memory_order_acquire);
+        if (!entry) {
+            entry = detail::io_lookup (led_name);
+            stats_entry.store (entry, std::memory_order_release);
+        }
+        return entry;
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Add an open operation to the I/O statistics. Doesn't change errno.
+    //--------------------------------------------------------------------------
+    void led::record_open (uint64_t start, int result) const
+    {
+        int errnum = errno;
+        auto entry = stats_io_entry ();
+        if (entry)
+            detail::io_record (entry->open, start, result < 0 ? -1 : 0);
+        errno = errnum;
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Add a read or write operation to the I/O statistics.
+    // Attributes are counted using the values of attr_t, which
+    // are the same as those of led_io_stats::attribute.
+    // Doesn't change errno.
+    //--------------------------------------------------------------------------
+    void led::record_io (bool write, unsigned attribute, uint64_t start, ssize_t result) const
+    {
+        static_assert ((unsigned)led_io_stats::brightness == attr_brightness  &&
+                       (unsigned)led_io_stats::max_brightness == attr_max_brightness  &&
+                       (unsigned)led_io_stats::multi_intensity == attr_multi_intensity  &&
+                       (unsigned)led_io_stats::trigger == attr_trigger);
+        int errnum = errno;
+        auto entry = stats_io_entry ();
+        if (entry) {
+            auto& slots = write ? entry->write : entry->read;
+            detail::io_record (slots[attribute], start, result);
+        }
+        errno = errnum;
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Return a file descriptor to an attribute file that is opened
+    // with (at least) the requested access mode. The file is opened
+    // read/write if possible, so the same descriptor can be used for
+    // both reading and writing. Read-only attributes, or attributes
+    // we don't have write permission to, are opened read-only.
+    //--------------------------------------------------------------------------
+    int led::attr_fd (attr_t attr, int access_mode)
+    {
+        int fd = attr_fds[attr];
+        if (fd >= 0) {
+            if (attr_modes[attr] == O_RDWR  ||  attr_modes[attr] == access_mode)
+                return fd;
+            // The file is open, but not with the requested access mode
+            errno = EACCES;
+            return -1;
+        }
+
+        int mode = O_RDWR;
+        fd = open_attr (attr_name(attr), O_RDWR);
+        if (fd < 0  &&  (errno == EACCES || errno == EPERM)) {
+            mode = access_mode;
+            fd = open_attr (attr_name(attr), access_mode);
+        }
+        if (fd < 0)
+            return -1;
+
+        attr_fds[attr] = fd;
+        attr_modes[attr] = mode;
+        return fd;
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Get a file descriptor for accessing an attribute. Unless the
+    // object keeps its files open, or the file is already open, the
+    // file is opened only for this access and 'temporary' is set.
+    //--------------------------------------------------------------------------
+    int led::use_fd (attr_t attr, int access_mode, bool& temporary)
+    {
+        temporary = !(led_flags & keep_open)  &&  attr_fds[attr] < 0;
+        if (!temporary)
+            return attr_fd (attr, access_mode);
+        if (access_mode == O_WRONLY)
+            access_mode |= O_TRUNC;
+        return open_attr (attr_name(attr), access_mode);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led::release_fd (int fd, bool temporary)
+    {
+        if (temporary) {
+            int errnum = errno;
+            close (fd);
+            errno = errnum;
+        }
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    ssize_t led::read_attr (attr_t attr, char* buf, size_t size, off_t offset)
+    {
+        bool temporary;
+        int fd = use_fd (attr, O_RDONLY, temporary);
+        if (fd < 0)
+            return -1;
+        ssize_t result;
+        uint64_t start = detail::io_start ();
+        do {
+            result = pread (fd, buf, size, offset);
+        } while (result < 0  &&  errno == EINTR);
+        if (start)
+            record_io (false, attr, start, result);
+        release_fd (fd, temporary);
+        return result;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led::write_attr (attr_t attr, const char* buf, size_t len)
+    {
+        bool temporary;
+        int fd = use_fd (attr, O_WRONLY, temporary);
+        if (fd < 0)
+            return -1;
+        ssize_t result;
+        uint64_t start = detail::io_start ();
+        do {
+            result = pwrite (fd, buf, len, 0);
+        } while (result < 0  &&  errno == EINTR);
+        if (start)
+            record_io (true, attr, start, result);
+        release_fd (fd, temporary);
+        return result < 0 ? -1 : 0;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led::get_value (attr_t attr)
+    {
+        char buf[32];
+        ssize_t len = read_attr (attr, buf, sizeof(buf));
+        if (len < 0)
+            return -1;
+        return parse_value (buf, len);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led::parse_value (const char* buf, size_t len)
+    {
+        const char* first = buf;
+        const char* last = buf + len;
+        while (first < last  &&  (*first == ' ' || *first == '\t'))
+            ++first;
+        int value;
+        auto [ptr, ec] = std::from_chars (first, last, value);
+        if (ec != std::errc()) {
+            errno = EINVAL;
+            return -1;
+        }
+        return value;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led::set_value (attr_t attr, unsigned value)
+    {
+        char buf[16];
+        int len = format_value (buf, sizeof(buf), value);
+        if (len < 0)
+            return -1;
+        return write_attr (attr, buf, len);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led::format_value (char* buf, size_t size, unsigned value)
+    {
+        auto [ptr, ec] = std::to_chars (buf, buf+size-1, value);
+        if (ec != std::errc()) {
+            errno = EINVAL;
+            return -1;
+        }
+        *ptr++ = '\n';
+        return ptr - buf;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led::format_values (char* buf, size_t size, std::span<const unsigned> values)
+    {
+        char* pos = buf;
+        char* end = buf + size - 1;
+        for (auto value : values) {
+            if (pos == end) {
+                errno = EINVAL;
+                return -1;
+            }
+            *pos++ = ' ';
+            auto [ptr, ec] = std::to_chars (pos, end, value);
+            if (ec != std::errc()) {
+                errno = EINVAL;
+                return -1;
+            }
+            pos = ptr;
         }
+        *pos++ = '\n';
+        return pos - buf;
     }
 
 
     //--------------------------------------------------------------------------
     //--------------------------------------------------------------------------
-    int led::get_value (const std::filesystem::path& pathname)
+    int led::read_color_intensity (std::span<unsigned> values)
     {
-        int value = -1;
-        std::ifstream s (pathname);
-        if (s.good()) {
-            s >> value;
-            s.close ();
+        bool use_shadow = led_flags & shadow_state;
+        if (use_shadow  &&  (shadow.known & field_intensity)) {
+            if (shadow.intensity.size() > values.size()) {
+                errno = ENOBUFS;
+                return -1;
+            }
+            std::copy (shadow.intensity.begin(), shadow.intensity.end(), values.begin());
+            return shadow.intensity.size ();
         }
-        return s.fail() ? -1 : value;
+
+        char buf[intensity_buf_size];
+        ssize_t len = read_attr (attr_multi_intensity, buf, sizeof(buf));
+        if (len < 0)
+            return -1;
+        int num = parse_values (buf, len, values);
+        if (num < 0)
+            return -1;
+        if (use_shadow) {
+            shadow.intensity.assign (values.begin(), values.begin()+num);
+            shadow.known |= field_intensity;
+        }
+        return num;
     }
 
 
     //--------------------------------------------------------------------------
+    // Parse a space separated list of values, like multi_intensity.
     //--------------------------------------------------------------------------
-    int led::set_value (const std::filesystem::path& pathname, const std::string& value)
+    int led::parse_values (const char* buf, size_t len, std::span<unsigned> values)
     {
-        std::ofstream s (pathname);
-        if (s.good()) {
-            s << value;
-            s.close ();
+        size_t num = 0;
+        const char* pos = buf;
+        const char* end = std::find (buf, buf+len, '\n');
+        while (pos < end) {
+            if (*pos == ' ') {
+                ++pos;
+                continue;
+            }
+            if (num == values.size()) {
+                errno = ENOBUFS;
+                return -1;
+            }
+            auto [ptr, ec] = std::from_chars (pos, end, values[num]);
+            if (ec != std::errc()) {
+                errno = EINVAL;
+                return -1;
+            }
+            ++num;
+            pos = ptr;
         }
-        return s.fail() ? -1 : 0;
+        return num;
     }
 
 
@@ -104,29 +685,206 @@ namespace ledpp {
     std::vector<unsigned> led::color_intensity ()
     {
         std::vector<unsigned> ci;
-        if (colors.empty())
+        if (color_names().empty())
             return ci;
 
-        std::ifstream s (path_multi_intensity);
-        while (s.good()) {
-            unsigned value;
-            s >> value;
-            if (s.fail())
-                return ci;
-            ci.emplace_back (value);
-        }
+        ci.resize (colors.size());
+        int num = read_color_intensity (ci);
+        ci.resize (num<0 ? 0 : num);
         return ci;
     }
 
 
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led::color_intensity (std::span<const unsigned> values)
+    {
+        if (led_flags & shadow_state) {
+            if ((shadow.known & field_intensity)  &&
+                std::equal(values.begin(), values.end(), shadow.intensity.begin(), shadow.intensity.end()))
+            {
+                return 0;
+            }
+            if (led_flags & defer_writes) {
+                shadow.intensity.assign (values.begin(), values.end());
+                shadow.known |= field_intensity;
+                shadow.dirty |= field_intensity;
+                return 0;
+            }
+        }
+
+        char buf[intensity_buf_size];
+        int len = format_values (buf, sizeof(buf), values);
+        int result = len < 0 ? -1 : write_attr (attr_multi_intensity, buf, len);
+        if (led_flags & shadow_state) {
+            if (result == 0)
+                intensity_written (values);
+            else
+                shadow.known &= ~field_intensity;
+        }
+        return result;
+    }
+
+
     //--------------------------------------------------------------------------
     //--------------------------------------------------------------------------
     int led::color_intensity (const std::vector<unsigned>& values)
     {
-        std::stringstream ss;
-        for (auto value : values)
-            ss << ' ' << value;
-        return set_value (path_multi_intensity, ss.str());
+        return color_intensity (std::span<const unsigned>(values));
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Read the whole trigger file into trigger_buf.
+    //--------------------------------------------------------------------------
+    ssize_t led::read_trigger_file ()
+    {
+        return read_trigger_file (trigger_buf);
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Read the whole trigger file into a buffer. The kernel returns
+    // at most one page per read, and the list of triggers may be longer
+    // than that, so read until the end of the file.
+    //--------------------------------------------------------------------------
+    ssize_t led::read_trigger_file (std::string& buf)
+    {
+        static constexpr size_t min_page_size = 4096;
+
+        if (buf.size() < min_page_size)
+            buf.resize (min_page_size);
+
+        bool temporary;
+        int fd = use_fd (attr_trigger, O_RDONLY, temporary);
+        if (fd < 0)
+            return -1;
+
+        size_t total = 0;
+        uint64_t start = detail::io_start ();
+        while (true) {
+            if (total == buf.size())
+                buf.resize (buf.size() * 2);
+            size_t size = buf.size() - total;
+            ssize_t len = pread (fd, buf.data()+total, size, total);
+            if (len < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (start)
+                    record_io (false, attr_trigger, start, -1);
+                release_fd (fd, temporary);
+                return -1;
+            }
+            total += len;
+            if (len == 0  ||  ((size_t)len < size  &&  (size_t)len < min_page_size))
+                break;
+        }
+        if (start)
+            record_io (false, attr_trigger, start, total);
+        release_fd (fd, temporary);
+
+        // The trigger list is a single line
+        auto end = std::find (buf.data(), buf.data()+total, '\n');
+        return end - buf.data();
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    std::string_view led::read_trigger ()
+    {
+        if ((led_flags & shadow_state)  &&  (shadow.known & field_trigger))
+            return trigger_registry::name (shadow.trigger);
+
+        ssize_t len = read_trigger_file ();
+        if (len <= 0)
+            return {};
+        auto name = parse_active_trigger (std::string_view(trigger_buf.data(), len));
+        if (name.empty())
+            return {};
+        if (led_flags & shadow_state) {
+            shadow.trigger = trigger_registry::intern (name);
+            shadow.known |= field_trigger;
+        }
+        return name;
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Return the name within brackets in a trigger list,
+    // or an empty string if there is none.
+    //--------------------------------------------------------------------------
+    std::string_view led::parse_active_trigger (std::string_view list)
+    {
+        auto first = list.find ('[');
+        if (first == std::string_view::npos)
+            return {};
+        auto last = list.find (']', first);
+        if (last == std::string_view::npos)
+            return {};
+        return list.substr (first+1, last-first-1);
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Read the trigger file, intern all trigger names, and update the
+    // cached list of available triggers. The file is parsed in a single
+    // pass without copying any names that are already interned.
+    // Returns the id of the active trigger, or -1 on error.
+    //--------------------------------------------------------------------------
+    int led::parse_triggers ()
+    {
+        ssize_t len = read_trigger_file ();
+        if (len < 0) {
+            trigger_list.clear ();
+            trigger_list_valid = false;
+            return -1;
+        }
+
+        int active = -1;
+        trigger_list.clear ();
+        std::string_view list (trigger_buf.data(), len);
+        while (!list.empty()) {
+            auto pos = list.find (' ');
+            auto name = list.substr (0, pos);
+            list.remove_prefix (pos==std::string_view::npos ? list.size() : pos+1);
+            if (name.empty())
+                continue;
+            bool is_active = false;
+            if (name.size() >= 3  &&  name.front() == '['  &&  name.back() == ']') {
+                name = name.substr (1, name.size()-2);
+                is_active = true;
+            }
+            trigger_id id = trigger_registry::intern (name);
+            if (is_active)
+                active = id;
+            trigger_list.emplace_back (id);
+        }
+        std::sort (trigger_list.begin(), trigger_list.end());
+        trigger_list_valid = true;
+
+        if (active < 0)
+            errno = ENOENT;
+        return active;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    const std::vector<trigger_id>& led::available_triggers ()
+    {
+        if (!trigger_list_valid)
+            parse_triggers ();
+        return trigger_list;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led::reload_triggers ()
+    {
+        trigger_list.clear ();
+        trigger_list_valid = false;
     }
 
 
@@ -135,53 +893,394 @@ namespace ledpp {
     const std::set<std::string> led::triggers ()
     {
         std::set<std::string> trigger_set;
+        for (auto id : available_triggers())
+            trigger_set.emplace (trigger_registry::name(id));
+        return trigger_set;
+    }
 
-        std::ifstream s (path_trigger);
-        while (s.good()) {
-            std::string name;
-            s >> name;
-            if (!s.fail()) {
-                size_t len = name.size ();
-                if (len >= 3) {
-                    if (name.front() == '['  &&  name.back() == ']')
-                        name = name.substr (1, len-2);
-                }
-                trigger_set.emplace (name);
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led::active_trigger ()
+    {
+        if (led_flags & shadow_state) {
+            if (shadow.known & field_trigger)
+                return shadow.trigger;
+            int id = (!trigger_list_valid) ? parse_triggers() : -1;
+            if (id < 0) {
+                auto name = read_trigger ();
+                if (name.empty())
+                    return parse_triggers ();
+                id = trigger_registry::intern (name);
             }
+            shadow.trigger = id;
+            shadow.known |= field_trigger;
+            return id;
         }
-        return trigger_set;
+
+        if (!trigger_list_valid)
+            return parse_triggers ();
+
+        // Parse the whole list again if the active trigger can't be
+        // found, or if it is a trigger not seen before, which means
+        // that the list of triggers has changed
+        auto name = read_trigger ();
+        int id = name.empty() ? -1 : trigger_registry::find (name);
+        if (id < 0  ||  !std::binary_search(trigger_list.begin(), trigger_list.end(), (trigger_id)id))
+            return parse_triggers ();
+        return id;
     }
 
 
     //--------------------------------------------------------------------------
     //--------------------------------------------------------------------------
-    std::string led::trigger ()
+    int led::trigger (std::string_view name)
+    {
+        if (led_flags & shadow_state)
+            return set_trigger (trigger_registry::intern(name), name);
+        return write_trigger (name);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led::write_trigger (std::string_view name)
+    {
+        // Terminate the name with a newline, like "echo" would
+        char buf[128];
+        if (name.size() >= sizeof(buf))
+            return write_attr (attr_trigger, name.data(), name.size());
+        memcpy (buf, name.data(), name.size());
+        buf[name.size()] = '\n';
+        return write_attr (attr_trigger, buf, name.size()+1);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led::trigger (trigger_id id)
+    {
+        auto name = trigger_registry::name (id);
+        if (name.empty()) {
+            errno = EINVAL;
+            return -1;
+        }
+        if (led_flags & shadow_state)
+            return set_trigger (id, name);
+        return write_trigger (name);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    bool led::has_trigger (std::string_view name)
+    {
+        auto& ids = available_triggers (); // Interns the trigger names
+        int id = trigger_registry::find (name);
+        if (id < 0)
+            return false;
+        return std::binary_search (ids.begin(), ids.end(), (trigger_id)id);
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Write an attribute that exists only while a trigger is set,
+    // like "delay_on" of trigger "timer".
+    //--------------------------------------------------------------------------
+    int led::write_trigger_attr (const char* attr_name, const char* buf, size_t len)
+    {
+        int fd = open_attr (attr_name, O_WRONLY | O_TRUNC);
+        if (fd < 0)
+            return -1;
+        ssize_t result;
+        uint64_t start = detail::io_start ();
+        do {
+            result = pwrite (fd, buf, len, 0);
+        } while (result < 0  &&  errno == EINTR);
+        int errnum = errno;
+        if (start)
+            record_io (true, led_io_stats::trigger_attr, start, result);
+        close (fd);
+        errno = errnum;
+        return result < 0 ? -1 : 0;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led::write_trigger_attr (const char* attr_name, unsigned value)
+    {
+        char buf[16];
+        int len = format_value (buf, sizeof(buf), value);
+        if (len < 0)
+            return -1;
+        return write_trigger_attr (attr_name, buf, len);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led::timer (unsigned delay_on, unsigned delay_off)
+    {
+        if (trigger("timer")  ||
+            write_trigger_attr("delay_on", delay_on)  ||
+            write_trigger_attr("delay_off", delay_off))
+        {
+            return -1;
+        }
+        return 0;
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Format pattern steps the way the pattern trigger expects them:
+    // "brightness duration brightness duration ...\n"
+    //--------------------------------------------------------------------------
+    static int format_pattern (char* buf, size_t size, std::span<const led::pattern_step> steps)
     {
-        std::string active_trigger;
-        std::ifstream s (path_trigger);
-        while (s.good()) {
-            std::string name;
-            s >> name;
-            if (!s.fail()) {
-                size_t len = name.size ();
-                if (len >= 3) {
-                    if (name.front() == '['  &&  name.back() == ']') {
-                        active_trigger = name.substr (1, len-2);
-                        break;
+        char* pos = buf;
+        char* end = buf + size - 1;
+        for (auto& step : steps) {
+            for (unsigned value : {step.brightness, step.duration}) {
+                if (pos != buf) {
+                    if (pos == end) {
+                        errno = ENOBUFS;
+                        return -1;
                     }
+                    *pos++ = ' ';
+                }
+                auto [ptr, ec] = std::to_chars (pos, end, value);
+                if (ec != std::errc()) {
+                    errno = ENOBUFS;
+                    return -1;
                 }
+                pos = ptr;
             }
         }
-        return active_trigger;
+        *pos++ = '\n';
+        return pos - buf;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led::pattern (std::span<const pattern_step> steps, int repeat)
+    {
+        if (steps.size() < 2) {
+            errno = EINVAL;
+            return -1;
+        }
+        char buf[4096]; // The pattern trigger accepts at most a page
+        int len = format_pattern (buf, sizeof(buf), steps);
+        if (len < 0)
+            return -1;
+
+        if (trigger("pattern"))
+            return -1;
+        // Set repeat first, writing the pattern restarts it
+        char repeat_buf[16];
+        auto [ptr, ec] = std::to_chars (repeat_buf, repeat_buf+sizeof(repeat_buf)-1,
+                                        repeat < 0 ? -1 : repeat);
+        *ptr++ = '\n';
+        if (write_trigger_attr("repeat", repeat_buf, ptr-repeat_buf))
+            return -1;
+        return write_trigger_attr ("pattern", buf, len);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led::oneshot (unsigned delay_on, unsigned delay_off, bool invert)
+    {
+        if (trigger("oneshot")  ||
+            write_trigger_attr("delay_on", delay_on)  ||
+            write_trigger_attr("delay_off", delay_off)  ||
+            write_trigger_attr("invert", invert ? 1 : 0))
+        {
+            return -1;
+        }
+        return 0;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led::shot ()
+    {
+        return write_trigger_attr ("shot", "1\n", 2);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led::set_trigger (trigger_id id, std::string_view name)
+    {
+        if ((shadow.known & field_trigger)  &&  shadow.trigger == id)
+            return 0;
+        if (led_flags & defer_writes) {
+            shadow.trigger = id;
+            shadow.known |= field_trigger;
+            shadow.dirty |= field_trigger;
+            // Setting the trigger turns the LED off, so flush() must
+            // write the brightness again. Brightness 0 isn't written,
+            // since that would remove the new trigger.
+            if ((shadow.known & field_brightness)  &&  shadow.brightness != 0)
+                shadow.dirty |= field_brightness;
+            return 0;
+        }
+        int result = write_trigger (name);
+        if (result == 0)
+            trigger_written (id);
+        else
+            shadow.known &= ~field_trigger;
+        return result;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led::shadow_brightness ()
+    {
+        if (shadow.known & field_brightness)
+            return shadow.brightness;
+        int value = get_value (attr_brightness);
+        brightness_changed (value);
+        return value;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led::shadow_brightness (unsigned value)
+    {
+        // A deferred trigger change turns the LED off when flushed
+        if ((shadow.known & field_brightness)  &&  shadow.brightness == value  &&
+            !(shadow.dirty & field_trigger))
+        {
+            return 0;
+        }
+        if (led_flags & defer_writes) {
+            shadow.brightness = value;
+            shadow.known |= field_brightness;
+            shadow.dirty |= field_brightness;
+            return 0;
+        }
+        int result = set_value (attr_brightness, value);
+        if (result == 0)
+            brightness_written (value);
+        else
+            shadow.known &= ~field_brightness;
+        return result;
+    }
+
+
+    //--------------------------------------------------------------------------
+    // The brightness has been written to the LED.
+    //--------------------------------------------------------------------------
+    void led::brightness_written (unsigned value)
+    {
+        shadow.brightness = value;
+        shadow.known |= field_brightness;
+        shadow.dirty &= ~field_brightness;
+
+        // Turning off a LED removes its trigger
+        if (value == 0)
+            shadow.known &= ~field_trigger | shadow.dirty;
+    }
+
+
+    //--------------------------------------------------------------------------
+    // The brightness has been read, or a change has been notified.
+    //--------------------------------------------------------------------------
+    void led::brightness_changed (int value)
+    {
+        if (value < 0  ||  (shadow.dirty & field_brightness))
+            return;
+        shadow.brightness = value;
+        shadow.known |= field_brightness;
+    }
+
+
+    //--------------------------------------------------------------------------
+    // The color intensity has been written to the LED.
+    //--------------------------------------------------------------------------
+    void led::intensity_written (std::span<const unsigned> values)
+    {
+        shadow.intensity.assign (values.begin(), values.end());
+        shadow.known |= field_intensity;
+        shadow.dirty &= ~field_intensity;
+    }
+
+
+    //--------------------------------------------------------------------------
+    // A trigger has been written to the LED.
+    //--------------------------------------------------------------------------
+    void led::trigger_written (trigger_id id)
+    {
+        shadow.trigger = id;
+        shadow.known |= field_trigger;
+        shadow.dirty &= ~field_trigger;
+
+        // Setting a trigger may change the brightness
+        shadow.known &= ~field_brightness | shadow.dirty;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led::flush ()
+    {
+        if (shadow.dirty & field_trigger) {
+            if (write_trigger(trigger_registry::name(shadow.trigger)))
+                return -1;
+            trigger_written (shadow.trigger);
+        }
+        if (shadow.dirty & field_intensity) {
+            char buf[intensity_buf_size];
+            int len = format_values (buf, sizeof(buf), shadow.intensity);
+            if (len < 0  ||  write_attr(attr_multi_intensity, buf, len))
+                return -1;
+            shadow.dirty &= ~field_intensity;
+        }
+        if (shadow.dirty & field_brightness) {
+            if (set_value(attr_brightness, shadow.brightness))
+                return -1;
+            brightness_written (shadow.brightness);
+        }
+        return 0;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led::invalidate ()
+    {
+        shadow.known &= shadow.dirty;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    std::string led::trigger ()
+    {
+        return std::string (read_trigger());
     }
 
 
     //--------------------------------------------------------------------------
     //--------------------------------------------------------------------------
     std::set<std::string> led::led_names ()
+    {
+        return led_names (leds_dir());
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    std::set<std::string> led::led_names (const std::filesystem::path& dir)
     {
         std::set<std::string> names;
-        std::filesystem::directory_iterator dir_iter ("/sys/class/leds");
+        std::filesystem::directory_iterator dir_iter (dir);
         for (auto& entry : dir_iter) {
             std::string name = entry.path().filename().string ();
             if (name.empty() == false)
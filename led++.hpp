@@ -20,11 +20,18 @@
 #define LEDPP_LED_HPP
 
 #include <set>
+#include <new>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <span>
 #include <stdexcept>
 #include <filesystem>
 #include <system_error>
+#include <atomic>
+#include <cstdint>
+#include <sys/types.h>
+#include <led_expected.hpp>
 
 
 /**
@@ -33,18 +40,256 @@
 namespace ledpp {
 
 
+    /**
+     * Identifier of an interned trigger name.
+     * @see trigger_registry
+     */
+    using trigger_id = unsigned;
+
+
+    namespace detail {
+        struct io_entry;
+    }
+
+
+    /**
+     * Process-wide registry of trigger names.
+     * Each trigger name that has been seen by any led object is given
+     * a small integer id, so that trigger names can be stored and
+     * compared as integers instead of strings. Ids are never reused,
+     * and a name keeps its id for the lifetime of the process.
+     * All methods are thread-safe.
+     */
+    class trigger_registry {
+    public:
+        /**
+         * Return the id of a trigger name,
+         * adding the name to the registry if needed.
+         * @param name A trigger name.
+         * @return The id of the trigger name.
+         */
+        static trigger_id intern (std::string_view name);
+
+        /**
+         * Look up the id of a trigger name
+         * without adding it to the registry.
+         * @param name A trigger name.
+         * @return The id of the trigger name,
+         *         or -1 if the name isn't in the registry.
+         */
+        static int find (std::string_view name);
+
+        /**
+         * Return the name of a trigger id.
+         * @param id A trigger id.
+         * @return The trigger name, or an empty string if the id is
+         *         unknown. The returned view is valid for the lifetime
+         *         of the process.
+         */
+        static std::string_view name (trigger_id id);
+
+        /**
+         * Return the number of trigger names in the registry.
+         */
+        static size_t size ();
+    };
+
+
+    /**
+     * The state of all LEDs in the system at one point in time,
+     * stored as a structure of arrays. Element <code>i</code> of
+     * each array belongs to the LED named <code>names[i]</code>.
+     * @see led::snapshot_all
+     */
+    struct led_snapshot {
+        /**
+         * LED names, sorted.
+         */
+        std::vector<std::string> names;
+
+        /**
+         * Current brightness, or -1 if it couldn't be read.
+         */
+        std::vector<int> brightness;
+
+        /**
+         * Maximum brightness, or -1 if it couldn't be read.
+         */
+        std::vector<int> max_brightness;
+
+        /**
+         * Id of the active trigger, or -1 if it couldn't be read.
+         * @see trigger_registry
+         */
+        std::vector<int> trigger;
+
+        /**
+         * The colors of LED <code>i</code> are found at index
+         * <code>color_offset[i]</code> up to, but not including,
+         * <code>color_offset[i+1]</code> in arrays
+         * <code>color_names</code> and <code>color_intensity</code>.
+         * This array has one more element than the number of LEDs.
+         */
+        std::vector<unsigned> color_offset;
+
+        /**
+         * Color names of all multicolor LEDs.
+         */
+        std::vector<std::string> color_names;
+
+        /**
+         * Color intensity values of all multicolor LEDs,
+         * -1 if they couldn't be read.
+         */
+        std::vector<int> color_intensity;
+
+        /**
+         * Return the number of LEDs in the snapshot.
+         */
+        size_t size () const {
+            return names.size ();
+        }
+
+        /**
+         * Return the number of colors of a LED in the snapshot.
+         * @param i The index of the LED.
+         */
+        unsigned num_colors (size_t i) const {
+            return color_offset[i+1] - color_offset[i];
+        }
+
+        /**
+         * Write the snapshot to a file in a compact binary format.
+         * Triggers are stored by name. The file is written to a
+         * temporary file first, and then renamed, so an existing
+         * file is replaced atomically.
+         * @param file The name of the file.
+         * @throw std::system_error If the file can't be written.
+         */
+        void save (const std::filesystem::path& file) const;
+
+        /**
+         * Read a snapshot written by save().
+         * @param file The name of the file.
+         * @return The snapshot.
+         * @throw std::system_error If the file can't be read,
+         *        or isn't a valid snapshot file (<code>EINVAL</code>).
+         */
+        static led_snapshot load (const std::filesystem::path& file);
+    };
+
+
     /**
      * Class to interface with LED devices in Linux.
      */
     class led {
     public:
+        /**
+         * Flags controlling how a led object accesses the LED device.
+         */
+        enum flags_t : unsigned {
+            /**
+             * Keep the sysfs attribute files of the LED open between
+             * calls, and access them using <code>pread</code> and
+             * <code>pwrite</code>. This avoids opening and closing a
+             * file on each access, at the cost of keeping a few file
+             * descriptors open for as long as the object exists.
+             */
+            keep_open = 0x01,
+
+            /**
+             * Remember the last brightness, color intensity, and
+             * trigger written to or read from the LED. Reads are
+             * served from the remembered state when it is known, and
+             * writes that wouldn't change anything are skipped.
+             * The remembered state is kept in sync by led_watcher
+             * notifications and led_batch commits, and can be
+             * discarded using invalidate().
+             */
+            shadow_state = 0x02,
+
+            /**
+             * Don't write brightness, color intensity, and trigger
+             * changes until flush() is called. Only changed values
+             * are written. Implies <code>shadow_state</code>.
+             */
+            defer_writes = 0x04,
+        };
+
+        /**
+         * Default directory where LED devices are found.
+         */
+        static constexpr const char* default_leds_dir = "/sys/class/leds";
+
+        /**
+         * Name of the environment variable that, if set,
+         * overrides the default LED class directory.
+         */
+        static constexpr const char* leds_dir_env = "LEDPP_LEDS_DIR";
+
+        /**
+         * Return the directory where LED devices are found.
+         * This is the value of environment variable
+         * <code>LEDPP_LEDS_DIR</code> if it is set and not empty,
+         * otherwise <code>/sys/class/leds</code>.
+         * @return The LED class directory.
+         */
+        static std::filesystem::path leds_dir ();
+
         /**
          * Create an object to interface with a LED device.
+         * The LED is looked up in the directory returned by leds_dir().
+         * Only the LED directory is opened, attribute files and
+         * the color names are read when first needed.
+         * @param name_arg The name of the LED.
+         * @param flags A bitmask of values from led::flags_t.
+         * @throw std::system_error If the LED doesn't exist,
+         *                          or can't be accessed.
+         */
+        led (const std::string& name_arg, unsigned flags=0);
+
+        /**
+         * Create an object to interface with a LED device
+         * located in a specific directory.
+         * This is mainly useful for testing and benchmarking
+         * using a fake LED class directory.
          * @param name_arg The name of the LED.
+         * @param leds_dir The directory where the LED is found.
+         * @param flags A bitmask of values from led::flags_t.
          * @throw std::system_error If the LED doesn't exist,
          *                          or can't be accessed.
          */
-        led (const std::string& name_arg);
+        led (const std::string& name_arg,
+             const std::filesystem::path& leds_dir,
+             unsigned flags=0);
+
+        /**
+         * Copy constructor.
+         * Open files are not shared with the new object, it will
+         * open its own files when needed.
+         */
+        led (const led& l);
+
+        /**
+         * Move constructor.
+         */
+        led (led&& l) noexcept;
+
+        /**
+         * Destructor.
+         * Closes any open attribute files.
+         */
+        ~led ();
+
+        /**
+         * Copy assignment operator.
+         */
+        led& operator= (const led& l);
+
+        /**
+         * Move assignment operator.
+         */
+        led& operator= (led&& l) noexcept;
 
         /**
          * Return the name of the LED.
@@ -56,11 +301,14 @@ namespace ledpp {
 
         /**
          * Get the maximum brightness value of the LED.
+         * The value never changes, so it is read once and then cached.
          * @return A maximum brightness value, or -1 on error.
          *         On error, <code>errno</code> is set.
          */
         int max_brightness () {
-            return get_value (path_max_brightness);
+            if (max_value < 0)
+                max_value = get_value (attr_max_brightness);
+            return max_value;
         }
 
         /**
@@ -69,7 +317,9 @@ namespace ledpp {
          *         On error, <code>errno</code> is set.
          */
         int brightness () {
-            return get_value (path_brightness);
+            if (led_flags & shadow_state)
+                return shadow_brightness ();
+            return get_value (attr_brightness);
         }
 
         /**
@@ -79,7 +329,9 @@ namespace ledpp {
          *         <code>errno</code> is set.
          */
         int brightness (unsigned value) {
-            return set_value (path_brightness, std::to_string(value));
+            if (led_flags & shadow_state)
+                return shadow_brightness (value);
+            return set_value (attr_brightness, value);
         }
 
         /**
@@ -88,7 +340,7 @@ namespace ledpp {
          *         <code>false</code> if not.
          */
         bool is_multicolor () const {
-            return !colors.empty();
+            return !color_names().empty();
         }
 
         /**
@@ -97,6 +349,8 @@ namespace ledpp {
          *         empty if this isn't a multicolor LED.
          */
         const std::vector<std::string>& color_names () const {
+            if (!colors_valid)
+                load_colors ();
             return colors;
         }
 
@@ -118,52 +372,551 @@ namespace ledpp {
          * formula:<br/>
          * <code>color_brightness = brightness * color_intensity/max_brightness</code>
          *
-         * @param values A vector of intensity values for each individual color.
+         * This method doesn't allocate any memory.
+         *
+         * @param values Intensity values for each individual color.
          *               The number of intensity values must match the number
          *               of colors this LED has.
          * @return 0 on success. -1 on error, and <code>errno</code> is set.
          */
+        int color_intensity (std::span<const unsigned> values);
+
+        /**
+         * Set the intensity of each individual color for a multicolor LED.
+         * Same as color_intensity(std::span<const unsigned>), kept so
+         * that code passing a vector or a braced list, like
+         * <code>l.color_intensity({255, 0, 0})</code>, still compiles.
+         * @param values Intensity values for each individual color.
+         * @return 0 on success. -1 on error, and <code>errno</code> is set.
+         */
         int color_intensity (const std::vector<unsigned>& values);
 
+        /**
+         * Read the intensity of each color of a multicolor LED
+         * into a buffer provided by the caller.
+         * This method doesn't allocate any memory.
+         *
+         * @param values Buffer where the intensity values are stored.
+         * @return The number of values read, or -1 on error
+         *         and <code>errno</code> is set.
+         *         If the buffer is too small, -1 is returned and
+         *         <code>errno</code> is set to <code>ENOBUFS</code>.
+         */
+        int read_color_intensity (std::span<unsigned> values);
+
         /**
          * Return the available triggers for the LED.
+         * The list of available triggers is read once and then cached,
+         * see reload_triggers().
          * @return A set of strings containing the names of
          *         the available triggers for this LED.
          */
         const std::set<std::string> triggers ();
 
+        /**
+         * Return the ids of the available triggers for the LED.
+         * The first call reads and parses the trigger file, following
+         * calls return the cached list without any I/O until
+         * reload_triggers() is called.
+         * @return A sorted vector of trigger ids. The vector is empty
+         *         if the triggers can't be read.
+         * @see trigger_registry
+         */
+        const std::vector<trigger_id>& available_triggers ();
+
+        /**
+         * Forget the cached list of available triggers.
+         * The list is read again on next call to available_triggers()
+         * or triggers(). The available triggers only change when
+         * trigger modules are loaded or unloaded.
+         */
+        void reload_triggers ();
+
+        /**
+         * Return the id of the current trigger for this LED.
+         * @return A trigger id, or -1 on error.
+         * @see trigger_registry
+         */
+        int active_trigger ();
+
         /**
          * Return the name of the current trigger for this LED.
          * @return A trigger name.
          */
         std::string trigger ();
 
+        /**
+         * Return the name of the current trigger for this LED
+         * without allocating memory once the internal buffer has
+         * grown large enough to hold the list of triggers.
+         * @return A trigger name, or an empty string on error.
+         *         The returned view refers to a buffer in this object,
+         *         and is valid until the next call to a method reading
+         *         the trigger.
+         */
+        std::string_view read_trigger ();
+
+        /**
+         * Set a trigger for this LED.
+         * @param name The name of the trigger.
+         * @return 0 on success, -1 on error.
+         */
+        int trigger (std::string_view name);
+
         /**
          * Set a trigger for this LED.
          * @param name The name of the trigger.
          * @return 0 on success, -1 on error.
          */
         int trigger (const std::string& name) {
-            return set_value (path_trigger, name);
+            return trigger (std::string_view(name));
+        }
+
+        /**
+         * Set a trigger for this LED.
+         * This overload makes calls with a string literal unambiguous.
+         * @param name The name of the trigger.
+         * @return 0 on success, -1 on error.
+         */
+        int trigger (const char* name) {
+            return trigger (std::string_view(name));
         }
 
+        /**
+         * Set a trigger for this LED by trigger id.
+         * @param id The id of the trigger.
+         * @return 0 on success, -1 on error and <code>errno</code> is set.
+         * @see trigger_registry
+         */
+        int trigger (trigger_id id);
+
+        /**
+         * Check if a trigger is available for this LED.
+         * @param name The name of the trigger.
+         * @return <code>true</code> if the trigger is available.
+         */
+        bool has_trigger (std::string_view name);
+
+        /**
+         * Let the kernel blink the LED using the <code>timer</code> trigger.
+         * The LED blinks with its current brightness, or with
+         * max brightness if the LED is off. Setting a non-zero
+         * brightness while blinking changes the blink brightness,
+         * setting brightness 0 stops the blinking.
+         * @param delay_on The time the LED is on, in milliseconds.
+         * @param delay_off The time the LED is off, in milliseconds.
+         * @return 0 on success, -1 on error and <code>errno</code> is set.
+         */
+        int timer (unsigned delay_on, unsigned delay_off);
+
+        /**
+         * One step of a brightness pattern.
+         * The brightness changes linearly from the brightness of
+         * one step to the brightness of the next step during the
+         * duration of the step. Use two steps with the same brightness
+         * and a duration of 0 for the second one to make a sharp edge.
+         */
+        struct pattern_step {
+            unsigned brightness; /**< Brightness at the start of the step. */
+            unsigned duration;   /**< Duration of the step in milliseconds. */
+        };
+
+        /**
+         * Let the kernel run a brightness pattern using
+         * the <code>pattern</code> trigger.
+         * @param steps The steps of the pattern, at least two.
+         * @param repeat The number of times to run the pattern.
+         *               -1 means repeat until another trigger is set.
+         * @return 0 on success, -1 on error and <code>errno</code> is set.
+         */
+        int pattern (std::span<const pattern_step> steps, int repeat=-1);
+
+        /**
+         * Prepare the LED for one-shot blinks using the
+         * <code>oneshot</code> trigger. Each call to shot()
+         * makes the LED blink once.
+         * @param delay_on The time the LED is on, in milliseconds.
+         * @param delay_off The minimum time the LED is off
+         *                  before the next shot, in milliseconds.
+         * @param invert If <code>true</code>, the LED is on
+         *               when idle, and is turned off by a shot.
+         * @return 0 on success, -1 on error and <code>errno</code> is set.
+         */
+        int oneshot (unsigned delay_on, unsigned delay_off, bool invert=false);
+
+        /**
+         * Make a LED prepared using oneshot() blink once.
+         * @return 0 on success, -1 on error and <code>errno</code> is set.
+         */
+        int shot ();
+
         /**
          * Get a list of available led devices in the system.
+         * The LEDs are looked up in the directory returned by leds_dir().
          * @return A list of led names.
          */
         static std::set<std::string> led_names ();
 
+        /**
+         * Get a list of available led devices in a specific directory.
+         * @param dir The directory where the LEDs are found.
+         * @return A list of led names.
+         */
+        static std::set<std::string> led_names (const std::filesystem::path& dir);
+
+        /**
+         * Read the state of all LEDs in the system.
+         * The LEDs are read concurrently by a small pool of threads.
+         * The LEDs are looked up in the directory returned by leds_dir().
+         * @param num_threads The number of threads to use. 0 means
+         *                    choose a number based on the number
+         *                    of LEDs and CPUs.
+         * @return A snapshot of the state of all LEDs.
+         * @throw std::filesystem::filesystem_error If the LED
+         *        directory can't be read.
+         */
+        static led_snapshot snapshot_all (unsigned num_threads=0);
+
+        /**
+         * Read the state of all LEDs in a specific directory.
+         * @param dir The directory where the LEDs are found.
+         * @param num_threads The number of threads to use. 0 means
+         *                    choose a number based on the number
+         *                    of LEDs and CPUs.
+         * @return A snapshot of the state of all LEDs.
+         * @throw std::filesystem::filesystem_error If the LED
+         *        directory can't be read.
+         */
+        static led_snapshot snapshot_all (const std::filesystem::path& dir, unsigned num_threads=0);
+
+        /**
+         * Read the state of some LEDs.
+         * The LEDs are read concurrently like by snapshot_all().
+         * @param names The names of the LEDs, in the order
+         *              they appear in the snapshot.
+         * @param dir The directory where the LEDs are found.
+         * @param num_threads The number of threads to use. 0 means
+         *                    choose a number based on the number
+         *                    of LEDs and CPUs.
+         * @return A snapshot of the state of the LEDs. LEDs that
+         *         can't be read have no values in the snapshot.
+         */
+        static led_snapshot snapshot (std::vector<std::string> names,
+                                      const std::filesystem::path& dir,
+                                      unsigned num_threads=0);
+
+        /**
+         * Restore the state of LEDs saved in a snapshot.
+         * The LEDs are looked up in the directory returned by leds_dir().
+         * @see restore(const led_snapshot&, const std::filesystem::path&, size_t*)
+         */
+        static int restore (const led_snapshot& state, size_t* num_writes=nullptr);
+
+        /**
+         * Restore the state of LEDs saved in a snapshot.
+         *
+         * The current state of the LEDs is read in bulk like by
+         * snapshot(), and only attributes that differ from the saved
+         * state are written. The writes are made in one led_frame
+         * commit, in the order trigger, color intensity, brightness
+         * for each LED, since setting a trigger turns the LED off.
+         * The brightness of a LED is only restored if its trigger
+         * is <code>none</code>, otherwise the brightness is controlled
+         * by the trigger, and writing 0 would remove the trigger.
+         * Brightness values are limited to the current max brightness.
+         * LEDs in the snapshot that no longer exist, and values that
+         * couldn't be read when the snapshot was made, are skipped.
+         * LEDs that already have the saved state cost no writes.
+         *
+         * @param state The saved state.
+         * @param dir The directory where the LEDs are found.
+         * @param num_writes If not null, set to the number of
+         *                   attributes that differed from the saved
+         *                   state, and were written or attempted to
+         *                   be written. If the restore fails, some of
+         *                   them may not have been written.
+         * @return 0 on success. -1 if one or more writes failed,
+         *         and <code>errno</code> is set to the first error.
+         */
+        static int restore (const led_snapshot& state,
+                            const std::filesystem::path& dir,
+                            size_t* num_writes=nullptr);
+
+        /**
+         * Write all changes made since the last flush.
+         * This is only needed for objects created with flag
+         * <code>defer_writes</code>. Changes are written in the order
+         * trigger, color intensity, brightness, since setting a
+         * trigger may change the brightness.
+         * @return 0 on success, -1 on error and <code>errno</code>
+         *         is set. Changes that couldn't be written are kept,
+         *         and are written by the next flush.
+         */
+        int flush ();
+
+        /**
+         * Check if there are changes not yet written by flush().
+         */
+        bool dirty () const {
+            return shadow.dirty != 0;
+        }
+
+        /**
+         * Forget the remembered brightness, color intensity,
+         * and trigger, so they are read from the LED the next time.
+         * Changes not yet written by flush() are kept.
+         * This is only useful for objects created with flag
+         * <code>shadow_state</code> or <code>defer_writes</code>.
+         */
+        void invalidate ();
+
+        /**
+         * Close any attribute files kept open by this object.
+         * If the object was created with flag <code>keep_open</code>,
+         * the files are opened again when next accessed.
+         */
+        void close_files ();
+
+
+        /**
+         * @name Non-throwing interface
+         * Methods that report errors as a <code>std::error_code</code>
+         * in the return value, instead of by an exception or by -1 and
+         * <code>errno</code>. They are all <code>noexcept</code>, and
+         * can be used by applications built without exceptions. A
+         * failed memory allocation terminates the program, like it
+         * does in a build without exceptions. Each method behaves like
+         * the method with the same name without the <code>try_</code>
+         * prefix.
+         * @{
+         */
+
+        /**
+         * Create an object to interface with a LED device.
+         * The LED is looked up in the directory returned by leds_dir().
+         * @param name The name of the LED.
+         * @param flags A bitmask of values from led::flags_t.
+         * @return The led object, or an error. The error is
+         *         <code>ENODEV</code> if the LED doesn't exist.
+         */
+        static expected<led> open (const std::string& name, unsigned flags=0) noexcept;
+
+        /**
+         * Create an object to interface with a LED device
+         * located in a specific directory.
+         * @param name The name of the LED.
+         * @param dir The directory where the LED is found.
+         * @param flags A bitmask of values from led::flags_t.
+         * @return The led object, or an error. The error is
+         *         <code>ENODEV</code> if the LED doesn't exist.
+         */
+        static expected<led> open (const std::string& name,
+                                   const std::filesystem::path& dir,
+                                   unsigned flags=0) noexcept;
+
+        /**
+         * Get the maximum brightness value of the LED.
+         */
+        expected<unsigned> try_max_brightness () noexcept;
+
+        /**
+         * Get the current brightness value of the LED.
+         */
+        expected<unsigned> try_brightness () noexcept;
+
+        /**
+         * Set the current brightness value of the LED.
+         */
+        expected<void> try_brightness (unsigned value) noexcept;
+
+        /**
+         * Return the color names of a multicolor LED.
+         * The list is empty if this isn't a multicolor LED.
+         * @return A view of the names, valid for the
+         *         lifetime of this object.
+         */
+        expected<std::span<const std::string>> try_color_names () const noexcept;
+
+        /**
+         * Return the intensity of each color of a multicolor LED.
+         */
+        expected<std::vector<unsigned>> try_color_intensity () noexcept;
+
+        /**
+         * Set the intensity of each color of a multicolor LED.
+         */
+        expected<void> try_color_intensity (std::span<const unsigned> values) noexcept;
+
+        /**
+         * Read the intensity of each color of a multicolor LED
+         * into a buffer provided by the caller.
+         * @return The number of values read.
+         */
+        expected<size_t> try_read_color_intensity (std::span<unsigned> values) noexcept;
+
+        /**
+         * Return the names of the available triggers for the LED.
+         */
+        expected<std::set<std::string>> try_triggers () noexcept;
+
+        /**
+         * Return the ids of the available triggers for the LED.
+         * @return A view of the sorted ids, valid until the
+         *         list of triggers is read again.
+         */
+        expected<std::span<const trigger_id>> try_available_triggers () noexcept;
+
+        /**
+         * Check if a trigger is available for this LED.
+         */
+        expected<bool> try_has_trigger (std::string_view name) noexcept;
+
+        /**
+         * Return the id of the current trigger for this LED.
+         */
+        expected<trigger_id> try_active_trigger () noexcept;
+
+        /**
+         * Return the name of the current trigger for this LED.
+         */
+        expected<std::string> try_trigger () noexcept;
+
+        /**
+         * Return the name of the current trigger for this LED
+         * without allocating memory, see read_trigger().
+         */
+        expected<std::string_view> try_read_trigger () noexcept;
+
+        /**
+         * Set a trigger for this LED.
+         */
+        expected<void> try_trigger (std::string_view name) noexcept;
+
+        /**
+         * Set a trigger for this LED by trigger id.
+         */
+        expected<void> try_trigger (trigger_id id) noexcept;
+
+        /**
+         * Let the kernel blink the LED using the <code>timer</code> trigger.
+         */
+        expected<void> try_timer (unsigned delay_on, unsigned delay_off) noexcept;
+
+        /**
+         * Let the kernel run a brightness pattern using
+         * the <code>pattern</code> trigger.
+         */
+        expected<void> try_pattern (std::span<const pattern_step> steps, int repeat=-1) noexcept;
+
+        /**
+         * Prepare the LED for one-shot blinks using the
+         * <code>oneshot</code> trigger.
+         */
+        expected<void> try_oneshot (unsigned delay_on, unsigned delay_off, bool invert=false) noexcept;
+
+        /**
+         * Make a LED prepared using oneshot() blink once.
+         */
+        expected<void> try_shot () noexcept;
+
+        /**
+         * Write all changes made since the last flush.
+         */
+        expected<void> try_flush () noexcept;
+
+        /**
+         * Get a list of available led devices in the system.
+         * The LEDs are looked up in the directory returned by leds_dir().
+         */
+        static expected<std::set<std::string>> try_led_names () noexcept;
+
+        /**
+         * Get a list of available led devices in a specific directory.
+         */
+        static expected<std::set<std::string>> try_led_names (const std::filesystem::path& dir) noexcept;
+
+        /** @} */
+
 
     private:
+        friend class led_batch;
+        friend class led_watcher;
+        friend class led_executor;
+        friend class shared_led;
+
+        enum field_t : unsigned {
+            field_brightness = 0x01,
+            field_intensity  = 0x02,
+            field_trigger    = 0x04,
+        };
+
+        // State remembered with flag shadow_state
+        struct shadow_t {
+            unsigned known;
+            unsigned dirty;
+            unsigned brightness;
+            trigger_id trigger;
+            std::vector<unsigned> intensity;
+        };
+
+        // Size of the buffers used to read and write multi_intensity
+        static constexpr size_t intensity_buf_size = 512;
+
+        enum attr_t {
+            attr_brightness = 0,
+            attr_max_brightness,
+            attr_multi_intensity,
+            attr_trigger,
+            attr_count
+        };
+
         std::string led_name;
-        std::vector<std::string> colors;
-        std::filesystem::path path_brightness;
-        std::filesystem::path path_max_brightness;
-        std::filesystem::path path_multi_intensity;
-        std::filesystem::path path_trigger;
-
-        static int get_value (const std::filesystem::path& pathname);
-        static int set_value (const std::filesystem::path& pathname, const std::string& value);
+        unsigned led_flags;
+        int attr_fds[attr_count];
+        int attr_modes[attr_count];
+        int dir_fd;
+        int max_value;
+        mutable std::atomic<detail::io_entry*> stats_entry;
+        mutable std::vector<std::string> colors;
+        mutable bool colors_valid;
+        std::string trigger_buf;
+        std::vector<trigger_id> trigger_list;
+        bool trigger_list_valid;
+        shadow_t shadow;
+
+        led (const std::string& name_arg, unsigned flags, std::nothrow_t) noexcept;
+        int open_dir (const std::filesystem::path& leds_dir) noexcept;
+        static const char* attr_name (attr_t attr);
+        void load_colors () const;
+        int open_attr (const char* attr_name, int flags) const;
+        int attr_fd (attr_t attr, int access_mode);
+        int use_fd (attr_t attr, int access_mode, bool& temporary);
+        static void release_fd (int fd, bool temporary);
+        ssize_t read_attr (attr_t attr, char* buf, size_t size, off_t offset=0);
+        int write_attr (attr_t attr, const char* buf, size_t len);
+        int get_value (attr_t attr);
+        int set_value (attr_t attr, unsigned value);
+        static int parse_value (const char* buf, size_t len);
+        static int parse_values (const char* buf, size_t len, std::span<unsigned> values);
+        static std::string_view parse_active_trigger (std::string_view list);
+        static int format_value (char* buf, size_t size, unsigned value);
+        static int format_values (char* buf, size_t size, std::span<const unsigned> values);
+        ssize_t read_trigger_file ();
+        ssize_t read_trigger_file (std::string& buf);
+        int parse_triggers ();
+        int write_trigger (std::string_view name);
+        int write_trigger_attr (const char* attr_name, const char* buf, size_t len);
+        int write_trigger_attr (const char* attr_name, unsigned value);
+        int set_trigger (trigger_id id, std::string_view name);
+        int shadow_brightness ();
+        int shadow_brightness (unsigned value);
+        void brightness_written (unsigned value);
+        void brightness_changed (int value);
+        void intensity_written (std::span<const unsigned> values);
+        void trigger_written (trigger_id id);
+        detail::io_entry* stats_io_entry () const;
+        void record_open (uint64_t start, int result) const;
+        void record_io (bool write, unsigned attribute, uint64_t start, ssize_t result) const;
     };
 
 
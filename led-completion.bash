@@ -5,10 +5,10 @@ fi
 
 _bash_led_completion() {
     local cur prev words
-    local opts="-l|-i|-c|-t|-h"
-    local copts="-l -i -c -t -h"
-    local long_opts="--list|--info|--colors|--trigger|--help"
-    local clong_opts="--list --info --colors --trigger --help"
+    local opts="-l|-i|-c|-t|-e|-b|-f|-D|-s|-p|-C|-h"
+    local copts="-l -i -c -t -e -b -f -D -s -p -C -h"
+    local long_opts="--list|--info|--colors|--trigger|--effect|--batch|--file|--daemon|--stats|--play|--loops|--fifo|--cpu|--convert|--save|--restore|--help"
+    local clong_opts="--list --info --colors --trigger --effect --batch --file --daemon --stats --play --loops --fifo --cpu --convert --save --restore --help"
     local triggers
     local completed
 
@@ -16,7 +16,12 @@ _bash_led_completion() {
 
     _get_comp_words_by_ref -n : cur prev words
 
-    if [ "${prev}" = "-t" -o "${prev}" = "--trigger" ]; then
+    if [ "${prev}" = "-f" -o "${prev}" = "--file" -o "${prev}" = "-p" -o "${prev}" = "--play" \
+         -o "${prev}" = "--save" -o "${prev}" = "--restore" ]; then
+        _filedir
+    elif [[ " ${words[*]} " == *" -C "* || " ${words[*]} " == *" --convert "* ]] && [[ ${cur} != -* ]]; then
+        _filedir
+    elif [ "${prev}" = "-t" -o "${prev}" = "--trigger" ]; then
         _count_args
         if [ -n "$_bash_led_completion_led_name" -a "$args" != "1" ]; then
             triggers=(`lsled -t $_bash_led_completion_led_name 2>/dev/null`)
@@ -50,10 +55,10 @@ complete -F _bash_led_completion led
 
 _bash_lsled_completion() {
     local cur prev
-    local opts="-n|-t|-h"
-    local copts="-n -t -h"
-    local long_opts="--names|--triggers|--help"
-    local clong_opts="--names --triggers --help"
+    local opts="-n|-t|-s|-d|-c|-f|-w|-j|-h"
+    local copts="-n -t -s -d -c -f -w -j -h"
+    local long_opts="--names|--triggers|--stats|--device|--color|--function|--watch|--json|--help"
+    local clong_opts="--names --triggers --stats --device --color --function --watch --json --help"
     local names
     local completed
 
@@ -66,6 +71,16 @@ _bash_lsled_completion() {
         if [ -n "${completed}" ] ; then
             COMPREPLY=( $(compgen -W "${completed[*]}" -- ${cur}) )
         fi
+    elif [[ ${prev} == @(-d|--device|-c|--color|-f|--function) ]]; then
+        # LED names are DEVICE:COLOR:FUNCTION
+        case "${prev}" in
+            -d|--device) completed=(`lsled -n 2>/dev/null | awk -F: 'NF>2 {print $1}' | sort -u`) ;;
+            -c|--color) completed=(`lsled -n 2>/dev/null | awk -F: 'NF>1 && $(NF-1)!="" {print $(NF-1)}' | sort -u`) ;;
+            -f|--function) completed=(`lsled -n 2>/dev/null | awk -F: '$NF!="" {print $NF}' | sort -u`) ;;
+        esac
+        if [ -n "${completed}" ] ; then
+            COMPREPLY=( $(compgen -W "${completed[*]}" -- ${cur}) )
+        fi
     elif [[ ${cur} == --* ]] ; then
         COMPREPLY=( $(compgen -W "${clong_opts}" -S ' ' -- ${cur}) )
     elif [[ ${cur} == "-" ]] ; then
@@ -0,0 +1,400 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <led_batch.hpp>
+#include <uring.hpp>
+#include <io_recorder.hpp>
+#include <cerrno>
+#include <cstdint>
+#include <fcntl.h>
+
+
+namespace ledpp {
+
+
+    // Operation codes stored in the lowest bits of the io_uring user data
+    static constexpr uint64_t op_trigger    = 0;
+    static constexpr uint64_t op_intensity  = 1;
+    static constexpr uint64_t op_brightness = 2;
+    static constexpr unsigned op_bits       = 2;
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    led_batch::led_batch (unsigned queue_depth)
+        : num_entries (0)
+    {
+        if (queue_depth < 3)
+            queue_depth = 3;
+        try {
+            ring = std::make_unique<uring> (queue_depth);
+            if (!ring->supports(IORING_OP_WRITE))
+                ring.reset ();
+        }
+        catch (std::system_error&) {
+            // io_uring not available, write one by one
+            ring.reset ();
+        }
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    led_batch::~led_batch ()
+    {
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    led_batch::entry& led_batch::get_entry (led& l)
+    {
+        auto [i, inserted] = index.try_emplace (&l, num_entries);
+        if (!inserted)
+            return entries[i->second];
+
+        if (num_entries == entries.size())
+            entries.emplace_back ();
+        entry& e = entries[num_entries++];
+        e.target = &l;
+        e.pending = 0;
+        e.errnum = 0;
+        return e;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led_batch::brightness (led& l, unsigned value)
+    {
+        entry& e = get_entry (l);
+        e.brightness = value;
+        e.pending |= pending_brightness;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led_batch::color_intensity (led& l, std::span<const unsigned> values)
+    {
+        entry& e = get_entry (l);
+        e.intensity.assign (values.begin(), values.end());
+        e.pending |= pending_intensity;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led_batch::trigger (led& l, std::string_view name)
+    {
+        entry& e = get_entry (l);
+        e.trigger.assign (name);
+        e.pending |= pending_trigger;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led_batch::clear ()
+    {
+        num_entries = 0;
+        index.clear ();
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Drop writes of values the LED is already known to have.
+    //--------------------------------------------------------------------------
+    void led_batch::elide_writes (entry& e)
+    {
+        auto& shadow = e.target->shadow;
+        unsigned clean = shadow.known & ~shadow.dirty;
+
+        if ((e.pending & pending_trigger)  &&  (clean & led::field_trigger)  &&
+            trigger_registry::name(shadow.trigger) == e.trigger)
+        {
+            e.pending &= ~pending_trigger;
+        }
+        if ((e.pending & pending_intensity)  &&  (clean & led::field_intensity)  &&
+            e.intensity == shadow.intensity)
+        {
+            e.pending &= ~pending_intensity;
+        }
+        // Setting a trigger turns the LED off, so the brightness
+        // must be written after a trigger change even if it's the same
+        if ((e.pending & pending_brightness)  &&  (clean & led::field_brightness)  &&
+            !(e.pending & pending_trigger)  &&  !(shadow.dirty & led::field_trigger)  &&
+            e.brightness == shadow.brightness)
+        {
+            e.pending &= ~pending_brightness;
+        }
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Update the shadow state of a LED after a commit.
+    //--------------------------------------------------------------------------
+    void led_batch::update_shadow (entry& e)
+    {
+        led& l = *e.target;
+        if (e.errnum) {
+            // Unknown which of the writes that succeeded
+            if (e.pending & pending_trigger)
+                l.shadow.known &= ~(led::field_trigger | led::field_brightness);
+            if (e.pending & pending_intensity)
+                l.shadow.known &= ~led::field_intensity;
+            if (e.pending & pending_brightness)
+                l.shadow.known &= ~(led::field_brightness | led::field_trigger);
+            l.shadow.known |= l.shadow.dirty;
+            return;
+        }
+        if (e.pending & pending_trigger)
+            l.trigger_written (trigger_registry::intern(e.trigger));
+        if (e.pending & pending_intensity)
+            l.intensity_written (e.intensity);
+        if (e.pending & pending_brightness)
+            l.brightness_written (e.brightness);
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Format the values to write and make sure the needed
+    // attribute files are open. Returns the number of writes
+    // needed for the entry, or -1 on error.
+    //--------------------------------------------------------------------------
+    int led_batch::prepare (entry& e)
+    {
+        int num_ops = 0;
+        led& l = *e.target;
+
+        if (l.led_flags & led::shadow_state)
+            elide_writes (e);
+
+        if (e.pending & pending_trigger) {
+            if (l.attr_fd(led::attr_trigger, O_WRONLY) < 0)
+                return -1;
+            ++num_ops;
+        }
+        if (e.pending & pending_intensity) {
+            e.ci_len = led::format_values (e.ci_buf, sizeof(e.ci_buf), e.intensity);
+            if (e.ci_len < 0  ||  l.attr_fd(led::attr_multi_intensity, O_WRONLY) < 0)
+                return -1;
+            ++num_ops;
+        }
+        if (e.pending & pending_brightness) {
+            e.br_len = led::format_value (e.br_buf, sizeof(e.br_buf), e.brightness);
+            if (e.br_len < 0  ||  l.attr_fd(led::attr_brightness, O_WRONLY) < 0)
+                return -1;
+            ++num_ops;
+        }
+        return num_ops;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led_batch::commit ()
+    {
+        if (ring)
+            commit_uring ();
+        else
+            commit_fallback ();
+
+        int first_error = 0;
+        commit_results.clear ();
+        for (size_t i=0; i<num_entries; ++i) {
+            entry& e = entries[i];
+            commit_results.emplace_back (result{e.target, e.errnum});
+            if (e.errnum  &&  !first_error)
+                first_error = e.errnum;
+            if (e.target->led_flags & led::shadow_state)
+                update_shadow (e);
+            if (!(e.target->led_flags & led::keep_open))
+                e.target->close_files ();
+        }
+        clear ();
+
+        if (first_error) {
+            errno = first_error;
+            return -1;
+        }
+        return 0;
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Queue all writes for one LED as a chain of linked requests, so
+    // they are performed in order, and the rest of the chain is
+    // cancelled if one of them fails.
+    //--------------------------------------------------------------------------
+    static void queue_write (uring& ring, int fd, const char* buf, unsigned len,
+                             uint64_t user_data, bool link)
+    {
+        io_uring_sqe* sqe = ring.get_sqe ();
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t> (buf);
+        sqe->len = len;
+        sqe->off = 0;
+        sqe->user_data = user_data;
+        if (link)
+            sqe->flags |= IOSQE_IO_LINK;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led_batch::commit_uring ()
+    {
+        size_t next = 0;
+        while (next < num_entries) {
+            //
+            // Fill the submission queue
+            //
+            size_t first = next;
+            unsigned queued = 0;
+            while (next < num_entries) {
+                entry& e = entries[next];
+                int num_ops = prepare (e);
+                if (num_ops < 0) {
+                    e.errnum = errno;
+                    ++next;
+                    continue;
+                }
+                if ((unsigned)num_ops > ring->sq_space())
+                    break;
+
+                led& l = *e.target;
+                uint64_t id = next << op_bits;
+                if (e.pending & pending_trigger) {
+                    --num_ops;
+                    queue_write (*ring, l.attr_fds[led::attr_trigger],
+                                 e.trigger.data(), e.trigger.size(),
+                                 id | op_trigger, num_ops > 0);
+                }
+                if (e.pending & pending_intensity) {
+                    --num_ops;
+                    queue_write (*ring, l.attr_fds[led::attr_multi_intensity],
+                                 e.ci_buf, e.ci_len, id | op_intensity, num_ops > 0);
+                }
+                if (e.pending & pending_brightness) {
+                    queue_write (*ring, l.attr_fds[led::attr_brightness],
+                                 e.br_buf, e.br_len, id | op_brightness, false);
+                }
+                queued += __builtin_popcount (e.pending);
+                ++next;
+            }
+            if (queued == 0)
+                continue;
+
+            //
+            // Submit and wait for all completions
+            //
+            uint64_t start = detail::io_start ();
+            if (ring->submit(queued) < 0) {
+                // Should not happen. Nothing in this round was written,
+                // so write it, and the rest, one by one instead.
+                ring.reset ();
+                commit_fallback (first);
+                return;
+            }
+            while (queued) {
+                io_uring_cqe cqe;
+                if (!ring->get_cqe(cqe)) {
+                    if (ring->submit(queued) < 0  &&  errno != EAGAIN) {
+                        // It's unknown which of the writes in this round
+                        // that were made. Write the rest one by one.
+                        int errnum = errno;
+                        for (size_t i=first; i<next; ++i) {
+                            if (!entries[i].errnum  &&  entries[i].pending)
+                                entries[i].errnum = errnum;
+                        }
+                        ring.reset ();
+                        commit_fallback (next);
+                        return;
+                    }
+                    continue;
+                }
+                --queued;
+                entry& e = entries[cqe.user_data >> op_bits];
+                if (start) {
+                    static constexpr led::attr_t op_attr[] = {
+                        led::attr_trigger, led::attr_multi_intensity, led::attr_brightness
+                    };
+                    e.target->record_io (true, op_attr[cqe.user_data & ((1<<op_bits) - 1)],
+                                         start, cqe.res);
+                }
+                if (e.errnum)
+                    continue; // Only report the first error for a LED
+                if (cqe.res < 0) {
+                    e.errnum = -cqe.res;
+                }else{
+                    unsigned len;
+                    switch (cqe.user_data & ((1<<op_bits) - 1)) {
+                    case op_trigger:
+                        len = e.trigger.size ();
+                        break;
+                    case op_intensity:
+                        len = e.ci_len;
+                        break;
+                    default:
+                        len = e.br_len;
+                        break;
+                    }
+                    if ((unsigned)cqe.res != len)
+                        e.errnum = EIO;
+                }
+            }
+        }
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led_batch::commit_fallback (size_t first)
+    {
+        for (size_t i=first; i<num_entries; ++i) {
+            entry& e = entries[i];
+            led& l = *e.target;
+            if (e.errnum)
+                continue; // Failed to prepare
+            if (prepare(e) < 0) {
+                e.errnum = errno;
+                continue;
+            }
+            if (e.pending & pending_trigger) {
+                if (l.write_attr(led::attr_trigger, e.trigger.data(), e.trigger.size())) {
+                    e.errnum = errno;
+                    continue;
+                }
+            }
+            if (e.pending & pending_intensity) {
+                if (l.write_attr(led::attr_multi_intensity, e.ci_buf, e.ci_len)) {
+                    e.errnum = errno;
+                    continue;
+                }
+            }
+            if (e.pending & pending_brightness) {
+                if (l.write_attr(led::attr_brightness, e.br_buf, e.br_len))
+                    e.errnum = errno;
+            }
+        }
+    }
+
+
+}
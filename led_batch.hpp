@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEDPP_LED_BATCH_HPP
+#define LEDPP_LED_BATCH_HPP
+
+#include <led++.hpp>
+#include <vector>
+#include <string>
+#include <memory>
+#include <unordered_map>
+
+
+namespace ledpp {
+
+
+    class uring;
+
+
+    /**
+     * Collect brightness, color intensity, and trigger changes
+     * for many LEDs and write them all at once.
+     *
+     * If io_uring is available, all writes in the batch are
+     * submitted to the kernel using a single system call.
+     * Otherwise the writes are made one by one.
+     *
+     * For each LED, the trigger is written first, then the color
+     * intensity, and last the brightness. This is because setting
+     * a trigger may reset the brightness. If one write to a LED
+     * fails, the remaining writes to that LED are skipped.
+     * Writes to different LEDs are independent of each other.
+     *
+     * The attribute files of the LEDs are kept open after a
+     * commit only for LEDs created with flag led::keep_open.
+     */
+    class led_batch {
+    public:
+        /**
+         * The result of a commit for one LED.
+         */
+        struct result {
+            led* target; /**< The LED. */
+            int errnum;  /**< 0 on success, otherwise an error number. */
+        };
+
+        /**
+         * Create an empty batch.
+         * @param queue_depth The maximum number of writes
+         *                    submitted in one system call.
+         */
+        led_batch (unsigned queue_depth=256);
+
+        /**
+         * Destructor.
+         */
+        ~led_batch ();
+
+        led_batch (const led_batch&) = delete;
+        led_batch& operator= (const led_batch&) = delete;
+
+        /**
+         * Queue a brightness value for a LED.
+         * If a brightness value is already queued for
+         * the LED, it is replaced.
+         * @param l The LED. The object must remain valid until
+         *          the batch is committed or cleared.
+         * @param value The brightness value.
+         */
+        void brightness (led& l, unsigned value);
+
+        /**
+         * Queue color intensity values for a multicolor LED.
+         * If color intensity values are already queued for
+         * the LED, they are replaced.
+         * @param l The LED. The object must remain valid until
+         *          the batch is committed or cleared.
+         * @param values The color intensity values.
+         */
+        void color_intensity (led& l, std::span<const unsigned> values);
+
+        /**
+         * Queue color intensity values for a multicolor LED.
+         * Same as color_intensity(led&, std::span<const unsigned>),
+         * for code passing a vector or a braced list.
+         */
+        void color_intensity (led& l, const std::vector<unsigned>& values) {
+            color_intensity (l, std::span<const unsigned>(values));
+        }
+
+        /**
+         * Queue a trigger for a LED.
+         * If a trigger is already queued for the LED, it is replaced.
+         * @param l The LED. The object must remain valid until
+         *          the batch is committed or cleared.
+         * @param name The name of the trigger.
+         */
+        void trigger (led& l, std::string_view name);
+
+        /**
+         * Queue a trigger for a LED.
+         * Same as trigger(led&, std::string_view).
+         */
+        void trigger (led& l, const std::string& name) {
+            trigger (l, std::string_view(name));
+        }
+
+        /**
+         * Queue a trigger for a LED.
+         * Same as trigger(led&, std::string_view).
+         */
+        void trigger (led& l, const char* name) {
+            trigger (l, std::string_view(name));
+        }
+
+        /**
+         * Return the number of LEDs with queued changes.
+         */
+        size_t size () const {
+            return num_entries;
+        }
+
+        /**
+         * Check if there are no queued changes.
+         */
+        bool empty () const {
+            return num_entries == 0;
+        }
+
+        /**
+         * Remove all queued changes.
+         */
+        void clear ();
+
+        /**
+         * Write all queued changes and clear the batch.
+         * The outcome for each LED is available using
+         * method results() after the call.
+         * @return 0 if all writes succeeded. -1 if one or more
+         *         writes failed, and <code>errno</code> is set
+         *         to the first error.
+         */
+        int commit ();
+
+        /**
+         * Return the outcome of the last commit, one entry
+         * for each LED in the order they were first queued.
+         */
+        const std::vector<result>& results () const {
+            return commit_results;
+        }
+
+        /**
+         * Check if the batch writes using io_uring.
+         */
+        bool uses_io_uring () const {
+            return ring != nullptr;
+        }
+
+
+    private:
+        enum : unsigned {
+            pending_trigger    = 0x01,
+            pending_intensity  = 0x02,
+            pending_brightness = 0x04,
+        };
+
+        struct entry {
+            led* target;
+            unsigned pending;
+            unsigned brightness;
+            std::vector<unsigned> intensity;
+            std::string trigger;
+            int errnum;
+            int br_len;
+            int ci_len;
+            char br_buf[16];
+            char ci_buf[led::intensity_buf_size];
+        };
+
+        std::unique_ptr<uring> ring;
+        std::vector<entry> entries;
+        size_t num_entries;
+        std::unordered_map<led*, size_t> index;
+        std::vector<result> commit_results;
+
+        entry& get_entry (led& l);
+        void elide_writes (entry& e);
+        void update_shadow (entry& e);
+        int prepare (entry& e);
+        void commit_uring ();
+        void commit_fallback (size_t first=0);
+    };
+
+
+}
+#endif
@@ -0,0 +1,378 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <led_color.hpp>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+#if defined(__GNUC__)  &&  !defined(LEDPP_NO_SIMD)
+#define LEDPP_SIMD 1
+#endif
+
+
+namespace ledpp {
+
+
+    //
+    // The kernels below are written once as templates, and are
+    // instantiated both for plain floats, and for GCC vector
+    // extension types that the compiler maps to the SIMD
+    // instructions of the target.
+    //
+#ifdef LEDPP_SIMD
+    // 128 bit vectors, available on all common targets (SSE2, NEON)
+    static constexpr size_t lanes = 4;
+    typedef float    vfloat __attribute__ ((vector_size (lanes * sizeof(float))));
+    typedef int32_t  vint   __attribute__ ((vector_size (lanes * sizeof(int32_t))));
+    typedef uint32_t vuint  __attribute__ ((vector_size (lanes * sizeof(uint32_t))));
+#endif
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    template<typename V>
+    static inline V vmin (V a, V b)
+    {
+        return a < b ? a : b;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    template<typename V>
+    static inline V vmax (V a, V b)
+    {
+        return a > b ? a : b;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    template<typename V>
+    static inline V clamp01 (V x)
+    {
+        return vmin (vmax(x, V{} + 0.0f), V{} + 1.0f);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    static inline float vfloor (float x)
+    {
+        return std::floor (x);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    static inline uint32_t to_uint (float x)
+    {
+        return (uint32_t) x;
+    }
+
+
+#ifdef LEDPP_SIMD
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    static inline vfloat vfloor (vfloat x)
+    {
+        vfloat t = __builtin_convertvector (__builtin_convertvector(x, vint), vfloat);
+        // Truncation rounds negative values up, adjust by -1 where needed
+        return t + __builtin_convertvector (t > x, vfloat);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    static inline vuint to_uint (vfloat x)
+    {
+        return __builtin_convertvector (__builtin_convertvector(x, vint), vuint);
+    }
+#endif
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    template<typename V, typename T>
+    static inline V load (const T* p)
+    {
+        V v;
+        memcpy (&v, p, sizeof(v));
+        return v;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    template<typename V, typename T>
+    static inline void store (T* p, const V& v)
+    {
+        memcpy (p, &v, sizeof(v));
+    }
+
+
+    //--------------------------------------------------------------------------
+    // HSV to RGB without branches:
+    // f(n) = v - v*s*max(0, min(k, 4-k, 1)), k = (n + h/60) mod 6
+    // with n = 5, 3, 1 for red, green, blue.
+    //--------------------------------------------------------------------------
+    template<typename V>
+    static inline void hsv_kernel (V h, V s, V v, V& r, V& g, V& b)
+    {
+        const V six = V{} + 6.0f;
+        h = h * (1.0f/60.0f);
+        h = h - six * vfloor (h * (1.0f/6.0f));
+        s = clamp01 (s);
+        v = clamp01 (v);
+        V vs = v * s;
+
+        auto channel = [&](float n) {
+            V k = h + n;
+            k = k >= six ? k - six : k;
+            V x = vmax (V{} + 0.0f, vmin(vmin(k, 4.0f - k), V{} + 1.0f));
+            return v - vs * x;
+        };
+        r = channel (5.0f);
+        g = channel (3.0f);
+        b = channel (1.0f);
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Color temperature to RGB, using the approximation by Tanner Helland.
+    //--------------------------------------------------------------------------
+    static rgb_color kelvin_formula (float kelvin)
+    {
+        double t = kelvin / 100.0;
+        double r, g, b;
+        if (t <= 66.0) {
+            r = 255.0;
+            g = 99.4708025861 * std::log(t) - 161.1195681661;
+        }else{
+            r = 329.698727446 * std::pow (t - 60.0, -0.1332047592);
+            g = 288.1221695283 * std::pow (t - 60.0, -0.0755148492);
+        }
+        if (t >= 66.0)
+            b = 255.0;
+        else if (t <= 19.0)
+            b = 0.0;
+        else
+            b = 138.5177312231 * std::log(t - 10.0) - 305.0447927307;
+
+        auto norm = [](double x) {
+            return (float) (x < 0.0 ? 0.0 : (x > 255.0 ? 1.0 : x / 255.0));
+        };
+        return rgb_color {norm(r), norm(g), norm(b)};
+    }
+
+
+    // Color temperature table, 1000 - 40000 K in steps of 100 K
+    static constexpr unsigned kelvin_min = 1000;
+    static constexpr unsigned kelvin_max = 40000;
+    static constexpr unsigned kelvin_step = 100;
+    static constexpr unsigned kelvin_entries = (kelvin_max - kelvin_min) / kelvin_step + 1;
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    static const std::array<rgb_color, kelvin_entries>& kelvin_table ()
+    {
+        static const auto table = [](){
+            std::array<rgb_color, kelvin_entries> t;
+            for (unsigned i=0; i<kelvin_entries; ++i)
+                t[i] = kelvin_formula (kelvin_min + i * kelvin_step);
+            return t;
+        }();
+        return table;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    rgb_color color_mapper::kelvin_to_rgb (float kelvin)
+    {
+        auto& table = kelvin_table ();
+        if (!(kelvin > kelvin_min))
+            return table.front ();
+        if (kelvin >= kelvin_max)
+            return table.back ();
+        float pos = (kelvin - kelvin_min) / kelvin_step;
+        unsigned i = (unsigned) pos;
+        float x = pos - i;
+        auto& a = table[i];
+        auto& b = table[i+1];
+        return rgb_color {a.r + (b.r - a.r) * x,
+                          a.g + (b.g - a.g) * x,
+                          a.b + (b.b - a.b) * x};
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    color_mapper::color_mapper (std::span<led* const> leds)
+    {
+        scale.reserve (leds.size());
+        offset.reserve (leds.size() + 1);
+        offset.emplace_back (0);
+        for (size_t i=0; i<leds.size(); ++i) {
+            led& l = *leds[i];
+            int max_br = l.max_brightness ();
+            scale.emplace_back (max_br > 0 ? (float)max_br : 0.0f);
+            for (auto& name : l.color_names()) {
+                uint8_t type = channel_none;
+                if (name == "red")
+                    type = channel_red;
+                else if (name == "green")
+                    type = channel_green;
+                else if (name == "blue")
+                    type = channel_blue;
+                else if (name == "white")
+                    type = channel_white;
+                channel_led.emplace_back (i);
+                channel_type.emplace_back (type);
+            }
+            offset.emplace_back (channel_led.size());
+        }
+        values.resize (channel_led.size());
+        plane_r.resize (leds.size());
+        plane_g.resize (leds.size());
+        plane_b.resize (leds.size());
+        for (auto& q : quantized)
+            q.assign (leds.size(), 0);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void color_mapper::convert (std::span<const rgb_color> colors)
+    {
+        size_t n = std::min (colors.size(), scale.size());
+        size_t i = 0;
+#ifdef LEDPP_SIMD
+        for (; i+lanes <= n; i+=lanes) {
+            vfloat r, g, b;
+            for (size_t l=0; l<lanes; ++l) {
+                r[l] = colors[i+l].r;
+                g[l] = colors[i+l].g;
+                b[l] = colors[i+l].b;
+            }
+            store (&plane_r[i], clamp01(r));
+            store (&plane_g[i], clamp01(g));
+            store (&plane_b[i], clamp01(b));
+        }
+#endif
+        for (; i<n; ++i) {
+            plane_r[i] = clamp01 (colors[i].r);
+            plane_g[i] = clamp01 (colors[i].g);
+            plane_b[i] = clamp01 (colors[i].b);
+        }
+        quantize ();
+        scatter ();
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void color_mapper::convert (std::span<const hsv_color> colors)
+    {
+        size_t n = std::min (colors.size(), scale.size());
+        size_t i = 0;
+#ifdef LEDPP_SIMD
+        for (; i+lanes <= n; i+=lanes) {
+            vfloat h, s, v, r, g, b;
+            for (size_t l=0; l<lanes; ++l) {
+                h[l] = colors[i+l].h;
+                s[l] = colors[i+l].s;
+                v[l] = colors[i+l].v;
+            }
+            hsv_kernel (h, s, v, r, g, b);
+            store (&plane_r[i], r);
+            store (&plane_g[i], g);
+            store (&plane_b[i], b);
+        }
+#endif
+        for (; i<n; ++i) {
+            hsv_kernel (colors[i].h, colors[i].s, colors[i].v,
+                        plane_r[i], plane_g[i], plane_b[i]);
+        }
+        quantize ();
+        scatter ();
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void color_mapper::convert_kelvin (std::span<const float> kelvin, float level)
+    {
+        size_t n = std::min (kelvin.size(), scale.size());
+        level = clamp01 (level);
+        for (size_t i=0; i<n; ++i) {
+            auto c = kelvin_to_rgb (kelvin[i]);
+            plane_r[i] = c.r * level;
+            plane_g[i] = c.g * level;
+            plane_b[i] = c.b * level;
+        }
+        quantize ();
+        scatter ();
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Scale the color planes to the max brightness of each LED,
+    // and round to integers.
+    //--------------------------------------------------------------------------
+    void color_mapper::quantize ()
+    {
+        size_t n = scale.size ();
+        size_t i = 0;
+#ifdef LEDPP_SIMD
+        for (; i+lanes <= n; i+=lanes) {
+            vfloat k = load<vfloat> (&scale[i]);
+            vfloat r = load<vfloat> (&plane_r[i]);
+            vfloat g = load<vfloat> (&plane_g[i]);
+            vfloat b = load<vfloat> (&plane_b[i]);
+            vfloat w = vmin (vmin(r, g), b);
+            store (&quantized[channel_red][i],   to_uint(r * k + 0.5f));
+            store (&quantized[channel_green][i], to_uint(g * k + 0.5f));
+            store (&quantized[channel_blue][i],  to_uint(b * k + 0.5f));
+            store (&quantized[channel_white][i], to_uint(w * k + 0.5f));
+        }
+#endif
+        for (; i<n; ++i) {
+            float k = scale[i];
+            float w = vmin (vmin(plane_r[i], plane_g[i]), plane_b[i]);
+            quantized[channel_red][i]   = to_uint (plane_r[i] * k + 0.5f);
+            quantized[channel_green][i] = to_uint (plane_g[i] * k + 0.5f);
+            quantized[channel_blue][i]  = to_uint (plane_b[i] * k + 0.5f);
+            quantized[channel_white][i] = to_uint (w * k + 0.5f);
+        }
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Place the quantized values in the channel order of each LED.
+    //--------------------------------------------------------------------------
+    void color_mapper::scatter ()
+    {
+        for (size_t j=0; j<values.size(); ++j)
+            values[j] = quantized[channel_type[j]][channel_led[j]];
+    }
+
+
+}
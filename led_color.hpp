@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEDPP_LED_COLOR_HPP
+#define LEDPP_LED_COLOR_HPP
+
+#include <led++.hpp>
+#include <vector>
+#include <span>
+#include <cstdint>
+
+
+namespace ledpp {
+
+
+    /**
+     * A color with red, green, and blue components in the range 0.0 - 1.0.
+     */
+    struct rgb_color {
+        float r; /**< Red. */
+        float g; /**< Green. */
+        float b; /**< Blue. */
+    };
+
+    /**
+     * A color with hue, saturation, and value components.
+     */
+    struct hsv_color {
+        float h; /**< Hue in degrees, 0.0 - 360.0. */
+        float s; /**< Saturation, 0.0 - 1.0. */
+        float v; /**< Value, 0.0 - 1.0. */
+    };
+
+
+    /**
+     * Convert colors for a set of multicolor LEDs into
+     * color intensity values.
+     *
+     * The mapper is created for a fixed set of LEDs, and knows the
+     * color channels and max brightness of each of them. A call to
+     * convert() takes one color per LED and calculates the color
+     * intensity values of all LEDs, in the order given by each LED's
+     * <code>color_names()</code>. Channels named red, green, and blue
+     * get the corresponding color component, and a channel named white
+     * gets the smallest of the three. Other channels are set to 0.
+     * Intensity values are scaled to the max brightness of each LED.
+     *
+     * The conversions process all LEDs at once using SIMD vector
+     * instructions when the library is built with support for it,
+     * and a scalar implementation otherwise.
+     */
+    class color_mapper {
+    public:
+        /**
+         * Create a mapper for a set of LEDs.
+         * @param leds The LEDs. Only the color names and max brightness
+         *             are read, the objects are not used after this.
+         *             LEDs that aren't multicolor get no intensity values.
+         */
+        color_mapper (std::span<led* const> leds);
+
+        /**
+         * Return the number of LEDs.
+         */
+        size_t size () const {
+            return scale.size ();
+        }
+
+        /**
+         * Calculate color intensity values from RGB colors.
+         * @param colors One color for each LED.
+         *               Components are clamped to 0.0 - 1.0.
+         */
+        void convert (std::span<const rgb_color> colors);
+
+        /**
+         * Calculate color intensity values from HSV colors.
+         * @param colors One color for each LED.
+         */
+        void convert (std::span<const hsv_color> colors);
+
+        /**
+         * Calculate color intensity values from white
+         * light color temperatures.
+         * @param kelvin One color temperature for each LED,
+         *               1000 - 40000 K.
+         * @param level The brightness of the light, 0.0 - 1.0.
+         */
+        void convert_kelvin (std::span<const float> kelvin, float level=1.0f);
+
+        /**
+         * Return the color intensity values of a LED calculated
+         * by the last conversion.
+         * @param index The index of the LED.
+         * @return Color intensity values in the order of
+         *         the color names of the LED.
+         */
+        std::span<const unsigned> intensity (size_t index) const {
+            return std::span<const unsigned> (values.data() + offset[index],
+                                              offset[index+1] - offset[index]);
+        }
+
+        /**
+         * Convert a single color temperature to an RGB color.
+         * @param kelvin Color temperature, 1000 - 40000 K.
+         * @return The color.
+         */
+        static rgb_color kelvin_to_rgb (float kelvin);
+
+
+    private:
+        enum : uint8_t {
+            channel_red = 0,
+            channel_green,
+            channel_blue,
+            channel_white,
+            channel_none,
+        };
+
+        // Per LED
+        std::vector<float> scale;
+        std::vector<unsigned> offset;
+
+        // Per color channel of all LEDs
+        std::vector<uint32_t> channel_led;
+        std::vector<uint8_t> channel_type;
+        std::vector<unsigned> values;
+
+        // Intermediate color planes, one value per LED
+        std::vector<float> plane_r;
+        std::vector<float> plane_g;
+        std::vector<float> plane_b;
+        std::vector<uint32_t> quantized[channel_none+1];
+
+        void quantize ();
+        void scatter ();
+    };
+
+
+}
+#endif
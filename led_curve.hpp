@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEDPP_LED_CURVE_HPP
+#define LEDPP_LED_CURVE_HPP
+
+#include <led++.hpp>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cerrno>
+#include <system_error>
+
+
+namespace ledpp {
+
+
+    namespace detail {
+
+        // Natural logarithm usable in constant expressions, x > 0.
+        constexpr double const_log (double x)
+        {
+            constexpr double ln2 = 0.693147180559945309417;
+            int k = 0;
+            while (x > 2.0) {
+                x /= 2.0;
+                ++k;
+            }
+            while (x < 1.0) {
+                x *= 2.0;
+                --k;
+            }
+            // ln(x) = 2*atanh((x-1)/(x+1)), converges fast for 1 <= x <= 2
+            double z = (x - 1.0) / (x + 1.0);
+            double z2 = z * z;
+            double term = z;
+            double sum = 0.0;
+            for (int n=1; n<40; n+=2) {
+                sum += term / n;
+                term *= z2;
+            }
+            return 2.0*sum + k*ln2;
+        }
+
+        // Exponential function usable in constant expressions.
+        constexpr double const_exp (double x)
+        {
+            constexpr double ln2 = 0.693147180559945309417;
+            int k = (int) (x / ln2);
+            double r = x - k*ln2;
+            double term = 1.0;
+            double sum = 1.0;
+            for (int n=1; n<30; ++n) {
+                term *= r / n;
+                sum += term;
+            }
+            for (; k>0; --k)
+                sum *= 2.0;
+            for (; k<0; ++k)
+                sum /= 2.0;
+            return sum;
+        }
+    }
+
+
+    /**
+     * Brightness curve where the brightness is proportional
+     * to the level.
+     */
+    struct linear_curve {
+        /** Map a level 0.0 - 1.0 to a relative brightness 0.0 - 1.0. */
+        static constexpr double apply (double x) {
+            return x;
+        }
+    };
+
+    /**
+     * Power law brightness curve, <code>brightness = level^gamma</code>,
+     * where gamma is <code>Num/Den</code>. The default is gamma 2.2.
+     */
+    template<unsigned Num=22, unsigned Den=10>
+    struct gamma_curve {
+        static_assert (Num > 0  &&  Den > 0, "Invalid gamma");
+        /** Map a level 0.0 - 1.0 to a relative brightness 0.0 - 1.0. */
+        static constexpr double apply (double x) {
+            if (x <= 0.0)
+                return 0.0;
+            return detail::const_exp (detail::const_log(x) * Num / Den);
+        }
+    };
+
+    /**
+     * Perceptually linear brightness curve, where the level is the
+     * CIE 1976 lightness L* divided by 100.
+     */
+    struct cie_curve {
+        /** Map a level 0.0 - 1.0 to a relative brightness 0.0 - 1.0. */
+        static constexpr double apply (double x) {
+            double l = x * 100.0;
+            if (l <= 8.0)
+                return l / 903.3;
+            double t = (l + 16.0) / 116.0;
+            return t * t * t;
+        }
+    };
+
+
+    /**
+     * Lookup table of a brightness curve, generated at compile time.
+     * Entry <code>i</code> holds the relative brightness at level
+     * <code>i/(Resolution-1)</code> in fixed point, where 65535
+     * means full brightness.
+     * @tparam Curve The curve, a type with a static constexpr
+     *               function <code>double apply(double)</code>.
+     * @tparam Resolution The number of entries in the table.
+     */
+    template<typename Curve, size_t Resolution=256>
+    struct curve_table {
+        static_assert (Resolution >= 2  &&  Resolution <= 65536, "Invalid curve resolution");
+
+        /** The table. */
+        static constexpr std::array<uint16_t, Resolution> values = []() {
+            std::array<uint16_t, Resolution> table {};
+            for (size_t i=0; i<Resolution; ++i) {
+                double y = Curve::apply ((double)i / (Resolution - 1));
+                if (y < 0.0)
+                    y = 0.0;
+                if (y > 1.0)
+                    y = 1.0;
+                table[i] = (uint16_t) (y * 65535.0 + 0.5);
+            }
+            return table;
+        }();
+    };
+
+
+    /**
+     * Map normalized brightness levels to the brightness
+     * values of a LED through a brightness curve.
+     *
+     * The curve table is generated at compile time, and is rescaled
+     * to the max brightness of the LED once when the object is
+     * created. After that, mapping a level is one table lookup using
+     * integer arithmetic only. A perceptually smooth fade over
+     * <code>n</code> steps is simply:
+     * @code
+     * ledpp::brightness_curve<ledpp::cie_curve> curve (l);
+     * for (unsigned i=0; i<n; ++i)
+     *     l.brightness (curve.step(i, n));
+     * @endcode
+     *
+     * @tparam Curve The curve, for example <code>cie_curve</code>
+     *               or <code>gamma_curve<></code>.
+     * @tparam Resolution The number of levels in the table.
+     */
+    template<typename Curve=cie_curve, size_t Resolution=256>
+    class brightness_curve {
+    public:
+        /**
+         * The fixed point level meaning full brightness.
+         */
+        static constexpr unsigned full_level = 65535;
+
+        /**
+         * Create a curve for a specific max brightness.
+         * @param max_brightness The max brightness of the LED.
+         */
+        explicit brightness_curve (unsigned max_brightness) {
+            rescale (max_brightness);
+        }
+
+        /**
+         * Create a curve for the max brightness of a LED.
+         * @param l The LED.
+         * @throw std::system_error If the max brightness
+         *                          can't be read.
+         */
+        explicit brightness_curve (led& l) {
+            int max_br = l.max_brightness ();
+            if (max_br < 0)
+                throw std::system_error (errno, std::generic_category());
+            rescale ((unsigned)max_br);
+        }
+
+        /**
+         * Return the number of levels in the table.
+         */
+        static constexpr size_t size () {
+            return Resolution;
+        }
+
+        /**
+         * Return the max brightness the curve is scaled to.
+         */
+        unsigned max_brightness () const {
+            return values[Resolution - 1];
+        }
+
+        /**
+         * Return the brightness value of a table entry.
+         * @param index A level 0 - size()-1.
+         */
+        unsigned operator[] (size_t index) const {
+            return values[index];
+        }
+
+        /**
+         * Return the brightness value of a fixed point level.
+         * @param level A level 0 - full_level.
+         *              Larger values give max brightness.
+         */
+        unsigned level_fixed (unsigned level) const {
+            if (level >= full_level)
+                return values[Resolution - 1];
+            return values[((uint64_t)level * (Resolution - 1) + full_level/2) / full_level];
+        }
+
+        /**
+         * Return the brightness value of a normalized level.
+         * @param level A level 0.0 - 1.0, values outside
+         *              the range are clamped.
+         */
+        unsigned level (float level) const {
+            if (!(level > 0.0f))
+                return values[0];
+            if (level >= 1.0f)
+                return values[Resolution - 1];
+            return values[(size_t) (level * (Resolution - 1) + 0.5f)];
+        }
+
+        /**
+         * Return the brightness value of one step of a fade
+         * from level 0 to full level.
+         * @param i The step, 0 - n-1.
+         * @param n The number of steps, at least 2.
+         */
+        unsigned step (unsigned i, unsigned n) const {
+            if (n < 2  ||  i >= n-1)
+                return values[Resolution - 1];
+            return values[((uint64_t)i * (Resolution - 1) + (n-1)/2) / (n-1)];
+        }
+
+
+    private:
+        std::array<unsigned, Resolution> values;
+
+        void rescale (unsigned max_brightness) {
+            auto& table = curve_table<Curve, Resolution>::values;
+            for (size_t i=0; i<Resolution; ++i)
+                values[i] = (unsigned) (((uint64_t)table[i] * max_brightness + full_level/2) / full_level);
+        }
+    };
+
+
+}
+#endif
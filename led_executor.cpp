@@ -0,0 +1,523 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <led_executor.hpp>
+#include <uring.hpp>
+#include <io_recorder.hpp>
+#include <algorithm>
+#include <system_error>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+
+
+namespace ledpp {
+
+
+    //--------------------------------------------------------------------------
+    // Coroutine wrapping a spawned task. It is owned by the executor,
+    // and destroys itself when the task has finished.
+    //--------------------------------------------------------------------------
+    struct led_executor::detached {
+        struct promise_type {
+            led_executor* ex;
+
+            promise_type (led_executor* e, task<>&)
+                : ex (e)
+            {
+            }
+
+            detached get_return_object () noexcept {
+                return detached {std::coroutine_handle<promise_type>::from_promise(*this)};
+            }
+            std::suspend_always initial_suspend () const noexcept {
+                return {};
+            }
+
+            struct final_awaiter {
+                bool await_ready () const noexcept {
+                    return false;
+                }
+                void await_suspend (std::coroutine_handle<promise_type> h) noexcept {
+                    h.promise().ex->tasks.erase (h.address());
+                    h.destroy ();
+                }
+                void await_resume () const noexcept {
+                }
+            };
+
+            final_awaiter final_suspend () const noexcept {
+                return {};
+            }
+            void return_void () const noexcept {
+            }
+            void unhandled_exception () noexcept {
+                if (!ex->task_error)
+                    ex->task_error = std::current_exception ();
+            }
+        };
+
+        std::coroutine_handle<promise_type> h;
+    };
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    led_executor::led_executor (unsigned queue_depth_arg)
+        : queue_depth (queue_depth_arg ? queue_depth_arg : 1),
+          epoll_fd (-1),
+          timer_fd (-1),
+          event_fd (-1),
+          stopped (false),
+          in_flight (0),
+          unsubmitted (0),
+          timer_seq (0)
+    {
+        try {
+            ring = std::make_unique<uring> (queue_depth);
+            if (!ring->supports(IORING_OP_READ)  ||  !ring->supports(IORING_OP_WRITE))
+                ring.reset ();
+        }
+        catch (std::system_error&) {
+            // io_uring not available, read and write synchronously
+            ring.reset ();
+        }
+
+        epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+        timer_fd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        event_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epoll_fd < 0  ||  timer_fd < 0  ||  event_fd < 0) {
+            int errnum = errno;
+            for (int fd : {epoll_fd, timer_fd, event_fd}) {
+                if (fd >= 0)
+                    close (fd);
+            }
+            throw std::system_error (errnum, std::generic_category());
+        }
+
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = timer_fd;
+        epoll_ctl (epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev);
+        ev.data.fd = event_fd;
+        epoll_ctl (epoll_fd, EPOLL_CTL_ADD, event_fd, &ev);
+        if (ring) {
+            // The ring is readable when there are completions
+            ev.data.fd = ring->fd ();
+            epoll_ctl (epoll_fd, EPOLL_CTL_ADD, ring->fd(), &ev);
+        }
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    led_executor::~led_executor ()
+    {
+        // The kernel may still use buffers in the coroutine frames
+        while (ring  &&  in_flight) {
+            if (ring->submit(1) < 0)
+                break;
+            io_uring_cqe cqe;
+            while (ring->get_cqe(cqe))
+                --in_flight;
+        }
+
+        waiting.clear ();
+        ready.clear ();
+        std::vector<void*> unfinished (tasks.begin(), tasks.end());
+        tasks.clear ();
+        for (auto address : unfinished)
+            std::coroutine_handle<>::from_address(address).destroy ();
+
+        close (event_fd);
+        close (timer_fd);
+        close (epoll_fd);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    led_executor::detached led_executor::run_detached (led_executor*, task<> t)
+    {
+        co_await t;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led_executor::spawn (task<> t)
+    {
+        auto d = run_detached (this, std::move(t));
+        tasks.insert (d.h.address());
+        ready.emplace_back (d.h);
+
+        // Let an external event loop know that there is work to do
+        uint64_t one = 1;
+        [[maybe_unused]] auto result = write (event_fd, &one, sizeof(one));
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led_executor::add_timer (clock::time_point deadline, std::coroutine_handle<> h)
+    {
+        timers.push (timer{deadline, timer_seq++, h});
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led_executor::arm_timer ()
+    {
+        itimerspec its {};
+        if (!timers.empty()) {
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds> (timers.top().deadline.time_since_epoch());
+            its.it_value.tv_sec = ns.count() / 1000000000;
+            its.it_value.tv_nsec = ns.count() % 1000000000;
+            if (its.it_value.tv_sec == 0  &&  its.it_value.tv_nsec == 0)
+                its.it_value.tv_nsec = 1; // Zero would disarm the timer
+        }
+        timerfd_settime (timer_fd, TFD_TIMER_ABSTIME, &its, nullptr);
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Start a read or write. Returns false if it has already
+    // completed, and the awaiting coroutine shouldn't suspend.
+    //--------------------------------------------------------------------------
+    bool led_executor::submit (io_op& op)
+    {
+        if (!ring) {
+            ssize_t result;
+            do {
+                if (op.write)
+                    result = pwrite (op.fd, op.buf, op.len, op.offset);
+                else
+                    result = pread (op.fd, op.buf, op.len, op.offset);
+            } while (result < 0  &&  errno == EINTR);
+            op.result = result < 0 ? -errno : result;
+            return false;
+        }
+        if (!queue(op))
+            waiting.emplace_back (&op);
+        return true;
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Put an operation in the submission queue.
+    // Returns false if too many operations are in progress.
+    //--------------------------------------------------------------------------
+    bool led_executor::queue (io_op& op)
+    {
+        if (in_flight >= queue_depth)
+            return false;
+        io_uring_sqe* sqe = ring->get_sqe ();
+        if (!sqe  &&  unsubmitted) {
+            if (ring->submit() >= 0)
+                unsubmitted = 0;
+            sqe = ring->get_sqe ();
+        }
+        if (!sqe)
+            return false;
+        sqe->opcode = op.write ? IORING_OP_WRITE : IORING_OP_READ;
+        sqe->fd = op.fd;
+        sqe->addr = reinterpret_cast<uint64_t> (op.buf);
+        sqe->len = op.len;
+        sqe->off = op.offset;
+        sqe->user_data = reinterpret_cast<uint64_t> (&op);
+        ++in_flight;
+        ++unsubmitted;
+        return true;
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Make the coroutines waiting for completed operations ready,
+    // and start operations waiting for room in the queue.
+    //--------------------------------------------------------------------------
+    void led_executor::reap ()
+    {
+        io_uring_cqe cqe;
+        while (ring->get_cqe(cqe)) {
+            auto op = reinterpret_cast<io_op*> (cqe.user_data);
+            op->result = cqe.res;
+            --in_flight;
+            ready.emplace_back (op->waiter);
+        }
+        while (!waiting.empty()  &&  queue(*waiting.front()))
+            waiting.pop_front ();
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    size_t led_executor::poll ()
+    {
+        uint64_t counter;
+        [[maybe_unused]] auto r1 = read (event_fd, &counter, sizeof(counter));
+        [[maybe_unused]] auto r2 = read (timer_fd, &counter, sizeof(counter));
+
+        size_t resumed = 0;
+        std::vector<std::coroutine_handle<>> running;
+        while (true) {
+            if (ring)
+                reap ();
+            auto now = clock::now ();
+            while (!timers.empty()  &&  timers.top().deadline <= now) {
+                ready.emplace_back (timers.top().waiter);
+                timers.pop ();
+            }
+
+            if (ready.empty()) {
+                // Submit everything queued by the coroutines that
+                // have run, some writes complete at once
+                if (unsubmitted  &&  ring->submit() >= 0) {
+                    unsubmitted = 0;
+                    continue;
+                }
+                break;
+            }
+
+            running.swap (ready);
+            for (auto h : running) {
+                h.resume ();
+                ++resumed;
+            }
+            running.clear ();
+
+            if (task_error) {
+                arm_timer ();
+                std::rethrow_exception (std::exchange(task_error, nullptr));
+            }
+        }
+        arm_timer ();
+        return resumed;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led_executor::run ()
+    {
+        stopped = false;
+        while (true) {
+            poll ();
+            if (stopped  ||  tasks.empty())
+                break;
+            epoll_event events[3];
+            if (epoll_wait(epoll_fd, events, 3, -1) < 0  &&  errno != EINTR) {
+                int errnum = errno;
+                throw std::system_error (errnum, std::generic_category());
+            }
+        }
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Read or write an attribute of a LED.
+    // Returns the number of bytes, or -1 and errno is set.
+    //--------------------------------------------------------------------------
+    task<ssize_t> led_executor::io (led& l, led::attr_t attr, bool write,
+                                    char* buf, size_t len, off_t offset)
+    {
+        bool temporary;
+        int fd = l.use_fd (attr, write ? O_WRONLY : O_RDONLY, temporary);
+        if (fd < 0)
+            co_return -1;
+
+        uint64_t start = detail::io_start ();
+        int result = co_await io_op {*this, write, fd, buf, (unsigned)len, (uint64_t)offset, 0, nullptr};
+        if (start)
+            l.record_io (write, attr, start, result < 0 ? -1 : result);
+
+        led::release_fd (fd, temporary);
+        if (result < 0) {
+            errno = -result;
+            co_return -1;
+        }
+        co_return result;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    task<int> led_executor::brightness (led& l)
+    {
+        bool use_shadow = l.led_flags & led::shadow_state;
+        if (use_shadow  &&  (l.shadow.known & led::field_brightness))
+            co_return l.shadow.brightness;
+
+        char buf[32];
+        ssize_t len = co_await io (l, led::attr_brightness, false, buf, sizeof(buf));
+        if (len < 0)
+            co_return -1;
+        int value = led::parse_value (buf, len);
+        if (use_shadow)
+            l.brightness_changed (value);
+        co_return value;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    task<int> led_executor::brightness (led& l, unsigned value)
+    {
+        bool use_shadow = l.led_flags & led::shadow_state;
+        if (use_shadow) {
+            // No I/O needed if the value is unchanged or the write is deferred
+            if (((l.shadow.known & led::field_brightness)  &&  l.shadow.brightness == value)  ||
+                (l.led_flags & led::defer_writes))
+            {
+                co_return l.shadow_brightness (value);
+            }
+        }
+
+        char buf[16];
+        int len = led::format_value (buf, sizeof(buf), value);
+        if (len < 0)
+            co_return -1;
+        ssize_t result = co_await io (l, led::attr_brightness, true, buf, len);
+        if (use_shadow) {
+            if (result >= 0)
+                l.brightness_written (value);
+            else
+                l.shadow.known &= ~led::field_brightness;
+        }
+        co_return result < 0 ? -1 : 0;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    task<int> led_executor::read_color_intensity (led& l, std::span<unsigned> values)
+    {
+        bool use_shadow = l.led_flags & led::shadow_state;
+        if (use_shadow  &&  (l.shadow.known & led::field_intensity))
+            co_return l.read_color_intensity (values);
+
+        char buf[led::intensity_buf_size];
+        ssize_t len = co_await io (l, led::attr_multi_intensity, false, buf, sizeof(buf));
+        if (len < 0)
+            co_return -1;
+        int num = led::parse_values (buf, len, values);
+        if (num < 0)
+            co_return -1;
+        if (use_shadow) {
+            l.shadow.intensity.assign (values.begin(), values.begin()+num);
+            l.shadow.known |= led::field_intensity;
+        }
+        co_return num;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    task<int> led_executor::color_intensity (led& l, std::span<const unsigned> values)
+    {
+        bool use_shadow = l.led_flags & led::shadow_state;
+        if (use_shadow) {
+            bool unchanged = (l.shadow.known & led::field_intensity)  &&
+                std::equal (values.begin(), values.end(), l.shadow.intensity.begin(), l.shadow.intensity.end());
+            if (unchanged  ||  (l.led_flags & led::defer_writes))
+                co_return l.color_intensity (values);
+        }
+
+        char buf[led::intensity_buf_size];
+        int len = led::format_values (buf, sizeof(buf), values);
+        if (len < 0)
+            co_return -1;
+        ssize_t result = co_await io (l, led::attr_multi_intensity, true, buf, len);
+        if (use_shadow) {
+            if (result >= 0)
+                l.intensity_written (values);
+            else
+                l.shadow.known &= ~led::field_intensity;
+        }
+        co_return result < 0 ? -1 : 0;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    task<std::string> led_executor::trigger (led& l)
+    {
+        static constexpr size_t min_page_size = 4096;
+
+        bool use_shadow = l.led_flags & led::shadow_state;
+        if (use_shadow  &&  (l.shadow.known & led::field_trigger))
+            co_return std::string (trigger_registry::name(l.shadow.trigger));
+
+        // Read until the end of the file, like led::read_trigger_file()
+        std::string buf (min_page_size, '\0');
+        size_t total = 0;
+        while (true) {
+            if (total == buf.size())
+                buf.resize (buf.size() * 2);
+            size_t size = buf.size() - total;
+            ssize_t len = co_await io (l, led::attr_trigger, false, buf.data()+total, size, total);
+            if (len < 0)
+                co_return std::string ();
+            total += len;
+            if (len == 0  ||  ((size_t)len < size  &&  (size_t)len < min_page_size))
+                break;
+        }
+
+        std::string_view list (buf.data(), total);
+        list = list.substr (0, list.find('\n'));
+        auto name = led::parse_active_trigger (list);
+        if (use_shadow  &&  !name.empty()) {
+            l.shadow.trigger = trigger_registry::intern (name);
+            l.shadow.known |= led::field_trigger;
+        }
+        co_return std::string (name);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    task<int> led_executor::trigger (led& l, std::string name)
+    {
+        bool use_shadow = l.led_flags & led::shadow_state;
+        trigger_id id = 0;
+        if (use_shadow) {
+            id = trigger_registry::intern (name);
+            if (((l.shadow.known & led::field_trigger)  &&  l.shadow.trigger == id)  ||
+                (l.led_flags & led::defer_writes))
+            {
+                co_return l.set_trigger (id, name);
+            }
+        }
+
+        // Terminate the name with a newline, like "echo" would
+        name.push_back ('\n');
+        ssize_t result = co_await io (l, led::attr_trigger, true, name.data(), name.size());
+        if (use_shadow) {
+            if (result >= 0)
+                l.trigger_written (id);
+            else
+                l.shadow.known &= ~led::field_trigger;
+        }
+        co_return result < 0 ? -1 : 0;
+    }
+
+
+}
@@ -0,0 +1,446 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEDPP_LED_EXECUTOR_HPP
+#define LEDPP_LED_EXECUTOR_HPP
+
+#include <led++.hpp>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+#include <type_traits>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <queue>
+#include <unordered_set>
+#include <string>
+#include <cstdint>
+
+
+namespace ledpp {
+
+
+    class uring;
+
+
+    namespace detail {
+
+        // Resume the awaiting coroutine when a task finishes
+        struct task_final_awaiter {
+            bool await_ready () const noexcept {
+                return false;
+            }
+            template<typename Promise>
+            std::coroutine_handle<> await_suspend (std::coroutine_handle<Promise> h) noexcept {
+                auto continuation = h.promise().continuation;
+                return continuation ? continuation : std::noop_coroutine ();
+            }
+            void await_resume () const noexcept {
+            }
+        };
+
+        struct task_promise_base {
+            std::coroutine_handle<> continuation;
+            std::exception_ptr error;
+
+            std::suspend_always initial_suspend () const noexcept {
+                return {};
+            }
+            task_final_awaiter final_suspend () const noexcept {
+                return {};
+            }
+            void unhandled_exception () noexcept {
+                error = std::current_exception ();
+            }
+        };
+
+        template<typename T>
+        struct task_promise : task_promise_base {
+            std::optional<T> value;
+
+            template<typename U>
+            void return_value (U&& v) {
+                value.emplace (std::forward<U>(v));
+            }
+        };
+
+        template<>
+        struct task_promise<void> : task_promise_base {
+            void return_void () const noexcept {
+            }
+        };
+    }
+
+
+    /**
+     * A coroutine that produces a value of type <code>T</code>.
+     *
+     * A task doesn't start until it is awaited using
+     * <code>co_await</code>, or handed to led_executor::spawn().
+     * The awaiting coroutine is resumed when the task has finished,
+     * and gets the value returned by the task using
+     * <code>co_return</code>. An exception thrown by the task is
+     * rethrown in the awaiting coroutine.
+     *
+     * @tparam T The type of the value, or <code>void</code>.
+     */
+    template<typename T=void>
+    class [[nodiscard]] task {
+    public:
+        /**
+         * The promise type of the coroutine.
+         */
+        struct promise_type : detail::task_promise<T> {
+            task get_return_object () noexcept {
+                return task (std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+        };
+
+        /**
+         * Move constructor.
+         */
+        task (task&& t) noexcept
+            : h (std::exchange(t.h, nullptr))
+        {
+        }
+
+        /**
+         * Move assignment operator.
+         */
+        task& operator= (task&& t) noexcept {
+            if (this != &t) {
+                if (h)
+                    h.destroy ();
+                h = std::exchange (t.h, nullptr);
+            }
+            return *this;
+        }
+
+        /**
+         * Destroy the coroutine, if it hasn't been spawned.
+         */
+        ~task () {
+            if (h)
+                h.destroy ();
+        }
+
+        task (const task&) = delete;
+        task& operator= (const task&) = delete;
+
+        /** Part of the awaitable interface. */
+        bool await_ready () const noexcept {
+            return false;
+        }
+
+        /** Part of the awaitable interface, starts the task. */
+        std::coroutine_handle<> await_suspend (std::coroutine_handle<> caller) noexcept {
+            h.promise().continuation = caller;
+            return h;
+        }
+
+        /** Part of the awaitable interface, returns the result. */
+        T await_resume () {
+            auto& p = h.promise ();
+            if (p.error)
+                std::rethrow_exception (p.error);
+            if constexpr (!std::is_void_v<T>)
+                return std::move (*p.value);
+        }
+
+
+    private:
+        friend class led_executor;
+        std::coroutine_handle<promise_type> h;
+
+        explicit task (std::coroutine_handle<promise_type> handle) noexcept
+            : h (handle)
+        {
+        }
+    };
+
+
+    /**
+     * Run coroutines that operate on LEDs in a single thread.
+     *
+     * The executor provides awaitable versions of the led methods to
+     * read and write the brightness, color intensity, and trigger,
+     * and awaitable timers. Reads and writes are submitted to the
+     * kernel using io_uring, so any number of LED tasks can wait for
+     * slow LEDs at the same time without blocking the thread. All
+     * operations started while running ready coroutines are submitted
+     * using a single system call. If io_uring isn't available, the
+     * reads and writes are made synchronously instead.
+     *
+     * Example:
+     * @code
+     * ledpp::task<> blink (ledpp::led_executor& ex, ledpp::led& l) {
+     *     for (int i=0; i<10; ++i) {
+     *         co_await ex.brightness (l, i & 1);
+     *         co_await ex.sleep_for (std::chrono::milliseconds(250));
+     *     }
+     * }
+     *
+     * ledpp::led_executor ex;
+     * ex.spawn (blink(ex, l));
+     * ex.run ();
+     * @endcode
+     *
+     * The executor can be driven by run(), or by an external event
+     * loop that waits for the file descriptor returned by fd() to
+     * become readable and then calls poll().
+     *
+     * Reads and writes follow the same rules as the corresponding
+     * led methods, including the <code>shadow_state</code> and
+     * <code>defer_writes</code> flags. Create the led objects with
+     * flag <code>keep_open</code> to avoid opening the attribute
+     * files on each access. A led object should be used by at most
+     * one task at a time.
+     *
+     * The executor isn't thread-safe, all methods must be called
+     * from the thread running it.
+     */
+    class led_executor {
+    public:
+        /**
+         * Clock used for timers.
+         */
+        using clock = std::chrono::steady_clock;
+
+        /**
+         * Create an executor.
+         * @param queue_depth The maximum number of reads and
+         *                    writes in progress at the same time.
+         * @throw std::system_error If the event file descriptors
+         *                          can't be created.
+         */
+        led_executor (unsigned queue_depth=256);
+
+        /**
+         * Destructor.
+         * Waits for reads and writes in progress,
+         * and destroys all unfinished tasks.
+         */
+        ~led_executor ();
+
+        led_executor (const led_executor&) = delete;
+        led_executor& operator= (const led_executor&) = delete;
+
+        /**
+         * Check if the executor uses io_uring for reads and writes.
+         */
+        bool uses_io_uring () const {
+            return ring != nullptr;
+        }
+
+        /**
+         * Return a file descriptor that is readable when
+         * the executor has work to do, see poll().
+         */
+        int fd () const {
+            return epoll_fd;
+        }
+
+        /**
+         * Start a task that runs until it is finished.
+         * The task starts the next time the executor runs.
+         * If the task throws an exception, it is rethrown
+         * by run() or poll().
+         * @param t The task.
+         */
+        void spawn (task<> t);
+
+        /**
+         * Return the number of spawned tasks that haven't finished.
+         */
+        size_t size () const {
+            return tasks.size ();
+        }
+
+        /**
+         * Run coroutines that are ready, without blocking.
+         * @return The number of coroutines resumed.
+         */
+        size_t poll ();
+
+        /**
+         * Run until all spawned tasks have finished,
+         * or stop() is called.
+         */
+        void run ();
+
+        /**
+         * Make run() return after the coroutines that are ready have run.
+         */
+        void stop () {
+            stopped = true;
+        }
+
+        /**
+         * Awaitable that resumes the awaiting coroutine at a point in time.
+         */
+        struct sleep_awaiter {
+            led_executor& ex;           /**< The executor. */
+            clock::time_point deadline; /**< When to resume. */
+
+            /** Part of the awaitable interface. */
+            bool await_ready () const noexcept {
+                return deadline <= clock::now ();
+            }
+            /** Part of the awaitable interface. */
+            void await_suspend (std::coroutine_handle<> h) {
+                ex.add_timer (deadline, h);
+            }
+            /** Part of the awaitable interface. */
+            void await_resume () const noexcept {
+            }
+        };
+
+        /**
+         * Suspend the awaiting coroutine for a time.
+         * @param time The time to sleep.
+         */
+        template<typename Rep, typename Period>
+        sleep_awaiter sleep_for (std::chrono::duration<Rep, Period> time) {
+            return sleep_awaiter {*this, clock::now() + std::chrono::duration_cast<clock::duration>(time)};
+        }
+
+        /**
+         * Suspend the awaiting coroutine until a point in time.
+         * @param deadline When to resume.
+         */
+        sleep_awaiter sleep_until (clock::time_point deadline) {
+            return sleep_awaiter {*this, deadline};
+        }
+
+        /**
+         * Read the brightness of a LED, like led::brightness().
+         * @return The brightness, or -1 on error and
+         *         <code>errno</code> is set.
+         */
+        task<int> brightness (led& l);
+
+        /**
+         * Set the brightness of a LED, like led::brightness(unsigned).
+         * @return 0 on success, or -1 on error and
+         *         <code>errno</code> is set.
+         */
+        task<int> brightness (led& l, unsigned value);
+
+        /**
+         * Read the color intensity values of a multicolor LED,
+         * like led::read_color_intensity().
+         * @param l The LED.
+         * @param values Buffer for the values, it must remain valid
+         *               until the task has finished.
+         * @return The number of values, or -1 on error and
+         *         <code>errno</code> is set.
+         */
+        task<int> read_color_intensity (led& l, std::span<unsigned> values);
+
+        /**
+         * Set the color intensity values of a multicolor LED,
+         * like led::color_intensity(std::span<const unsigned>).
+         * @param l The LED.
+         * @param values The values, they must remain valid
+         *               until the task has finished.
+         * @return 0 on success, or -1 on error and
+         *         <code>errno</code> is set.
+         */
+        task<int> color_intensity (led& l, std::span<const unsigned> values);
+
+        /**
+         * Read the name of the current trigger of a LED,
+         * like led::trigger().
+         * @return The trigger name, or an empty string on error.
+         */
+        task<std::string> trigger (led& l);
+
+        /**
+         * Set the trigger of a LED, like led::trigger(std::string_view).
+         * @return 0 on success, or -1 on error and
+         *         <code>errno</code> is set.
+         */
+        task<int> trigger (led& l, std::string name);
+
+
+    private:
+        struct detached;
+
+        // A read or write, completed by io_uring or synchronously
+        struct io_op {
+            led_executor& ex;
+            bool write;
+            int fd;
+            void* buf;
+            unsigned len;
+            uint64_t offset;
+            int result;
+            std::coroutine_handle<> waiter;
+
+            bool await_ready () const noexcept {
+                return false;
+            }
+            bool await_suspend (std::coroutine_handle<> h) {
+                waiter = h;
+                return ex.submit (*this);
+            }
+            int await_resume () const noexcept {
+                return result;
+            }
+        };
+
+        struct timer {
+            clock::time_point deadline;
+            uint64_t seq;
+            std::coroutine_handle<> waiter;
+
+            bool operator> (const timer& rhs) const {
+                return deadline != rhs.deadline ? deadline > rhs.deadline : seq > rhs.seq;
+            }
+        };
+
+        unsigned queue_depth;
+        int epoll_fd;
+        int timer_fd;
+        int event_fd;
+        bool stopped;
+        std::unique_ptr<uring> ring;
+        unsigned in_flight;
+        unsigned unsubmitted;
+        std::deque<io_op*> waiting;
+        std::vector<std::coroutine_handle<>> ready;
+        std::priority_queue<timer, std::vector<timer>, std::greater<timer>> timers;
+        uint64_t timer_seq;
+        std::unordered_set<void*> tasks;
+        std::exception_ptr task_error;
+
+        static detached run_detached (led_executor* ex, task<> t);
+        void add_timer (clock::time_point deadline, std::coroutine_handle<> h);
+        bool submit (io_op& op);
+        bool queue (io_op& op);
+        void reap ();
+        void arm_timer ();
+        task<ssize_t> io (led& l, led::attr_t attr, bool write, char* buf, size_t len, off_t offset=0);
+    };
+
+
+}
+#endif
@@ -0,0 +1,314 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <led++.hpp>
+#include <algorithm>
+#include <cerrno>
+
+
+//
+// The non-throwing interface of class led. The methods call the
+// methods reporting errors by -1 and errno, and turn errno into an
+// error code, so both interfaces always behave the same.
+//
+namespace ledpp {
+
+
+    //--------------------------------------------------------------------------
+    // Return the current errno as an error. Some failures, like a
+    // trigger file without an active trigger, don't set errno, so the
+    // caller clears it first and gives the error to use in that case.
+    //--------------------------------------------------------------------------
+    static unexpected<std::error_code> last_error (int fallback=EIO) noexcept
+    {
+        int errnum = errno ? errno : fallback;
+        return unexpected (std::error_code(errnum, std::generic_category()));
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    static expected<void> void_result (int result) noexcept
+    {
+        if (result < 0)
+            return last_error ();
+        return {};
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    expected<led> led::open (const std::string& name, unsigned flags) noexcept
+    {
+        return open (name, leds_dir(), flags);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    expected<led> led::open (const std::string& name,
+                             const std::filesystem::path& dir,
+                             unsigned flags) noexcept
+    {
+        led l (name, flags, std::nothrow);
+        int errnum = l.open_dir (dir);
+        if (errnum)
+            return unexpected (std::error_code(errnum, std::generic_category()));
+        return l;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    expected<unsigned> led::try_max_brightness () noexcept
+    {
+        int value = max_brightness ();
+        if (value < 0)
+            return last_error ();
+        return (unsigned) value;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    expected<unsigned> led::try_brightness () noexcept
+    {
+        int value = brightness ();
+        if (value < 0)
+            return last_error ();
+        return (unsigned) value;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    expected<void> led::try_brightness (unsigned value) noexcept
+    {
+        return void_result (brightness(value));
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    expected<std::span<const std::string>> led::try_color_names () const noexcept
+    {
+        auto& names = color_names ();
+        if (!colors_valid)
+            return last_error ();
+        return std::span<const std::string> (names);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    expected<std::vector<unsigned>> led::try_color_intensity () noexcept
+    {
+        auto names = try_color_names ();
+        if (!names)
+            return unexpected (names.error());
+        std::vector<unsigned> values (names->size());
+        if (values.empty())
+            return values;
+        auto num = try_read_color_intensity (values);
+        if (!num)
+            return unexpected (num.error());
+        values.resize (*num);
+        return values;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    expected<void> led::try_color_intensity (std::span<const unsigned> values) noexcept
+    {
+        return void_result (color_intensity(values));
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    expected<size_t> led::try_read_color_intensity (std::span<unsigned> values) noexcept
+    {
+        int num = read_color_intensity (values);
+        if (num < 0)
+            return last_error ();
+        return (size_t) num;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    expected<std::set<std::string>> led::try_triggers () noexcept
+    {
+        auto ids = try_available_triggers ();
+        if (!ids)
+            return unexpected (ids.error());
+        std::set<std::string> names;
+        for (auto id : *ids)
+            names.emplace (trigger_registry::name(id));
+        return names;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    expected<std::span<const trigger_id>> led::try_available_triggers () noexcept
+    {
+        if (!trigger_list_valid) {
+            errno = 0;
+            parse_triggers ();
+        }
+        // A list without an active trigger is still valid
+        if (!trigger_list_valid)
+            return last_error (EINVAL);
+        return std::span<const trigger_id> (trigger_list);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    expected<bool> led::try_has_trigger (std::string_view name) noexcept
+    {
+        auto ids = try_available_triggers (); // Interns the trigger names
+        if (!ids)
+            return unexpected (ids.error());
+        int id = trigger_registry::find (name);
+        return id >= 0  &&  std::binary_search (ids->begin(), ids->end(), (trigger_id)id);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    expected<trigger_id> led::try_active_trigger () noexcept
+    {
+        errno = 0;
+        int id = active_trigger ();
+        if (id < 0)
+            return last_error (ENOENT);
+        return (trigger_id) id;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    expected<std::string> led::try_trigger () noexcept
+    {
+        auto name = try_read_trigger ();
+        if (!name)
+            return unexpected (name.error());
+        return std::string (*name);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    expected<std::string_view> led::try_read_trigger () noexcept
+    {
+        errno = 0;
+        auto name = read_trigger ();
+        if (name.empty())
+            return last_error (ENOENT);
+        return name;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    expected<void> led::try_trigger (std::string_view name) noexcept
+    {
+        return void_result (trigger(name));
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    expected<void> led::try_trigger (trigger_id id) noexcept
+    {
+        return void_result (trigger(id));
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    expected<void> led::try_timer (unsigned delay_on, unsigned delay_off) noexcept
+    {
+        return void_result (timer(delay_on, delay_off));
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    expected<void> led::try_pattern (std::span<const pattern_step> steps, int repeat) noexcept
+    {
+        return void_result (pattern(steps, repeat));
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    expected<void> led::try_oneshot (unsigned delay_on, unsigned delay_off, bool invert) noexcept
+    {
+        return void_result (oneshot(delay_on, delay_off, invert));
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    expected<void> led::try_shot () noexcept
+    {
+        return void_result (shot());
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    expected<void> led::try_flush () noexcept
+    {
+        return void_result (flush());
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    expected<std::set<std::string>> led::try_led_names () noexcept
+    {
+        return try_led_names (leds_dir());
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    expected<std::set<std::string>> led::try_led_names (const std::filesystem::path& dir) noexcept
+    {
+        std::error_code ec;
+        std::set<std::string> names;
+        std::filesystem::directory_iterator end;
+        std::filesystem::directory_iterator dir_iter (dir, ec);
+        while (!ec  &&  dir_iter != end) {
+            std::string name = dir_iter->path().filename().string ();
+            if (name.empty() == false)
+                names.emplace (std::move(name));
+            dir_iter.increment (ec);
+        }
+        if (ec)
+            return unexpected (ec);
+        return names;
+    }
+
+
+}
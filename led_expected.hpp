@@ -0,0 +1,314 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEDPP_LED_EXPECTED_HPP
+#define LEDPP_LED_EXPECTED_HPP
+
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <cstdlib>
+
+
+namespace ledpp {
+
+
+    /**
+     * An error value used to construct an expected object
+     * that holds an error, like <code>std::unexpected</code>.
+     */
+    template<class E>
+    class unexpected {
+    public:
+        /**
+         * Wrap an error value.
+         */
+        constexpr explicit unexpected (E e) noexcept (std::is_nothrow_move_constructible_v<E>)
+            : err (std::move(e))
+        {
+        }
+
+        /**
+         * Return the error value.
+         */
+        constexpr const E& error () const& noexcept {
+            return err;
+        }
+
+        /**
+         * Return the error value.
+         */
+        constexpr E&& error () && noexcept {
+            return std::move (err);
+        }
+
+    private:
+        E err;
+    };
+
+
+    /**
+     * Either a value or an error, with the same interface as the
+     * commonly used parts of C++23 <code>std::expected</code>.
+     *
+     * The library is built as C++20, where <code>std::expected</code>
+     * isn't available. A type of our own is used even when the
+     * application is built as C++23, since the layout of the return
+     * values of the library can't depend on the language version of
+     * the code calling it. Code written against this type compiles
+     * unchanged with <code>std::expected</code>.
+     *
+     * No method throws. Calling value(), <code>operator*</code>, or
+     * <code>operator-></code> on an object that holds an error, or
+     * error() on an object that holds a value, is a programming error
+     * that aborts the program.
+     *
+     * @tparam T The value type.
+     * @tparam E The error type.
+     */
+    template<class T, class E = std::error_code>
+    class expected {
+    public:
+        using value_type = T; /**< The value type. */
+        using error_type = E; /**< The error type. */
+
+        /**
+         * Hold a default constructed value.
+         */
+        constexpr expected () noexcept (std::is_nothrow_default_constructible_v<T>)
+            : v (std::in_place_index<0>)
+        {
+        }
+
+        /**
+         * Hold a value.
+         */
+        template<class U = T>
+            requires (std::is_constructible_v<T, U&&>  &&
+                      !std::is_same_v<std::remove_cvref_t<U>, expected>  &&
+                      !std::is_same_v<std::remove_cvref_t<U>, unexpected<E>>)
+        constexpr expected (U&& value) noexcept (std::is_nothrow_constructible_v<T, U&&>)
+            : v (std::in_place_index<0>, std::forward<U>(value))
+        {
+        }
+
+        /**
+         * Hold an error.
+         */
+        template<class G>
+        constexpr expected (const unexpected<G>& e) noexcept
+            : v (std::in_place_index<1>, e.error())
+        {
+        }
+
+        /**
+         * Hold an error.
+         */
+        template<class G>
+        constexpr expected (unexpected<G>&& e) noexcept
+            : v (std::in_place_index<1>, std::move(e).error())
+        {
+        }
+
+        /**
+         * Check if a value is held.
+         */
+        constexpr bool has_value () const noexcept {
+            return v.index() == 0;
+        }
+
+        /**
+         * Check if a value is held.
+         */
+        constexpr explicit operator bool () const noexcept {
+            return has_value ();
+        }
+
+        /**
+         * Return the value.
+         */
+        constexpr T& value () & noexcept {
+            return *std::get_if<0> (&checked(true).v);
+        }
+
+        /**
+         * Return the value.
+         */
+        constexpr const T& value () const& noexcept {
+            return *std::get_if<0> (&checked(true).v);
+        }
+
+        /**
+         * Return the value.
+         */
+        constexpr T&& value () && noexcept {
+            return std::move (*std::get_if<0>(&checked(true).v));
+        }
+
+        /**
+         * Return the value, or a default value if an error is held.
+         */
+        template<class U>
+        constexpr T value_or (U&& other) const& {
+            return has_value() ? *std::get_if<0>(&v) : static_cast<T>(std::forward<U>(other));
+        }
+
+        /**
+         * Return the error.
+         */
+        constexpr const E& error () const& noexcept {
+            return *std::get_if<1> (&checked(false).v);
+        }
+
+        /**
+         * Return the value.
+         */
+        constexpr T& operator* () & noexcept {
+            return value ();
+        }
+
+        /**
+         * Return the value.
+         */
+        constexpr const T& operator* () const& noexcept {
+            return value ();
+        }
+
+        /**
+         * Return the value.
+         */
+        constexpr T&& operator* () && noexcept {
+            return std::move(*this).value ();
+        }
+
+        /**
+         * Access the value.
+         */
+        constexpr T* operator-> () noexcept {
+            return &value ();
+        }
+
+        /**
+         * Access the value.
+         */
+        constexpr const T* operator-> () const noexcept {
+            return &value ();
+        }
+
+    private:
+        std::variant<T, E> v;
+
+        constexpr expected& checked (bool want_value) noexcept {
+            if (has_value() != want_value)
+                std::abort ();
+            return *this;
+        }
+        constexpr const expected& checked (bool want_value) const noexcept {
+            if (has_value() != want_value)
+                std::abort ();
+            return *this;
+        }
+    };
+
+
+    /**
+     * Success without a value, or an error.
+     * @tparam E The error type.
+     */
+    template<class E>
+    class expected<void, E> {
+    public:
+        using value_type = void; /**< The value type. */
+        using error_type = E;    /**< The error type. */
+
+        /**
+         * Success.
+         */
+        constexpr expected () noexcept
+            : ok (true),
+              err ()
+        {
+        }
+
+        /**
+         * Hold an error.
+         */
+        template<class G>
+        constexpr expected (const unexpected<G>& e) noexcept
+            : ok (false),
+              err (e.error())
+        {
+        }
+
+        /**
+         * Hold an error.
+         */
+        template<class G>
+        constexpr expected (unexpected<G>&& e) noexcept
+            : ok (false),
+              err (std::move(e).error())
+        {
+        }
+
+        /**
+         * Check if the operation succeeded.
+         */
+        constexpr bool has_value () const noexcept {
+            return ok;
+        }
+
+        /**
+         * Check if the operation succeeded.
+         */
+        constexpr explicit operator bool () const noexcept {
+            return ok;
+        }
+
+        /**
+         * Check that the operation succeeded.
+         */
+        constexpr void value () const noexcept {
+            if (!ok)
+                std::abort ();
+        }
+
+        /**
+         * Check that the operation succeeded.
+         */
+        constexpr void operator* () const noexcept {
+            value ();
+        }
+
+        /**
+         * Return the error.
+         */
+        constexpr const E& error () const& noexcept {
+            if (ok)
+                std::abort ();
+            return err;
+        }
+
+    private:
+        bool ok;
+        E err;
+    };
+
+
+}
+#endif
@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <led_frame.hpp>
+#include <cerrno>
+
+
+namespace ledpp {
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    led_frame::led_frame ()
+    {
+        reset_stats ();
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    led_frame::led_frame (std::span<led* const> leds)
+        : led_frame ()
+    {
+        slots.reserve (leds.size());
+        index_of.reserve (leds.size());
+        for (auto l : leds)
+            add (*l);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    size_t led_frame::add (led& l)
+    {
+        auto [i, inserted] = index_of.try_emplace (&l, slots.size());
+        if (!inserted)
+            return i->second;
+        slot& s = slots.emplace_back ();
+        s.target = &l;
+        s.front.fields = 0;
+        s.back.fields = 0;
+        s.written = 0;
+        return slots.size() - 1;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led_frame::brightness (size_t index, unsigned value)
+    {
+        state& back = slots[index].back;
+        back.brightness = value;
+        back.fields |= field_brightness;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led_frame::color_intensity (size_t index, std::span<const unsigned> values)
+    {
+        state& back = slots[index].back;
+        back.intensity.assign (values.begin(), values.end());
+        back.fields |= field_intensity;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led_frame::trigger (size_t index, trigger_id id)
+    {
+        state& back = slots[index].back;
+        back.trigger = id;
+        back.fields |= field_trigger;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led_frame::brightness (size_t index) const
+    {
+        const state& back = slots[index].back;
+        return (back.fields & field_brightness) ? (int)back.brightness : -1;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led_frame::revert ()
+    {
+        for (auto& s : slots)
+            s.back = s.front;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led_frame::invalidate ()
+    {
+        for (auto& s : slots)
+            s.front.fields = 0;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led_frame::commit ()
+    {
+        static const trigger_id none = trigger_registry::intern ("none");
+        auto start = clock::now ();
+
+        //
+        // Queue the differences between the buffers
+        //
+        for (auto& s : slots) {
+            const state& back = s.back;
+            const state& front = s.front;
+            unsigned changed = back.fields & ~front.fields;
+
+            if ((back.fields & front.fields & field_trigger)  &&
+                back.trigger != front.trigger)
+            {
+                changed |= field_trigger;
+            }
+            if ((back.fields & front.fields & field_intensity)  &&
+                back.intensity != front.intensity)
+            {
+                changed |= field_intensity;
+            }
+            if ((back.fields & front.fields & field_brightness)  &&
+                back.brightness != front.brightness)
+            {
+                changed |= field_brightness;
+            }
+            // Setting the trigger turns the LED off, so write the
+            // brightness again. Brightness 0 isn't written after any
+            // other trigger than none, since that would remove the new
+            // trigger. It is still recorded as committed, so later
+            // commits don't write it either.
+            unsigned elided = 0;
+            if ((changed & field_trigger)  &&  (back.fields & field_brightness)) {
+                if (back.brightness != 0)
+                    changed |= field_brightness;
+                else if (back.trigger != none)
+                    elided = field_brightness;
+            }
+
+            s.written = changed | elided;
+            changed &= ~elided;
+            if (changed & field_trigger)
+                batch.trigger (*s.target, trigger_registry::name(back.trigger));
+            if (changed & field_intensity)
+                batch.color_intensity (*s.target, back.intensity);
+            if (changed & field_brightness)
+                batch.brightness (*s.target, back.brightness);
+        }
+
+        int result = batch.commit ();
+        int errnum = errno;
+
+        //
+        // Update the front buffer with what was written.
+        // The batch results are in the same order as the slots.
+        //
+        auto& results = batch.results ();
+        size_t r = 0;
+        for (auto& s : slots) {
+            if (!s.written)
+                continue;
+            if (results[r++].errnum) {
+                s.front.fields &= ~s.written;
+                ++latency.errors;
+                continue;
+            }
+            if (s.written & field_trigger)
+                s.front.trigger = s.back.trigger;
+            if (s.written & field_intensity)
+                s.front.intensity = s.back.intensity;
+            if (s.written & field_brightness)
+                s.front.brightness = s.back.brightness;
+            s.front.fields |= s.written;
+            ++latency.writes;
+        }
+
+        auto elapsed = clock::now() - start;
+        ++latency.commits;
+        latency.last = elapsed;
+        latency.total += elapsed;
+        if (latency.commits == 1  ||  elapsed < latency.min)
+            latency.min = elapsed;
+        if (elapsed > latency.max)
+            latency.max = elapsed;
+
+        if (result)
+            errno = errnum;
+        return result;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led_frame::reset_stats ()
+    {
+        latency.commits = 0;
+        latency.writes = 0;
+        latency.errors = 0;
+        latency.last = clock::duration::zero ();
+        latency.min = clock::duration::zero ();
+        latency.max = clock::duration::zero ();
+        latency.total = clock::duration::zero ();
+    }
+
+
+}
@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEDPP_LED_FRAME_HPP
+#define LEDPP_LED_FRAME_HPP
+
+#include <led++.hpp>
+#include <led_batch.hpp>
+#include <chrono>
+#include <vector>
+#include <unordered_map>
+#include <span>
+
+
+namespace ledpp {
+
+
+    /**
+     * A frame of brightness, color intensity, and trigger
+     * state for a fixed set of LEDs.
+     *
+     * The frame has two buffers. The back buffer is modified
+     * using brightness(), color_intensity(), and trigger(), and
+     * nothing is written to the LEDs until commit() is called.
+     * The front buffer holds the state last committed to the LEDs.
+     * A commit compares the buffers and writes only the LEDs and
+     * attributes that differ, in the order the LEDs were added to
+     * the frame. For each LED, the trigger is written first, then
+     * the color intensity, and last the brightness. Since setting
+     * a trigger may change the brightness, the brightness is
+     * written again after a trigger change. Brightness 0 is not
+     * written together with a trigger other than <code>none</code>,
+     * since that would remove the new trigger.
+     *
+     * The writes of one commit are made using a led_batch, so
+     * they are submitted using a single system call if io_uring
+     * is available.
+     *
+     * Attributes that have never been set in the back buffer
+     * are left untouched.
+     */
+    class led_frame {
+    public:
+        /**
+         * Clock used for commit latency.
+         */
+        using clock = std::chrono::steady_clock;
+
+        /**
+         * Commit latency statistics.
+         */
+        struct stats {
+            unsigned long commits;     /**< Number of commits made. */
+            unsigned long writes;      /**< Number of LEDs written to. */
+            unsigned long errors;      /**< Number of LEDs that failed. */
+            clock::duration last;      /**< Latency of the last commit. */
+            clock::duration min;       /**< Shortest commit latency. */
+            clock::duration max;       /**< Longest commit latency. */
+            clock::duration total;     /**< Sum of all commit latencies. */
+
+            /**
+             * Return the mean commit latency.
+             */
+            clock::duration mean () const {
+                return commits ? total / static_cast<clock::rep>(commits) : clock::duration::zero();
+            }
+        };
+
+        /**
+         * Create an empty frame.
+         */
+        led_frame ();
+
+        /**
+         * Create a frame for a set of LEDs.
+         * @param leds The LEDs. The objects must remain valid
+         *             for the lifetime of the frame.
+         */
+        led_frame (std::span<led* const> leds);
+
+        led_frame (const led_frame&) = delete;
+        led_frame& operator= (const led_frame&) = delete;
+
+        /**
+         * Add a LED to the frame. If the LED is already
+         * in the frame, the existing index is returned.
+         * @param l The LED. The object must remain valid
+         *          for the lifetime of the frame.
+         * @return The index of the LED in the frame.
+         */
+        size_t add (led& l);
+
+        /**
+         * Return the number of LEDs in the frame.
+         */
+        size_t size () const {
+            return slots.size ();
+        }
+
+        /**
+         * Return a LED in the frame.
+         * @param index The index of the LED in the frame.
+         */
+        led& at (size_t index) const {
+            return *slots[index].target;
+        }
+
+        /**
+         * Set the brightness of a LED in the back buffer.
+         * @param index The index of the LED in the frame.
+         * @param value The brightness value.
+         */
+        void brightness (size_t index, unsigned value);
+
+        /**
+         * Set the color intensity of a LED in the back buffer.
+         * @param index The index of the LED in the frame.
+         * @param values The color intensity values.
+         */
+        void color_intensity (size_t index, std::span<const unsigned> values);
+
+        /**
+         * Set the trigger of a LED in the back buffer.
+         * @param index The index of the LED in the frame.
+         * @param id The trigger.
+         */
+        void trigger (size_t index, trigger_id id);
+
+        /**
+         * Set the trigger of a LED in the back buffer.
+         * @param index The index of the LED in the frame.
+         * @param name The name of the trigger.
+         */
+        void trigger (size_t index, std::string_view name) {
+            trigger (index, trigger_registry::intern(name));
+        }
+
+        /**
+         * Return the brightness of a LED in the back buffer.
+         * @return The brightness, or -1 if not set.
+         */
+        int brightness (size_t index) const;
+
+        /**
+         * Make the back buffer equal to the front buffer,
+         * discarding all changes since the last commit.
+         */
+        void revert ();
+
+        /**
+         * Forget what has been committed, so the next
+         * commit writes all attributes set in the back buffer.
+         */
+        void invalidate ();
+
+        /**
+         * Write the differences between the back buffer
+         * and the front buffer to the LEDs.
+         * LEDs that fail are retried on the next commit.
+         * @return 0 if all writes succeeded. -1 if one or more
+         *         writes failed, and <code>errno</code> is set
+         *         to the first error.
+         */
+        int commit ();
+
+        /**
+         * Return the commit latency statistics.
+         * The latency of a commit is measured from the start of
+         * the commit until the last LED has been written, and is
+         * an upper bound on the time to update the slowest LED.
+         */
+        const stats& commit_stats () const {
+            return latency;
+        }
+
+        /**
+         * Reset the commit latency statistics.
+         */
+        void reset_stats ();
+
+
+    private:
+        enum : unsigned {
+            field_trigger    = 0x01,
+            field_intensity  = 0x02,
+            field_brightness = 0x04,
+        };
+
+        struct state {
+            unsigned fields;
+            unsigned brightness;
+            trigger_id trigger;
+            std::vector<unsigned> intensity;
+        };
+
+        struct slot {
+            led* target;
+            state front;
+            state back;
+            unsigned written;
+        };
+
+        std::vector<slot> slots;
+        std::unordered_map<led*, size_t> index_of;
+        led_batch batch;
+        stats latency;
+    };
+
+
+}
+#endif
@@ -0,0 +1,561 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <led_registry.hpp>
+#include <algorithm>
+#include <system_error>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+
+namespace ledpp {
+
+
+    // Size of the buffer used to receive uevents and inotify events
+    static constexpr size_t event_buf_size = 16384;
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    led_registry::led_registry (unsigned flags)
+        : led_registry (led::leds_dir(), flags)
+    {
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    led_registry::led_registry (const std::filesystem::path& dir_arg, unsigned flags)
+        : dir (dir_arg),
+          led_flags (flags),
+          uevents (false),
+          epoll_fd (-1),
+          source_fd (-1),
+          event_fd (-1),
+          stopped (false),
+          next_subscriber (1),
+          buf (event_buf_size)
+    {
+        epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+        event_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epoll_fd >= 0  &&  event_fd >= 0)
+            open_source ();
+        if (epoll_fd < 0  ||  event_fd < 0  ||  source_fd < 0) {
+            int errnum = errno;
+            for (int fd : {epoll_fd, event_fd, source_fd}) {
+                if (fd >= 0)
+                    close (fd);
+            }
+            throw std::system_error (errnum, std::generic_category());
+        }
+
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = source_fd;
+        epoll_ctl (epoll_fd, EPOLL_CTL_ADD, source_fd, &ev);
+        ev.data.fd = event_fd;
+        epoll_ctl (epoll_fd, EPOLL_CTL_ADD, event_fd, &ev);
+
+        // Listen for changes before reading the directory,
+        // so no LED added in between is missed
+        try {
+            for (auto& name : led::led_names(dir))
+                add (name);
+        }
+        catch (...) {
+            close (source_fd);
+            close (event_fd);
+            close (epoll_fd);
+            throw;
+        }
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    led_registry::~led_registry ()
+    {
+        close (source_fd);
+        close (event_fd);
+        close (epoll_fd);
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Use kernel uevents for the real LED class directory, and
+    // inotify otherwise, or if the netlink socket can't be used.
+    // Sysfs doesn't generate inotify events for devices, so a
+    // registry using inotify on sysfs will only see the initial LEDs.
+    //--------------------------------------------------------------------------
+    void led_registry::open_source ()
+    {
+        std::error_code ec;
+        if (std::filesystem::equivalent(dir, led::default_leds_dir, ec)) {
+            source_fd = socket (AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                                NETLINK_KOBJECT_UEVENT);
+            if (source_fd >= 0) {
+                sockaddr_nl addr;
+                memset (&addr, 0, sizeof(addr));
+                addr.nl_family = AF_NETLINK;
+                addr.nl_groups = 1; // Kernel uevents
+                if (bind(source_fd, (sockaddr*)&addr, sizeof(addr)) == 0) {
+                    uevents = true;
+                    return;
+                }
+                close (source_fd);
+                source_fd = -1;
+            }
+        }
+
+        source_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+        if (source_fd < 0)
+            return;
+        if (inotify_add_watch(source_fd, dir.c_str(),
+                              IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO) < 0)
+        {
+            int errnum = errno;
+            close (source_fd);
+            source_fd = -1;
+            errno = errnum;
+        }
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Split a name following the convention devicename:color:function.
+    // The function is after the last colon, and the color before it.
+    // The device name is everything before the color, and may itself
+    // contain colons. A name with only one colon is color:function,
+    // and a name without colons is taken to be a function, like "ACT".
+    //--------------------------------------------------------------------------
+    void led_registry::parse_name (entry& e)
+    {
+        std::string_view name (e.name);
+        e.device = e.color = e.function = std::string_view ();
+
+        auto last = name.rfind (':');
+        if (last == std::string_view::npos) {
+            e.function = name;
+        }else{
+            e.function = name.substr (last + 1);
+            auto prev = last ? name.rfind(':', last - 1) : std::string_view::npos;
+            if (prev == std::string_view::npos) {
+                e.color = name.substr (0, last);
+            }else{
+                e.device = name.substr (0, prev);
+                e.color = name.substr (prev + 1, last - prev - 1);
+            }
+        }
+        e.multicolor = e.color == "multicolor"  ||  e.color == "rgb";
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led_registry::unlink (std::vector<item*>& list, item* i)
+    {
+        auto pos = std::find (list.begin(), list.end(), i);
+        if (pos != list.end()) {
+            *pos = list.back ();
+            list.pop_back ();
+        }
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Returns 1 if the LED was added, 0 if it was already known.
+    //--------------------------------------------------------------------------
+    int led_registry::add (std::string_view name)
+    {
+        if (name.empty()  ||  by_name.find(name) != by_name.end())
+            return 0;
+
+        auto i = std::make_unique<item> ();
+        i->name = name;
+        parse_name (*i);
+        auto ptr = i.get ();
+        by_name.emplace (i->name, std::move(i));
+
+        // Empty fields are not indexed, they can't be selected
+        if (!ptr->device.empty())
+            by_device[std::string(ptr->device)].emplace_back (ptr);
+        if (!ptr->color.empty())
+            by_color[std::string(ptr->color)].emplace_back (ptr);
+        if (!ptr->function.empty())
+            by_function[std::string(ptr->function)].emplace_back (ptr);
+        if (ptr->multicolor)
+            multicolor_leds.emplace_back (ptr);
+
+        notify (*ptr, event::added);
+        return 1;
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Returns 1 if the LED was removed, 0 if it wasn't known.
+    //--------------------------------------------------------------------------
+    int led_registry::remove (std::string_view name)
+    {
+        auto pos = by_name.find (name);
+        if (pos == by_name.end())
+            return 0;
+        auto i = std::move (pos->second);
+        by_name.erase (pos);
+
+        auto drop = [&i](posting_map& index, std::string_view key) {
+            if (key.empty())
+                return;
+            auto list = index.find (key);
+            if (list == index.end())
+                return;
+            unlink (list->second, i.get());
+            if (list->second.empty())
+                index.erase (list);
+        };
+        drop (by_device, i->device);
+        drop (by_color, i->color);
+        drop (by_function, i->function);
+        if (i->multicolor)
+            unlink (multicolor_leds, i.get());
+
+        // Holders of the led object get errors from now on
+        if (i->handle) {
+            i->handle->close_files ();
+            i->handle->invalidate ();
+        }
+
+        notify (*i, event::removed);
+        return 1;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led_registry::notify (const entry& e, event ev)
+    {
+        // Callbacks may unsubscribe
+        auto current = subscribers;
+        for (auto& [id, cb] : current) {
+            if (cb)
+                cb (e, ev);
+        }
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    const led_registry::entry* led_registry::find (std::string_view name) const
+    {
+        auto pos = by_name.find (name);
+        return pos==by_name.end() ? nullptr : pos->second.get();
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    std::vector<const led_registry::entry*> led_registry::select (const query& q) const
+    {
+        static const std::vector<item*> none;
+        std::vector<const entry*> result;
+
+        // Start with the shortest list of candidates from the index
+        const std::vector<item*>* candidates = nullptr;
+        auto narrow = [&](const posting_map& index, std::string_view key) {
+            if (key.empty())
+                return;
+            auto list = index.find (key);
+            auto& found = list==index.end() ? none : list->second;
+            if (!candidates  ||  found.size() < candidates->size())
+                candidates = &found;
+        };
+        narrow (by_device, q.device);
+        narrow (by_color, q.color);
+        narrow (by_function, q.function);
+        if (q.multicolor > 0  &&  (!candidates  ||  multicolor_leds.size() < candidates->size()))
+            candidates = &multicolor_leds;
+
+        auto match = [&q](const entry& e) {
+            return (q.device.empty()    ||  e.device == q.device)  &&
+                   (q.color.empty()     ||  e.color == q.color)  &&
+                   (q.function.empty()  ||  e.function == q.function)  &&
+                   (q.multicolor < 0    ||  e.multicolor == (q.multicolor > 0));
+        };
+
+        if (candidates) {
+            for (auto i : *candidates) {
+                if (match(*i))
+                    result.emplace_back (i);
+            }
+        }else{
+            result.reserve (by_name.size());
+            for (auto& [name, i] : by_name) {
+                if (match(*i))
+                    result.emplace_back (i.get());
+            }
+        }
+
+        std::sort (result.begin(), result.end(), [](const entry* a, const entry* b) {
+                return a->name < b->name;
+            });
+        return result;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    std::vector<std::string> led_registry::names () const
+    {
+        std::vector<std::string> result;
+        result.reserve (by_name.size());
+        for (auto& [name, i] : by_name)
+            result.emplace_back (name);
+        std::sort (result.begin(), result.end());
+        return result;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    std::shared_ptr<led> led_registry::open (std::string_view name)
+    {
+        auto pos = by_name.find (name);
+        if (pos == by_name.end()) {
+            errno = ENODEV;
+            return nullptr;
+        }
+        auto& i = *pos->second;
+        if (!i.handle) {
+            auto l = led::open (i.name, dir, led_flags);
+            if (!l) {
+                errno = l.error().value ();
+                return nullptr;
+            }
+            i.handle = std::make_shared<led> (std::move(*l));
+        }
+        return i.handle;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led_registry::subscribe (callback cb)
+    {
+        int id = next_subscriber++;
+        subscribers.emplace_back (id, std::move(cb));
+        return id;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led_registry::unsubscribe (int id)
+    {
+        std::erase_if (subscribers, [id](auto& s) {
+                return s.first == id;
+            });
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led_registry::rescan ()
+    {
+        std::set<std::string> current;
+        try {
+            current = led::led_names (dir);
+        }
+        catch (std::filesystem::filesystem_error& e) {
+            errno = e.code().value ();
+            return -1;
+        }
+
+        std::vector<std::string> gone;
+        for (auto& [name, i] : by_name) {
+            if (!current.contains(name))
+                gone.emplace_back (name);
+        }
+        int num_changes = 0;
+        for (auto& name : gone)
+            num_changes += remove (name);
+        for (auto& name : current)
+            num_changes += add (name);
+        return num_changes;
+    }
+
+
+    //--------------------------------------------------------------------------
+    // A uevent is a header "ACTION@DEVPATH" followed by
+    // KEY=VALUE strings, all terminated by a null character.
+    //--------------------------------------------------------------------------
+    int led_registry::handle_uevents ()
+    {
+        int num_changes = 0;
+        while (true) {
+            sockaddr_nl sender;
+            socklen_t sender_len = sizeof (sender);
+            ssize_t len = recvfrom (source_fd, buf.data(), buf.size(), 0,
+                                    (sockaddr*)&sender, &sender_len);
+            if (len < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN)
+                    break;
+                if (errno == ENOBUFS) {
+                    // Events were lost
+                    int result = rescan ();
+                    if (result < 0)
+                        return -1;
+                    num_changes += result;
+                    continue;
+                }
+                return -1;
+            }
+            if (sender.nl_pid != 0)
+                continue; // Not sent by the kernel
+
+            std::string_view action, devpath, devpath_old, subsystem;
+            std::string_view msg (buf.data(), len);
+            size_t pos = msg.find ('\0');
+            while (pos < msg.size()) {
+                std::string_view field = msg.substr (pos + 1);
+                field = field.substr (0, field.find('\0'));
+                pos += field.size () + 1;
+                if (field.starts_with("ACTION="))
+                    action = field.substr (7);
+                else if (field.starts_with("DEVPATH="))
+                    devpath = field.substr (8);
+                else if (field.starts_with("DEVPATH_OLD="))
+                    devpath_old = field.substr (12);
+                else if (field.starts_with("SUBSYSTEM="))
+                    subsystem = field.substr (10);
+            }
+            if (subsystem != "leds"  ||  devpath.empty())
+                continue;
+
+            auto basename = [](std::string_view path) {
+                return path.substr (path.rfind('/') + 1);
+            };
+            if (action == "add") {
+                num_changes += add (basename(devpath));
+            }
+            else if (action == "remove") {
+                num_changes += remove (basename(devpath));
+            }
+            else if (action == "move") {
+                if (!devpath_old.empty())
+                    num_changes += remove (basename(devpath_old));
+                num_changes += add (basename(devpath));
+            }
+        }
+        return num_changes;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led_registry::handle_inotify ()
+    {
+        int num_changes = 0;
+        while (true) {
+            ssize_t len = read (source_fd, buf.data(), buf.size());
+            if (len < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN)
+                    break;
+                return -1;
+            }
+            for (ssize_t pos=0; pos<len; ) {
+                auto ev = reinterpret_cast<inotify_event*> (buf.data() + pos);
+                pos += sizeof(inotify_event) + ev->len;
+                if (ev->mask & IN_Q_OVERFLOW) {
+                    int result = rescan ();
+                    if (result < 0)
+                        return -1;
+                    num_changes += result;
+                    continue;
+                }
+                if (!ev->len)
+                    continue;
+                std::string_view name (ev->name);
+                if (ev->mask & (IN_CREATE | IN_MOVED_TO))
+                    num_changes += add (name);
+                else if (ev->mask & (IN_DELETE | IN_MOVED_FROM))
+                    num_changes += remove (name);
+            }
+        }
+        return num_changes;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led_registry::run_once (int timeout)
+    {
+        epoll_event events[2];
+        int num = epoll_wait (epoll_fd, events, 2, timeout);
+        if (num < 0)
+            return errno==EINTR ? 0 : -1;
+
+        int num_changes = 0;
+        for (int i=0; i<num; ++i) {
+            if (events[i].data.fd == event_fd) {
+                uint64_t counter;
+                [[maybe_unused]] auto result = read (event_fd, &counter, sizeof(counter));
+                continue;
+            }
+            int result = uevents ? handle_uevents() : handle_inotify();
+            if (result < 0)
+                return -1;
+            num_changes += result;
+        }
+        return num_changes;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led_registry::run ()
+    {
+        while (!stopped) {
+            if (run_once(-1) < 0)
+                return -1;
+        }
+        stopped = false;
+        return 0;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led_registry::stop ()
+    {
+        stopped = true;
+        uint64_t one = 1;
+        [[maybe_unused]] auto result = write (event_fd, &one, sizeof(one));
+    }
+
+
+}
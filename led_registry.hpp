@@ -0,0 +1,279 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEDPP_LED_REGISTRY_HPP
+#define LEDPP_LED_REGISTRY_HPP
+
+#include <led++.hpp>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <atomic>
+
+
+namespace ledpp {
+
+
+    /**
+     * An index of the LEDs in the system that is kept up to date
+     * when LED devices are added and removed.
+     *
+     * The LED directory is read once when the registry is created.
+     * After that, the registry is updated from kernel uevents
+     * received on a netlink socket, or, if that isn't possible or
+     * the LEDs are in a directory other than
+     * <code>/sys/class/leds</code>, from inotify events for the
+     * LED directory. The registry never needs to read the whole
+     * directory again, except when the kernel reports that uevents
+     * were lost.
+     *
+     * LED names are parsed once into device name, color, and function
+     * according to the kernel naming convention
+     * <code>devicename:color:function</code>, and indexed by each of
+     * them. Queries only use the index, and do no I/O.
+     *
+     * Like led_watcher, the registry is driven by the application,
+     * either by calling run(), or by adding the file descriptor
+     * returned by fd() to an external event loop and calling
+     * run_once() when it is readable. Callbacks are called from the
+     * thread running the registry. Except for stop(), methods must
+     * not be called concurrently from different threads.
+     */
+    class led_registry {
+    public:
+        /**
+         * A LED known by the registry.
+         * The views refer to the name, and are valid for as long
+         * as the LED is in the registry.
+         */
+        struct entry {
+            std::string name;          /**< The name of the LED. */
+            std::string_view device;   /**< Device name, may be empty. */
+            std::string_view color;    /**< Color, may be empty. */
+            std::string_view function; /**< Function, may be empty. */
+            bool multicolor;           /**< The color is "multicolor" or "rgb". */
+        };
+
+        /**
+         * Selection of LEDs. Empty fields match any LED.
+         */
+        struct query {
+            std::string_view device;   /**< Match this device name. */
+            std::string_view color;    /**< Match this color. */
+            std::string_view function; /**< Match this function. */
+            int multicolor = -1;       /**< 1: only multicolor LEDs, 0: no multicolor LEDs, -1: any LED. */
+        };
+
+        /**
+         * What happened to a LED.
+         */
+        enum class event {
+            added,   /**< The LED was added to the system. */
+            removed, /**< The LED was removed from the system. */
+        };
+
+        /**
+         * Function called when a LED is added or removed.
+         * A removed entry is valid until the callback returns.
+         */
+        using callback = std::function<void(const entry&, event)>;
+
+        /**
+         * Create a registry of the LEDs in the directory
+         * returned by led::leds_dir().
+         * @param flags Flags used when creating led objects
+         *              returned by open(), see led::flags_t.
+         * @throw std::system_error If the registry can't be created.
+         * @throw std::filesystem::filesystem_error If the LED
+         *        directory can't be read.
+         */
+        led_registry (unsigned flags=0);
+
+        /**
+         * Create a registry of the LEDs in a specific directory.
+         * @param dir The directory where the LEDs are found.
+         * @param flags Flags used when creating led objects
+         *              returned by open(), see led::flags_t.
+         * @throw std::system_error If the registry can't be created.
+         * @throw std::filesystem::filesystem_error If the LED
+         *        directory can't be read.
+         */
+        led_registry (const std::filesystem::path& dir, unsigned flags=0);
+
+        /**
+         * Destructor.
+         */
+        ~led_registry ();
+
+        led_registry (const led_registry&) = delete;
+        led_registry& operator= (const led_registry&) = delete;
+
+        /**
+         * Check if changes are tracked using kernel uevents.
+         * @return <code>true</code> if uevents are used,
+         *         <code>false</code> if inotify is used.
+         */
+        bool uses_uevents () const {
+            return uevents;
+        }
+
+        /**
+         * Return the number of LEDs.
+         */
+        size_t size () const {
+            return by_name.size ();
+        }
+
+        /**
+         * Find a LED by name.
+         * @param name The name of the LED.
+         * @return The LED, or <code>nullptr</code> if there is no such LED.
+         */
+        const entry* find (std::string_view name) const;
+
+        /**
+         * Select LEDs.
+         * The most selective field of the query is looked up in
+         * the index, so the cost depends on the number of LEDs with
+         * that device name, color, or function, not on the number
+         * of LEDs in the system.
+         * @param q The selection.
+         * @return The selected LEDs, sorted by name.
+         */
+        std::vector<const entry*> select (const query& q) const;
+
+        /**
+         * Return the names of all LEDs, sorted.
+         */
+        std::vector<std::string> names () const;
+
+        /**
+         * Get a led object for a LED.
+         * The object is created on first use and shared by all callers.
+         * When the LED is removed, the files of the object are
+         * closed and its remembered state is discarded, so holders
+         * of the object get errors instead of stale values.
+         * @param name The name of the LED.
+         * @return The LED, or <code>nullptr</code> and
+         *         <code>errno</code> is set on error.
+         */
+        std::shared_ptr<led> open (std::string_view name);
+
+        /**
+         * Add a function called when LEDs are added or removed.
+         * @param cb The function.
+         * @return An id to use with unsubscribe().
+         */
+        int subscribe (callback cb);
+
+        /**
+         * Remove a function added by subscribe().
+         * This may be called from a callback.
+         * @param id The id returned by subscribe().
+         */
+        void unsubscribe (int id);
+
+        /**
+         * Read the LED directory again, and add and remove LEDs
+         * to match it. This is done automatically if uevents
+         * are lost, and is normally never needed.
+         * @return The number of added and removed LEDs,
+         *         or -1 on error and <code>errno</code> is set.
+         */
+        int rescan ();
+
+        /**
+         * Return a file descriptor that becomes readable
+         * when run_once() has work to do.
+         */
+        int fd () const {
+            return epoll_fd;
+        }
+
+        /**
+         * Wait for LEDs to be added or removed, and update the registry.
+         * @param timeout The maximum time in milliseconds to wait,
+         *                or -1 to wait until something happens.
+         * @return The number of added and removed LEDs,
+         *         or -1 on error and <code>errno</code> is set.
+         */
+        int run_once (int timeout=-1);
+
+        /**
+         * Update the registry until stop() is called.
+         * @return 0 when stopped, or -1 on error and
+         *         <code>errno</code> is set.
+         */
+        int run ();
+
+        /**
+         * Make run() return.
+         * This may be called from any thread, or from a callback.
+         */
+        void stop ();
+
+
+    private:
+        struct item : entry {
+            std::shared_ptr<led> handle;
+        };
+
+        struct name_hash {
+            using is_transparent = void;
+            size_t operator() (std::string_view s) const {
+                return std::hash<std::string_view>{} (s);
+            }
+        };
+        using posting_map = std::unordered_map<std::string,
+                                               std::vector<item*>,
+                                               name_hash,
+                                               std::equal_to<>>;
+
+        std::filesystem::path dir;
+        unsigned led_flags;
+        bool uevents;
+        int epoll_fd;
+        int source_fd;
+        int event_fd;
+        std::atomic<bool> stopped;
+        std::unordered_map<std::string, std::unique_ptr<item>, name_hash, std::equal_to<>> by_name;
+        posting_map by_device;
+        posting_map by_color;
+        posting_map by_function;
+        std::vector<item*> multicolor_leds;
+        std::vector<std::pair<int, callback>> subscribers;
+        int next_subscriber;
+        std::vector<char> buf;
+
+        void open_source ();
+        int add (std::string_view name);
+        int remove (std::string_view name);
+        void notify (const entry& e, event ev);
+        int handle_uevents ();
+        int handle_inotify ();
+        static void parse_name (entry& e);
+        static void unlink (std::vector<item*>& list, item* i);
+    };
+
+
+}
+#endif
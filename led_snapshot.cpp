@@ -0,0 +1,407 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <led++.hpp>
+#include <led_frame.hpp>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <algorithm>
+#include <unordered_map>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace ledpp {
+
+
+    // Don't start a thread for fewer LEDs than this
+    static constexpr size_t leds_per_thread = 8;
+
+    // Upper limit of threads used for a snapshot
+    static constexpr unsigned max_snapshot_threads = 8;
+
+
+    //
+    // Snapshot file format. All numbers are in host byte order,
+    // and strings are offsets in a table of null terminated strings.
+    //
+    namespace {
+        constexpr char snapshot_magic[8] = "LEDPPSN";
+        constexpr uint16_t snapshot_byte_order = 0x0102;
+        constexpr uint16_t snapshot_version = 1;
+        constexpr uint32_t no_string = UINT32_MAX;
+
+        struct file_header {
+            char magic[8];
+            uint16_t byte_order;
+            uint16_t version;
+            uint32_t num_leds;
+            uint32_t num_colors;
+            uint32_t strings_size;
+        };
+
+        struct file_led {
+            uint32_t name;
+            uint32_t trigger;
+            int32_t brightness;
+            int32_t max_brightness;
+            uint32_t first_color;
+            uint32_t num_colors;
+        };
+
+        struct file_color {
+            uint32_t name;
+            int32_t intensity;
+        };
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    led_snapshot led::snapshot_all (unsigned num_threads)
+    {
+        return snapshot_all (leds_dir(), num_threads);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    led_snapshot led::snapshot_all (const std::filesystem::path& dir, unsigned num_threads)
+    {
+        auto names = led_names (dir);
+        return snapshot (std::vector<std::string>(names.begin(), names.end()), dir, num_threads);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    led_snapshot led::snapshot (std::vector<std::string> names,
+                                const std::filesystem::path& dir,
+                                unsigned num_threads)
+    {
+        led_snapshot snapshot;
+        size_t num_leds = names.size ();
+
+        snapshot.names = std::move (names);
+        snapshot.brightness.resize (num_leds, -1);
+        snapshot.max_brightness.resize (num_leds, -1);
+        snapshot.trigger.resize (num_leds, -1);
+
+        // Colors are collected per LED, and flattened when all LEDs are read
+        std::vector<std::vector<std::string>> colors (num_leds);
+        std::vector<std::vector<unsigned>> intensity (num_leds);
+
+        std::atomic<size_t> next (0);
+        auto worker = [&]() {
+            size_t i;
+            while ((i = next.fetch_add(1, std::memory_order_relaxed)) < num_leds) {
+                auto l = led::open (snapshot.names[i], dir, keep_open);
+                if (!l)
+                    continue; // The LED has disappeared, or can't be accessed
+                snapshot.brightness[i] = l->brightness ();
+                snapshot.max_brightness[i] = l->max_brightness ();
+                // Only the active trigger is needed, skip parsing the whole list
+                auto trigger = l->read_trigger ();
+                if (!trigger.empty())
+                    snapshot.trigger[i] = trigger_registry::intern (trigger);
+                if (l->is_multicolor()) {
+                    colors[i] = l->color_names ();
+                    intensity[i] = l->color_intensity ();
+                }
+            }
+        };
+
+        if (num_threads == 0) {
+            num_threads = std::max (1u, std::thread::hardware_concurrency());
+            num_threads = std::min (num_threads, max_snapshot_threads);
+            num_threads = std::min<size_t> (num_threads, num_leds/leds_per_thread + 1);
+        }
+        std::vector<std::thread> threads;
+        for (unsigned t=1; t<num_threads; ++t)
+            threads.emplace_back (worker);
+        worker ();
+        for (auto& thread : threads)
+            thread.join ();
+
+        snapshot.color_offset.reserve (num_leds + 1);
+        snapshot.color_offset.emplace_back (0);
+        for (size_t i=0; i<num_leds; ++i) {
+            for (size_t c=0; c<colors[i].size(); ++c) {
+                snapshot.color_names.emplace_back (std::move(colors[i][c]));
+                snapshot.color_intensity.emplace_back (c < intensity[i].size() ? (int)intensity[i][c] : -1);
+            }
+            snapshot.color_offset.emplace_back (snapshot.color_names.size());
+        }
+
+        return snapshot;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led_snapshot::save (const std::filesystem::path& file) const
+    {
+        // Color and trigger names are stored once
+        std::string strings;
+        std::unordered_map<std::string_view, uint32_t> string_pos;
+        auto add_string = [&](std::string_view str) -> uint32_t {
+            auto i = string_pos.find (str);
+            if (i != string_pos.end())
+                return i->second;
+            uint32_t pos = strings.size ();
+            strings.append (str);
+            strings.push_back ('\0');
+            string_pos.emplace (str, pos);
+            return pos;
+        };
+        file_header hdr {};
+        memcpy (hdr.magic, snapshot_magic, sizeof(snapshot_magic));
+        hdr.byte_order = snapshot_byte_order;
+        hdr.version = snapshot_version;
+        hdr.num_leds = size ();
+        hdr.num_colors = color_names.size ();
+
+        std::vector<file_led> leds (size());
+        for (size_t i=0; i<size(); ++i) {
+            auto& l = leds[i];
+            l.name = add_string (names[i]);
+            l.trigger = trigger[i] < 0 ? no_string : add_string(trigger_registry::name(trigger[i]));
+            l.brightness = brightness[i];
+            l.max_brightness = max_brightness[i];
+            l.first_color = color_offset[i];
+            l.num_colors = num_colors (i);
+        }
+        std::vector<file_color> colors (color_names.size());
+        for (size_t c=0; c<colors.size(); ++c) {
+            colors[c].name = add_string (color_names[c]);
+            colors[c].intensity = color_intensity[c];
+        }
+        hdr.strings_size = strings.size ();
+
+        std::string buf;
+        buf.append (reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+        buf.append (reinterpret_cast<const char*>(leds.data()), leds.size() * sizeof(file_led));
+        buf.append (reinterpret_cast<const char*>(colors.data()), colors.size() * sizeof(file_color));
+        buf.append (strings);
+
+        // Write a temporary file and rename it, so a reader
+        // never sees a partially written snapshot
+        auto tmp = file;
+        tmp += ".tmp";
+        int fd = open (tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            int errnum = errno;
+            throw std::system_error (errnum, std::generic_category(), tmp.string());
+        }
+        size_t pos = 0;
+        while (pos < buf.size()) {
+            ssize_t len = write (fd, buf.data()+pos, buf.size()-pos);
+            if (len < 0  &&  errno == EINTR)
+                continue;
+            if (len < 0)
+                break;
+            pos += len;
+        }
+        int errnum = pos < buf.size() ? errno : 0;
+        if (!errnum  &&  fsync(fd))
+            errnum = errno;
+        if (close(fd)  &&  !errnum)
+            errnum = errno;
+        if (!errnum  &&  rename(tmp.c_str(), file.c_str()))
+            errnum = errno;
+        if (errnum) {
+            unlink (tmp.c_str());
+            throw std::system_error (errnum, std::generic_category(), file.string());
+        }
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    led_snapshot led_snapshot::load (const std::filesystem::path& file)
+    {
+        int fd = open (file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            int errnum = errno;
+            throw std::system_error (errnum, std::generic_category(), file.string());
+        }
+        std::string buf;
+        char tmp[4096];
+        while (true) {
+            ssize_t len = read (fd, tmp, sizeof(tmp));
+            if (len < 0  &&  errno == EINTR)
+                continue;
+            if (len < 0) {
+                int errnum = errno;
+                close (fd);
+                throw std::system_error (errnum, std::generic_category(), file.string());
+            }
+            if (len == 0)
+                break;
+            buf.append (tmp, len);
+        }
+        close (fd);
+
+        auto invalid = [&file]() {
+            return std::system_error (EINVAL, std::generic_category(),
+                                      "Invalid snapshot file " + file.string());
+        };
+        if (buf.size() < sizeof(file_header))
+            throw invalid ();
+        file_header hdr;
+        memcpy (&hdr, buf.data(), sizeof(hdr));
+        if (memcmp(hdr.magic, snapshot_magic, sizeof(snapshot_magic))  ||
+            hdr.byte_order != snapshot_byte_order  ||
+            hdr.version != snapshot_version)
+        {
+            throw invalid ();
+        }
+        uint64_t leds_pos = sizeof (file_header);
+        uint64_t colors_pos = leds_pos + (uint64_t)hdr.num_leds * sizeof(file_led);
+        uint64_t strings_pos = colors_pos + (uint64_t)hdr.num_colors * sizeof(file_color);
+        if (strings_pos + hdr.strings_size != buf.size())
+            throw invalid ();
+        std::string_view strings (buf.data() + strings_pos, hdr.strings_size);
+        auto get_string = [&](uint32_t pos) {
+            if (pos >= strings.size()  ||  strings.find('\0', pos) == std::string_view::npos)
+                throw invalid ();
+            return std::string_view (strings.data() + pos);
+        };
+
+        led_snapshot snapshot;
+        snapshot.color_offset.emplace_back (0);
+        for (uint32_t i=0; i<hdr.num_leds; ++i) {
+            file_led l;
+            memcpy (&l, buf.data() + leds_pos + i*sizeof(file_led), sizeof(l));
+            if (l.first_color != snapshot.color_names.size()  ||
+                (uint64_t)l.first_color + l.num_colors > hdr.num_colors)
+            {
+                throw invalid ();
+            }
+            snapshot.names.emplace_back (get_string(l.name));
+            snapshot.brightness.emplace_back (l.brightness);
+            snapshot.max_brightness.emplace_back (l.max_brightness);
+            if (l.trigger == no_string)
+                snapshot.trigger.emplace_back (-1);
+            else
+                snapshot.trigger.emplace_back (trigger_registry::intern(get_string(l.trigger)));
+            for (uint32_t c=l.first_color; c<l.first_color+l.num_colors; ++c) {
+                file_color color;
+                memcpy (&color, buf.data() + colors_pos + c*sizeof(file_color), sizeof(color));
+                snapshot.color_names.emplace_back (get_string(color.name));
+                snapshot.color_intensity.emplace_back (color.intensity);
+            }
+            snapshot.color_offset.emplace_back (snapshot.color_names.size());
+        }
+        if (snapshot.color_names.size() != hdr.num_colors)
+            throw invalid ();
+        return snapshot;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led::restore (const led_snapshot& state, size_t* num_writes)
+    {
+        return restore (state, leds_dir(), num_writes);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led::restore (const led_snapshot& state,
+                      const std::filesystem::path& dir,
+                      size_t* num_writes)
+    {
+        if (num_writes)
+            *num_writes = 0;
+
+        auto current = snapshot (state.names, dir);
+        int none = trigger_registry::intern ("none");
+
+        std::vector<std::unique_ptr<led>> leds;
+        led_frame frame;
+        size_t writes = 0;
+        for (size_t i=0; i<state.size(); ++i) {
+            // Skip LEDs that are gone, or couldn't be read now or when saved
+            if (current.max_brightness[i] < 0)
+                continue;
+
+            bool set_trigger = state.trigger[i] >= 0  &&  state.trigger[i] != current.trigger[i];
+            int target_trigger = state.trigger[i] >= 0 ? state.trigger[i] : current.trigger[i];
+
+            bool set_intensity = false;
+            std::vector<unsigned> intensity;
+            if (state.num_colors(i)  &&  state.num_colors(i) == current.num_colors(i)) {
+                for (unsigned c=0; c<state.num_colors(i); ++c) {
+                    int value = state.color_intensity[state.color_offset[i] + c];
+                    if (value < 0) {
+                        intensity.clear ();
+                        break;
+                    }
+                    intensity.emplace_back (value);
+                    set_intensity |= value != current.color_intensity[current.color_offset[i] + c];
+                }
+                set_intensity &= !intensity.empty ();
+            }
+
+            // Triggers control the brightness, except trigger none.
+            // Setting a trigger turns the LED off, so the brightness
+            // is written again after a trigger change.
+            bool set_brightness = false;
+            unsigned value = 0;
+            if (state.brightness[i] >= 0  &&  target_trigger == none) {
+                value = std::min (state.brightness[i], current.max_brightness[i]);
+                set_brightness = set_trigger  ||  (int)value != current.brightness[i];
+            }
+
+            if (!set_trigger  &&  !set_intensity  &&  !set_brightness)
+                continue;
+
+            auto opened = led::open (state.names[i], dir, keep_open);
+            if (!opened)
+                continue; // The LED has disappeared
+            auto l = std::make_unique<led> (std::move(*opened));
+            size_t index = frame.add (*l);
+            leds.emplace_back (std::move(l));
+            if (set_trigger) {
+                frame.trigger (index, (trigger_id)state.trigger[i]);
+                ++writes;
+            }
+            if (set_intensity) {
+                frame.color_intensity (index, intensity);
+                ++writes;
+            }
+            if (set_brightness) {
+                frame.brightness (index, value);
+                ++writes;
+            }
+        }
+
+        if (num_writes)
+            *num_writes = writes;
+        if (frame.size() == 0)
+            return 0;
+        return frame.commit ();
+    }
+
+
+}
@@ -0,0 +1,260 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <led_stats.hpp>
+#include <io_recorder.hpp>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <bit>
+
+
+namespace ledpp {
+
+
+    namespace detail {
+
+#ifndef LEDPP_NO_STATS
+        std::atomic<bool> io_stats_on {false};
+#endif
+
+        static std::mutex registry_mutex;
+        static std::map<std::string, std::unique_ptr<io_entry>, std::less<>> registry;
+
+
+        //----------------------------------------------------------------------
+        //----------------------------------------------------------------------
+        io_entry* io_lookup (const std::string& name) noexcept
+        {
+            std::lock_guard<std::mutex> lock (registry_mutex);
+            try {
+                auto& e = registry[name];
+                if (!e) {
+                    e = std::make_unique<io_entry> ();
+                    e->name = name;
+                }
+                return e.get ();
+            }
+            catch (...) {
+                return nullptr;
+            }
+        }
+
+
+        //----------------------------------------------------------------------
+        //----------------------------------------------------------------------
+        void io_record (io_entry::slot& s, uint64_t start, ssize_t result) noexcept
+        {
+            timespec ts;
+            clock_gettime (CLOCK_MONOTONIC, &ts);
+            uint64_t now = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec + 1;
+            uint64_t ns = now > start ? now - start : 0;
+
+            s.ops.fetch_add (1, std::memory_order_relaxed);
+            if (result < 0)
+                s.errors.fetch_add (1, std::memory_order_relaxed);
+            else
+                s.bytes.fetch_add (result, std::memory_order_relaxed);
+            s.total_ns.fetch_add (ns, std::memory_order_relaxed);
+
+            uint64_t max = s.max_ns.load (std::memory_order_relaxed);
+            while (ns > max  &&  !s.max_ns.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+                ;
+
+            unsigned bucket = std::bit_width (ns);
+            if (bucket >= io_counters::num_buckets)
+                bucket = io_counters::num_buckets - 1;
+            s.histogram[bucket].fetch_add (1, std::memory_order_relaxed);
+        }
+
+
+        //----------------------------------------------------------------------
+        //----------------------------------------------------------------------
+        static void copy_slot (const io_entry::slot& s, io_counters& c)
+        {
+            c.ops = s.ops.load (std::memory_order_relaxed);
+            c.bytes = s.bytes.load (std::memory_order_relaxed);
+            c.errors = s.errors.load (std::memory_order_relaxed);
+            c.total_ns = s.total_ns.load (std::memory_order_relaxed);
+            c.max_ns = s.max_ns.load (std::memory_order_relaxed);
+            for (unsigned i=0; i<io_counters::num_buckets; ++i)
+                c.histogram[i] = s.histogram[i].load (std::memory_order_relaxed);
+        }
+
+
+        //----------------------------------------------------------------------
+        //----------------------------------------------------------------------
+        static void clear_slot (io_entry::slot& s)
+        {
+            s.ops.store (0, std::memory_order_relaxed);
+            s.bytes.store (0, std::memory_order_relaxed);
+            s.errors.store (0, std::memory_order_relaxed);
+            s.total_ns.store (0, std::memory_order_relaxed);
+            s.max_ns.store (0, std::memory_order_relaxed);
+            for (auto& bucket : s.histogram)
+                bucket.store (0, std::memory_order_relaxed);
+        }
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    uint64_t io_counters::percentile_ns (unsigned p) const
+    {
+        if (ops == 0)
+            return 0;
+        if (p > 100)
+            p = 100;
+        // The rank of the operation, rounded up
+        uint64_t rank = (ops * p + 99) / 100;
+        if (rank == 0)
+            rank = 1;
+        uint64_t count = 0;
+        for (unsigned i=0; i<num_buckets; ++i) {
+            count += histogram[i];
+            if (count >= rank) {
+                uint64_t limit = i ? (uint64_t(1) << i) - 1 : 0;
+                return limit < max_ns ? limit : max_ns;
+            }
+        }
+        return max_ns;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    io_counters& io_counters::operator+= (const io_counters& rhs)
+    {
+        ops += rhs.ops;
+        bytes += rhs.bytes;
+        errors += rhs.errors;
+        total_ns += rhs.total_ns;
+        if (rhs.max_ns > max_ns)
+            max_ns = rhs.max_ns;
+        for (unsigned i=0; i<num_buckets; ++i)
+            histogram[i] += rhs.histogram[i];
+        return *this;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    const char* led_io_stats::attribute_name (attribute attr)
+    {
+        switch (attr) {
+        case brightness:
+            return "brightness";
+        case max_brightness:
+            return "max_brightness";
+        case multi_intensity:
+            return "multi_intensity";
+        case trigger:
+            return "trigger";
+        case multi_index:
+            return "multi_index";
+        default:
+            return "trigger_attr";
+        }
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    io_counters led_io_stats::total () const
+    {
+        io_counters sum = open;
+        for (unsigned i=0; i<num_attributes; ++i) {
+            sum += read[i];
+            sum += write[i];
+        }
+        return sum;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    bool io_stats::available ()
+    {
+#ifdef LEDPP_NO_STATS
+        return false;
+#else
+        return true;
+#endif
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void io_stats::enable (bool on)
+    {
+#ifndef LEDPP_NO_STATS
+        detail::io_stats_on.store (on, std::memory_order_relaxed);
+#else
+        (void) on;
+#endif
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    bool io_stats::enabled ()
+    {
+#ifndef LEDPP_NO_STATS
+        return detail::io_stats_on.load (std::memory_order_relaxed);
+#else
+        return false;
+#endif
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    std::vector<led_io_stats> io_stats::get ()
+    {
+        std::lock_guard<std::mutex> lock (detail::registry_mutex);
+        std::vector<led_io_stats> result (detail::registry.size());
+        size_t i = 0;
+        for (auto& [name, e] : detail::registry) {
+            led_io_stats& s = result[i++];
+            s.name = name;
+            detail::copy_slot (e->open, s.open);
+            for (unsigned a=0; a<led_io_stats::num_attributes; ++a) {
+                detail::copy_slot (e->read[a], s.read[a]);
+                detail::copy_slot (e->write[a], s.write[a]);
+            }
+        }
+        return result;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void io_stats::reset ()
+    {
+        std::lock_guard<std::mutex> lock (detail::registry_mutex);
+        for (auto& [name, e] : detail::registry) {
+            detail::clear_slot (e->open);
+            for (unsigned a=0; a<led_io_stats::num_attributes; ++a) {
+                detail::clear_slot (e->read[a]);
+                detail::clear_slot (e->write[a]);
+            }
+        }
+    }
+
+
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEDPP_LED_STATS_HPP
+#define LEDPP_LED_STATS_HPP
+
+#include <string>
+#include <vector>
+#include <array>
+#include <cstdint>
+
+
+namespace ledpp {
+
+
+    /**
+     * I/O counters and latency histogram of one kind of operation.
+     */
+    struct io_counters {
+        /**
+         * Number of latency histogram buckets.
+         */
+        static constexpr unsigned num_buckets = 32;
+
+        uint64_t ops;      /**< Number of operations. */
+        uint64_t bytes;    /**< Number of bytes read or written. */
+        uint64_t errors;   /**< Number of failed operations. */
+        uint64_t total_ns; /**< Sum of the latency of all operations. */
+        uint64_t max_ns;   /**< The longest latency. */
+
+        /**
+         * Log scale latency histogram. Bucket 0 counts operations
+         * taking 0 ns, and bucket <code>i</code> operations taking
+         * 2<sup>i-1</sup> to 2<sup>i</sup>-1 ns. The last bucket
+         * also counts all slower operations.
+         */
+        std::array<uint64_t, num_buckets> histogram;
+
+        /**
+         * Return the mean latency in nanoseconds.
+         */
+        uint64_t mean_ns () const {
+            return ops ? total_ns / ops : 0;
+        }
+
+        /**
+         * Return an upper bound of a latency percentile in nanoseconds.
+         * The value is rounded up to the end of a histogram bucket,
+         * but is never larger than max_ns.
+         * @param p The percentile, 0 - 100.
+         */
+        uint64_t percentile_ns (unsigned p) const;
+
+        /**
+         * Add the counters of another object to this one.
+         */
+        io_counters& operator+= (const io_counters& rhs);
+    };
+
+
+    /**
+     * I/O statistics of one LED.
+     */
+    struct led_io_stats {
+        /**
+         * The attributes of a LED with separate counters.
+         */
+        enum attribute : unsigned {
+            brightness = 0,  /**< brightness */
+            max_brightness,  /**< max_brightness */
+            multi_intensity, /**< multi_intensity */
+            trigger,         /**< trigger */
+            multi_index,     /**< multi_index, read once for the color names. */
+            trigger_attr,    /**< Attributes of the current trigger, like delay_on. */
+            num_attributes
+        };
+
+        /**
+         * Return the name of an attribute.
+         */
+        static const char* attribute_name (attribute attr);
+
+        std::string name;                   /**< The name of the LED. */
+        io_counters open;                   /**< Opening the LED directory and attribute files. */
+        io_counters read[num_attributes];   /**< Reads of each attribute. */
+        io_counters write[num_attributes];  /**< Writes of each attribute. */
+
+        /**
+         * Return the sum of all counters of the LED.
+         */
+        io_counters total () const;
+    };
+
+
+    /**
+     * Process wide I/O statistics of all led objects.
+     *
+     * When enabled, every system call that led objects make to open,
+     * read, or write LED attribute files is counted per LED name and
+     * attribute, and its latency is added to a histogram. Writes
+     * committed by led_batch using io_uring are counted with the
+     * time from submission to completion.
+     *
+     * Collection is disabled by default and then costs one predictable
+     * branch per operation. If the library is built with option
+     * <code>ENABLE_STATS=OFF</code> the instrumentation is left out
+     * completely, and enable() has no effect.
+     *
+     * All methods are thread-safe.
+     */
+    class io_stats {
+    public:
+        /**
+         * Check if the library is built with support for I/O statistics.
+         */
+        static bool available ();
+
+        /**
+         * Start or stop collecting I/O statistics.
+         * @param on <code>true</code> to start collecting.
+         */
+        static void enable (bool on=true);
+
+        /**
+         * Check if I/O statistics are being collected.
+         */
+        static bool enabled ();
+
+        /**
+         * Return a copy of the statistics of all LEDs
+         * that have been accessed, sorted by LED name.
+         */
+        static std::vector<led_io_stats> get ();
+
+        /**
+         * Set all counters to zero.
+         */
+        static void reset ();
+    };
+
+
+}
+#endif
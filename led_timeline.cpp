@@ -0,0 +1,539 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <led_timeline.hpp>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+
+
+namespace ledpp {
+
+
+    static constexpr char timeline_magic[8] = "LEDPPTL";
+    static constexpr uint16_t timeline_byte_order = 0x0102;
+    static constexpr uint16_t timeline_version = 1;
+
+    static_assert (sizeof(led_timeline::header) == 32);
+    static_assert (sizeof(led_timeline::track) == 16);
+    static_assert (sizeof(led_timeline::keyframe) == 8);
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    static double ease (led_timeline::interpolation mode, double x)
+    {
+        switch (mode) {
+        case led_timeline::interpolation::ease_in:
+            return x * x;
+        case led_timeline::interpolation::ease_out:
+            return 1.0 - (1.0-x) * (1.0-x);
+        case led_timeline::interpolation::ease_in_out:
+            return x * x * (3.0 - 2.0*x);
+        default:
+            return x;
+        }
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    static unsigned keyframe_value (const led_timeline::keyframe& k, unsigned max_brightness)
+    {
+        if (k.flags & led_timeline::relative)
+            return (unsigned) (((uint64_t)k.value * max_brightness + 32767) / 65535);
+        return std::min<unsigned> (k.value, max_brightness);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    static void throw_invalid ()
+    {
+        throw std::system_error (EINVAL, std::generic_category(), "Invalid timeline file");
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    led_timeline::led_timeline (const std::filesystem::path& file)
+        : map (MAP_FAILED),
+          map_size (0),
+          hdr (nullptr)
+    {
+        int fd = open (file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            int errnum = errno;
+            throw std::system_error (errnum, std::generic_category(), file.string());
+        }
+        struct stat st;
+        if (fstat(fd, &st)) {
+            int errnum = errno;
+            close (fd);
+            throw std::system_error (errnum, std::generic_category(), file.string());
+        }
+        if ((size_t)st.st_size < sizeof(header)) {
+            close (fd);
+            throw_invalid ();
+        }
+        // The whole file is used by the player, so fault it in now
+        map_size = st.st_size;
+        map = mmap (nullptr, map_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        int errnum = errno;
+        close (fd);
+        if (map == MAP_FAILED)
+            throw std::system_error (errnum, std::generic_category(), file.string());
+
+        try {
+            auto base = static_cast<const char*> (map);
+            hdr = reinterpret_cast<const header*> (base);
+            if (memcmp(hdr->magic, timeline_magic, sizeof(timeline_magic))  ||
+                hdr->byte_order != timeline_byte_order  ||
+                hdr->version != timeline_version  ||
+                hdr->frame_interval_us == 0)
+            {
+                throw_invalid ();
+            }
+
+            uint64_t tracks_pos = sizeof (header);
+            uint64_t frames_pos = tracks_pos + (uint64_t)hdr->num_tracks * sizeof(track);
+            uint64_t names_pos = frames_pos + (uint64_t)hdr->num_keyframes * sizeof(keyframe);
+            if (names_pos + hdr->names_size > map_size)
+                throw_invalid ();
+            tracks = std::span (reinterpret_cast<const track*>(base + tracks_pos), hdr->num_tracks);
+            frames = std::span (reinterpret_cast<const keyframe*>(base + frames_pos), hdr->num_keyframes);
+            names = std::string_view (base + names_pos, hdr->names_size);
+
+            // Check everything the player relies on
+            for (auto& t : tracks) {
+                if (t.num_keyframes == 0  ||
+                    (uint64_t)t.first_keyframe + t.num_keyframes > frames.size()  ||
+                    t.name_offset >= names.size()  ||
+                    names.find('\0', t.name_offset) == std::string_view::npos)
+                {
+                    throw_invalid ();
+                }
+                auto k = frames.subspan (t.first_keyframe, t.num_keyframes);
+                for (size_t i=0; i<k.size(); ++i) {
+                    if (k[i].mode > (uint8_t)interpolation::ease_in_out  ||
+                        (i  &&  k[i].time_ms < k[i-1].time_ms))
+                    {
+                        throw_invalid ();
+                    }
+                }
+                if (k.back().time_ms > hdr->duration_ms)
+                    throw_invalid ();
+            }
+        }
+        catch (...) {
+            munmap (map, map_size);
+            throw;
+        }
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    led_timeline::~led_timeline ()
+    {
+        munmap (map, map_size);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    std::string_view led_timeline::led_name (size_t index) const
+    {
+        return std::string_view (names.data() + tracks[index].name_offset);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    std::span<const led_timeline::keyframe> led_timeline::keyframes (size_t index) const
+    {
+        return frames.subspan (tracks[index].first_keyframe, tracks[index].num_keyframes);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    unsigned led_timeline::value_at (std::span<const keyframe> keyframes,
+                                     std::chrono::microseconds time,
+                                     unsigned max_brightness,
+                                     size_t& cursor)
+    {
+        if (keyframes.empty())
+            return 0;
+        int64_t t = time.count ();
+        if (cursor >= keyframes.size()  ||  (int64_t)keyframes[cursor].time_ms * 1000 > t)
+            cursor = 0;
+        while (cursor+1 < keyframes.size()  &&  (int64_t)keyframes[cursor+1].time_ms * 1000 <= t)
+            ++cursor;
+
+        auto& k = keyframes[cursor];
+        unsigned from = keyframe_value (k, max_brightness);
+        int64_t k_start = (int64_t)k.time_ms * 1000;
+        if (cursor+1 == keyframes.size()  ||  t <= k_start  ||  k.mode == (uint8_t)interpolation::step)
+            return from;
+
+        auto& next = keyframes[cursor+1];
+        unsigned to = keyframe_value (next, max_brightness);
+        double x = double(t - k_start) / (double(next.time_ms - k.time_ms) * 1000.0);
+        return (unsigned) std::lround (from + ((double)to - from) * ease((interpolation)k.mode, x));
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led_timeline::convert (std::istream& in, std::ostream& out)
+    {
+        struct text_track {
+            std::string name;
+            std::vector<keyframe> keyframes;
+        };
+        std::vector<text_track> text_tracks;
+        uint32_t interval_us = 10000;
+        uint32_t duration_ms = 0;
+
+        std::string line;
+        unsigned line_num = 0;
+        auto error = [&line_num](const std::string& msg) {
+            throw std::invalid_argument ("Line " + std::to_string(line_num) + ": " + msg);
+        };
+        auto number = [&error](const std::string& str, unsigned long max) -> unsigned long {
+            size_t pos = 0;
+            unsigned long value = 0;
+            try {
+                value = std::stoul (str, &pos);
+            }
+            catch (...) {
+                pos = 0;
+            }
+            if (pos == 0  ||  pos != str.size()  ||  value > max  ||  str[0] == '-')
+                error ("Invalid number: " + str);
+            return value;
+        };
+
+        while (std::getline(in, line)) {
+            ++line_num;
+            auto comment = line.find ('#');
+            if (comment != std::string::npos)
+                line.erase (comment);
+            std::istringstream ss (line);
+            std::vector<std::string> args;
+            std::string arg;
+            while (ss >> arg)
+                args.emplace_back (arg);
+            if (args.empty())
+                continue;
+
+            if (args[0] == "interval") {
+                if (args.size() != 2)
+                    error ("Expected: interval MS");
+                interval_us = number (args[1], 60000) * 1000;
+                if (interval_us == 0)
+                    error ("The interval can't be 0");
+            }
+            else if (args[0] == "led") {
+                if (args.size() != 2)
+                    error ("Expected: led NAME");
+                text_tracks.emplace_back (text_track{args[1], {}});
+            }
+            else {
+                if (text_tracks.empty())
+                    error ("Keyframe before the first led statement");
+                if (args.size() < 2  ||  args.size() > 3)
+                    error ("Expected: TIME VALUE [MODE]");
+
+                keyframe k {};
+                k.time_ms = number (args[0], UINT32_MAX);
+                if (args[1].ends_with('%')) {
+                    double percent = -1;
+                    try {
+                        size_t pos;
+                        percent = std::stod (args[1], &pos);
+                        if (pos != args[1].size()-1)
+                            percent = -1;
+                    }
+                    catch (...) {
+                    }
+                    if (!(percent >= 0.0  &&  percent <= 100.0))
+                        error ("Invalid percentage: " + args[1]);
+                    k.value = (uint16_t) std::lround (percent * 65535.0 / 100.0);
+                    k.flags = relative;
+                }else{
+                    k.value = number (args[1], UINT16_MAX);
+                }
+                std::string mode = args.size() > 2 ? args[2] : "linear";
+                if (mode == "step")
+                    k.mode = (uint8_t) interpolation::step;
+                else if (mode == "linear")
+                    k.mode = (uint8_t) interpolation::linear;
+                else if (mode == "in")
+                    k.mode = (uint8_t) interpolation::ease_in;
+                else if (mode == "out")
+                    k.mode = (uint8_t) interpolation::ease_out;
+                else if (mode == "in-out")
+                    k.mode = (uint8_t) interpolation::ease_in_out;
+                else
+                    error ("Invalid interpolation mode: " + mode);
+
+                auto& keyframes = text_tracks.back().keyframes;
+                if (!keyframes.empty()  &&  k.time_ms < keyframes.back().time_ms)
+                    error ("Keyframes must be in time order");
+                keyframes.emplace_back (k);
+                duration_ms = std::max (duration_ms, k.time_ms);
+            }
+        }
+        line_num = 0;
+        if (text_tracks.empty())
+            throw std::invalid_argument ("No LEDs in the timeline");
+
+        header hdr {};
+        memcpy (hdr.magic, timeline_magic, sizeof(timeline_magic));
+        hdr.byte_order = timeline_byte_order;
+        hdr.version = timeline_version;
+        hdr.num_tracks = text_tracks.size ();
+        hdr.frame_interval_us = interval_us;
+        hdr.duration_ms = duration_ms;
+
+        std::vector<track> tracks;
+        std::vector<keyframe> keyframes;
+        std::string name_table;
+        for (auto& t : text_tracks) {
+            if (t.keyframes.empty())
+                throw std::invalid_argument ("No keyframes for LED " + t.name);
+            track tr {};
+            tr.name_offset = name_table.size ();
+            tr.first_keyframe = keyframes.size ();
+            tr.num_keyframes = t.keyframes.size ();
+            tracks.emplace_back (tr);
+            keyframes.insert (keyframes.end(), t.keyframes.begin(), t.keyframes.end());
+            name_table.append (t.name);
+            name_table.push_back ('\0');
+        }
+        hdr.num_keyframes = keyframes.size ();
+        hdr.names_size = name_table.size ();
+
+        out.write (reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+        out.write (reinterpret_cast<const char*>(tracks.data()), tracks.size() * sizeof(track));
+        out.write (reinterpret_cast<const char*>(keyframes.data()), keyframes.size() * sizeof(keyframe));
+        out.write (name_table.data(), name_table.size());
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    std::chrono::nanoseconds timeline_player::stats::percentile (unsigned p) const
+    {
+        if (frames == 0)
+            return std::chrono::nanoseconds::zero ();
+        if (p > 100)
+            p = 100;
+        // The rank of the frame, rounded up
+        uint64_t rank = ((uint64_t)frames * p + 99) / 100;
+        if (rank == 0)
+            rank = 1;
+        uint64_t count = 0;
+        for (unsigned i=0; i<32; ++i) {
+            count += histogram[i];
+            if (count >= rank) {
+                std::chrono::nanoseconds limit (i ? (int64_t(1) << i) - 1 : 0);
+                return limit < max ? limit : max;
+            }
+        }
+        return max;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    timeline_player::timeline_player (const led_timeline& tl, const std::filesystem::path& dir)
+        : timeline (tl),
+          stopped (false),
+          lateness_stats {}
+    {
+        for (size_t i=0; i<timeline.size(); ++i) {
+            auto l = std::make_unique<led> (std::string(timeline.led_name(i)), dir, led::keep_open);
+            int max = l->max_brightness ();
+            if (max < 0) {
+                int errnum = errno;
+                throw std::system_error (errnum, std::generic_category(), l->name());
+            }
+            max_brightness.emplace_back (max);
+            frame.add (*l);
+            leds.emplace_back (std::move(l));
+        }
+        cursors.resize (leds.size(), 0);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void timeline_player::render (std::chrono::microseconds time)
+    {
+        for (size_t i=0; i<leds.size(); ++i) {
+            frame.brightness (i, led_timeline::value_at(timeline.keyframes(i), time,
+                                                        max_brightness[i], cursors[i]));
+        }
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    static int64_t to_ns (const timespec& ts)
+    {
+        return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int timeline_player::play (const options& opt)
+    {
+        int64_t interval_ns = std::chrono::nanoseconds(opt.frame_interval).count ();
+        if (interval_ns <= 0)
+            interval_ns = std::chrono::nanoseconds(timeline.frame_interval()).count ();
+        if (interval_ns <= 0) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        // Pin the thread and raise its priority, and restore both when done
+        pthread_t self = pthread_self ();
+        cpu_set_t old_cpus;
+        bool restore_cpus = false;
+        if (opt.cpu >= 0) {
+            if (opt.cpu >= CPU_SETSIZE) {
+                errno = EINVAL;
+                return -1;
+            }
+            cpu_set_t cpus;
+            CPU_ZERO (&cpus);
+            CPU_SET (opt.cpu, &cpus);
+            int err = pthread_getaffinity_np (self, sizeof(old_cpus), &old_cpus);
+            if (!err)
+                err = pthread_setaffinity_np (self, sizeof(cpus), &cpus);
+            if (err) {
+                errno = err;
+                return -1;
+            }
+            restore_cpus = true;
+        }
+        int old_policy;
+        sched_param old_param;
+        bool restore_sched = false;
+        if (opt.fifo_priority > 0) {
+            sched_param param {};
+            param.sched_priority = opt.fifo_priority;
+            int err = pthread_getschedparam (self, &old_policy, &old_param);
+            if (!err)
+                err = pthread_setschedparam (self, SCHED_FIFO, &param);
+            if (err) {
+                if (restore_cpus)
+                    pthread_setaffinity_np (self, sizeof(old_cpus), &old_cpus);
+                errno = err;
+                return -1;
+            }
+            restore_sched = true;
+        }
+
+        // Don't let the kernel delay wakeups to group them with other timers
+        int old_slack = prctl (PR_GET_TIMERSLACK, 0, 0, 0, 0);
+        prctl (PR_SET_TIMERSLACK, 1, 0, 0, 0);
+
+        stopped.store (false, std::memory_order_relaxed);
+        lateness_stats = stats {};
+        frame.reset_stats ();
+        std::fill (cursors.begin(), cursors.end(), 0);
+
+        int64_t duration_ns = std::chrono::nanoseconds(timeline.duration()).count ();
+        uint64_t frames_per_loop = (duration_ns + interval_ns - 1) / interval_ns;
+        timespec ts;
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        int64_t start = to_ns (ts);
+        uint64_t n = 0;          // Frames since start
+        uint64_t loop_start = 0; // The frame the current loop started at
+        unsigned loop = 0;
+
+        while (!stopped.load(std::memory_order_relaxed)) {
+            int64_t deadline = start + (int64_t)n * interval_ns;
+            ts.tv_sec = deadline / 1000000000;
+            ts.tv_nsec = deadline % 1000000000;
+            if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR)
+                continue;
+
+            clock_gettime (CLOCK_MONOTONIC, &ts);
+            int64_t late = std::max<int64_t> (to_ns(ts) - deadline, 0);
+            ++lateness_stats.frames;
+            lateness_stats.total += std::chrono::nanoseconds (late);
+            lateness_stats.max = std::max (lateness_stats.max, std::chrono::nanoseconds(late));
+            ++lateness_stats.histogram[std::min<unsigned>(std::bit_width((uint64_t)late), 31)];
+
+            // The last frame of a loop is at the time of the last keyframe
+            uint64_t loop_frame = n - loop_start;
+            bool last = loop_frame >= frames_per_loop;
+            int64_t t = last ? duration_ns : (int64_t)loop_frame * interval_ns;
+            render (std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::nanoseconds(t)));
+            frame.commit (); // Failed writes are counted in the commit stats
+            ++n;
+
+            if (last) {
+                if (opt.loops  &&  ++loop >= opt.loops)
+                    break;
+                loop_start = n;
+                continue;
+            }
+
+            // Skip the frames whose deadlines have already passed,
+            // but always play the last frame of a loop
+            clock_gettime (CLOCK_MONOTONIC, &ts);
+            uint64_t next = (to_ns(ts) - start) / interval_ns + 1;
+            next = std::min (next, loop_start + frames_per_loop);
+            if (next > n) {
+                lateness_stats.skipped += next - n;
+                n = next;
+            }
+        }
+
+        if (old_slack > 0)
+            prctl (PR_SET_TIMERSLACK, old_slack, 0, 0, 0);
+        if (restore_sched)
+            pthread_setschedparam (self, old_policy, &old_param);
+        if (restore_cpus)
+            pthread_setaffinity_np (self, sizeof(old_cpus), &old_cpus);
+        return 0;
+    }
+
+
+}
@@ -0,0 +1,342 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEDPP_LED_TIMELINE_HPP
+#define LEDPP_LED_TIMELINE_HPP
+
+#include <led++.hpp>
+#include <led_frame.hpp>
+#include <chrono>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <span>
+#include <iosfwd>
+#include <cstdint>
+
+
+namespace ledpp {
+
+
+    /**
+     * A light sequence of brightness keyframes for a set of LEDs,
+     * loaded from a binary file.
+     *
+     * The file is mapped into memory and used as it is, there is no
+     * parsing step. It consists of a header, one track per LED,
+     * the keyframes of all tracks, and the LED names:
+     *
+     * <pre>
+     * header                     32 bytes
+     * track[num_tracks]          16 bytes each
+     * keyframe[num_keyframes]     8 bytes each
+     * names[names_size]          null terminated LED names
+     * </pre>
+     *
+     * All numbers are in the byte order of the host that created
+     * the file, which is checked using a byte order mark. A track
+     * refers to a range of keyframes sorted by time. Each keyframe
+     * has an interpolation mode telling how the brightness changes
+     * from that keyframe to the next. Files are created from a text
+     * description by convert().
+     */
+    class led_timeline {
+    public:
+        /**
+         * How the brightness changes between two keyframes.
+         */
+        enum class interpolation : uint8_t {
+            step = 0,    /**< Keep the brightness until the next keyframe. */
+            linear,      /**< Constant rate of change. */
+            ease_in,     /**< Start slow, end fast. */
+            ease_out,    /**< Start fast, end slow. */
+            ease_in_out, /**< Start and end slow. */
+        };
+
+        /**
+         * Keyframe flag: the value is a fraction of the max
+         * brightness of the LED, where 65535 is the max brightness.
+         */
+        static constexpr uint8_t relative = 0x01;
+
+        /**
+         * The file header.
+         */
+        struct header {
+            char magic[8];              /**< "LEDPPTL" and a null character. */
+            uint16_t byte_order;        /**< 0x0102 in host byte order. */
+            uint16_t version;           /**< Format version, 1. */
+            uint32_t num_tracks;        /**< Number of tracks. */
+            uint32_t num_keyframes;     /**< Number of keyframes of all tracks. */
+            uint32_t names_size;        /**< Size of the name table in bytes. */
+            uint32_t frame_interval_us; /**< Suggested time between frames. */
+            uint32_t duration_ms;       /**< Time of the last keyframe. */
+        };
+
+        /**
+         * The keyframes of one LED.
+         */
+        struct track {
+            uint32_t name_offset;    /**< Offset of the LED name in the name table. */
+            uint32_t first_keyframe; /**< Index of the first keyframe. */
+            uint32_t num_keyframes;  /**< Number of keyframes, at least one. */
+            uint32_t reserved;       /**< Set to 0. */
+        };
+
+        /**
+         * A brightness value at a point in time.
+         */
+        struct keyframe {
+            uint32_t time_ms;   /**< Time from the start of the sequence. */
+            uint16_t value;     /**< Brightness, see flag <code>relative</code>. */
+            uint8_t  mode;      /**< A value from enum interpolation. */
+            uint8_t  flags;     /**< Keyframe flags. */
+        };
+
+        /**
+         * Map a timeline file into memory.
+         * The file is checked to be a valid timeline, so that
+         * the player never reads outside of it.
+         * @param file The name of the file.
+         * @throw std::system_error If the file can't be read, or
+         *        isn't a valid timeline file (<code>EINVAL</code>).
+         */
+        led_timeline (const std::filesystem::path& file);
+
+        /**
+         * Unmap the file.
+         */
+        ~led_timeline ();
+
+        led_timeline (const led_timeline&) = delete;
+        led_timeline& operator= (const led_timeline&) = delete;
+
+        /**
+         * Return the number of tracks.
+         */
+        size_t size () const {
+            return tracks.size ();
+        }
+
+        /**
+         * Return the name of the LED of a track.
+         */
+        std::string_view led_name (size_t index) const;
+
+        /**
+         * Return the keyframes of a track.
+         */
+        std::span<const keyframe> keyframes (size_t index) const;
+
+        /**
+         * Return the time of the last keyframe of all tracks.
+         */
+        std::chrono::milliseconds duration () const {
+            return std::chrono::milliseconds (hdr->duration_ms);
+        }
+
+        /**
+         * Return the time between frames suggested by the file.
+         */
+        std::chrono::microseconds frame_interval () const {
+            return std::chrono::microseconds (hdr->frame_interval_us);
+        }
+
+        /**
+         * Calculate the brightness of a track at a point in time.
+         * @param keyframes The keyframes of the track.
+         * @param time The time from the start of the sequence.
+         * @param max_brightness The max brightness of the LED.
+         * @param cursor Index of the keyframe at or before the last
+         *               time asked for. Start at 0, the search
+         *               continues from here when time moves forward.
+         * @return The brightness, 0 - max_brightness.
+         */
+        static unsigned value_at (std::span<const keyframe> keyframes,
+                                  std::chrono::microseconds time,
+                                  unsigned max_brightness,
+                                  size_t& cursor);
+
+        /**
+         * Create a timeline file from a text description.
+         *
+         * The text has one statement per line, and '#' starts
+         * a comment:
+         * <pre>
+         * interval MS               Suggested time between frames, default 10.
+         * led NAME                  Start the track of a LED.
+         * TIME VALUE [MODE]         A keyframe of the current track.
+         * </pre>
+         * TIME is in milliseconds, keyframes of a track must be in time
+         * order. VALUE is a brightness, or a percentage of the max
+         * brightness like "50%". MODE is one of step, linear, in, out,
+         * and in-out, and is linear if not given.
+         *
+         * @param in The text.
+         * @param out The binary timeline is written here.
+         * @throw std::invalid_argument If the text isn't valid.
+         *        The message tells the line number.
+         */
+        static void convert (std::istream& in, std::ostream& out);
+
+
+    private:
+        void* map;
+        size_t map_size;
+        const header* hdr;
+        std::span<const track> tracks;
+        std::span<const keyframe> frames;
+        std::string_view names;
+    };
+
+
+    /**
+     * Play a led_timeline on the LEDs.
+     *
+     * The player wakes up at absolute deadlines on
+     * <code>CLOCK_MONOTONIC</code> using
+     * <code>clock_nanosleep</code>, so time errors don't accumulate.
+     * At each frame, the brightness of all tracks is calculated and
+     * committed using a led_frame, so only changed LEDs are written.
+     * If a frame is so late that the next deadline has already passed,
+     * the frames in between are skipped. The lateness of each frame,
+     * the time from the deadline until the player woke up, is recorded.
+     */
+    class timeline_player {
+    public:
+        /**
+         * Playback options.
+         */
+        struct options {
+            /**
+             * Time between frames. 0 means use the
+             * interval suggested by the timeline.
+             */
+            std::chrono::microseconds frame_interval {0};
+
+            /**
+             * Number of times to play the timeline. 0 means
+             * repeat until stop() is called.
+             */
+            unsigned loops {1};
+
+            /**
+             * If not 0, play using the real-time scheduling policy
+             * <code>SCHED_FIFO</code> with this priority, 1 - 99.
+             */
+            int fifo_priority {0};
+
+            /**
+             * If not -1, run the playing thread on this CPU only.
+             */
+            int cpu {-1};
+        };
+
+        /**
+         * Frame lateness statistics.
+         */
+        struct stats {
+            unsigned long frames;            /**< Number of frames played. */
+            unsigned long skipped;           /**< Number of frames skipped. */
+            std::chrono::nanoseconds max;    /**< Largest lateness. */
+            std::chrono::nanoseconds total;  /**< Sum of all lateness. */
+            /**
+             * Number of frames by lateness. Index n counts frames
+             * later than 2^(n-1) and at most 2^n - 1 nanoseconds.
+             */
+            unsigned long histogram[32];
+
+            /**
+             * Return the mean lateness.
+             */
+            std::chrono::nanoseconds mean () const {
+                return frames ? total / static_cast<long>(frames) : std::chrono::nanoseconds::zero();
+            }
+
+            /**
+             * Return a lateness percentile, rounded up to a power
+             * of two nanoseconds.
+             * @param p The percentile, 0 - 100.
+             */
+            std::chrono::nanoseconds percentile (unsigned p) const;
+        };
+
+        /**
+         * Create a player and open the LEDs of a timeline.
+         * @param tl The timeline. It must remain valid
+         *           for the lifetime of the player.
+         * @param dir The directory where the LEDs are found.
+         * @throw std::system_error If a LED can't be opened.
+         */
+        timeline_player (const led_timeline& tl,
+                         const std::filesystem::path& dir = led::leds_dir());
+
+        timeline_player (const timeline_player&) = delete;
+        timeline_player& operator= (const timeline_player&) = delete;
+
+        /**
+         * Play the timeline in the calling thread.
+         * The timer slack of the thread is set to the minimum while
+         * playing. The timer slack, scheduling policy, and CPU affinity
+         * of the thread are restored when playback ends.
+         * @param opt Playback options.
+         * @return 0 when the timeline has been played or stop() was
+         *         called, or -1 on error and <code>errno</code> is set.
+         *         Setting <code>SCHED_FIFO</code> usually fails with
+         *         <code>EPERM</code> for unprivileged users.
+         */
+        int play (const options& opt);
+
+        /**
+         * Make play() return after the current frame.
+         * This may be called from any thread, or from a signal handler.
+         */
+        void stop () {
+            stopped.store (true, std::memory_order_relaxed);
+        }
+
+        /**
+         * Return the lateness statistics of the last playback.
+         */
+        const stats& lateness () const {
+            return lateness_stats;
+        }
+
+        /**
+         * Return the commit statistics of the last playback.
+         */
+        const led_frame::stats& commit_stats () const {
+            return frame.commit_stats ();
+        }
+
+
+    private:
+        const led_timeline& timeline;
+        std::vector<std::unique_ptr<led>> leds;
+        std::vector<unsigned> max_brightness;
+        std::vector<size_t> cursors;
+        led_frame frame;
+        std::atomic<bool> stopped;
+        stats lateness_stats;
+
+        void render (std::chrono::microseconds time);
+    };
+
+
+}
+#endif
@@ -0,0 +1,321 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <led_watcher.hpp>
+#include <vector>
+#include <charconv>
+#include <cerrno>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+
+
+namespace ledpp {
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    led_watcher::led_watcher (std::chrono::milliseconds min_interval_arg,
+                              std::chrono::milliseconds max_interval_arg)
+        : min_interval (min_interval_arg),
+          max_interval (max_interval_arg < min_interval_arg ? min_interval_arg : max_interval_arg),
+          epoll_fd (-1),
+          timer_fd (-1),
+          event_fd (-1),
+          stopped (false),
+          dispatching (false)
+    {
+        epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+        timer_fd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        event_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epoll_fd < 0  ||  timer_fd < 0  ||  event_fd < 0) {
+            int errnum = errno;
+            for (int fd : {epoll_fd, timer_fd, event_fd}) {
+                if (fd >= 0)
+                    close (fd);
+            }
+            throw std::system_error (errnum, std::generic_category());
+        }
+
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = &timer_fd;
+        epoll_ctl (epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev);
+        ev.data.ptr = &event_fd;
+        epoll_ctl (epoll_fd, EPOLL_CTL_ADD, event_fd, &ev);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    led_watcher::~led_watcher ()
+    {
+        for (auto& [l, e] : entries) {
+            if (e->fd >= 0)
+                close (e->fd);
+        }
+        close (event_fd);
+        close (timer_fd);
+        close (epoll_fd);
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Read the value of brightness_hw_changed. Reading the attribute
+    // also re-arms the notification. If the attribute has no value
+    // yet (ENODATA), the current brightness is returned instead.
+    //--------------------------------------------------------------------------
+    int led_watcher::read_hw_changed (entry& e)
+    {
+        char buf[32];
+        ssize_t len = pread (e.fd, buf, sizeof(buf), 0);
+        if (len < 0)
+            return e.target->get_value (led::attr_brightness);
+        int value;
+        auto [ptr, ec] = std::from_chars (buf, buf+len, value);
+        if (ec != std::errc())
+            return e.target->get_value (led::attr_brightness);
+        return value;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led_watcher::add (led& l, callback cb)
+    {
+        auto i = entries.find (&l);
+        if (i != entries.end()  &&  !i->second->removed) {
+            i->second->cb = cb;
+            return 0;
+        }
+
+        auto e = std::make_unique<entry> ();
+        e->target = &l;
+        e->cb = cb;
+        e->removed = false;
+        e->interval = min_interval;
+        e->deadline = clock::now() + e->interval;
+        e->fd = l.open_attr ("brightness_hw_changed", O_RDONLY);
+        if (e->fd >= 0) {
+            epoll_event ev;
+            ev.events = EPOLLPRI;
+            ev.data.ptr = e.get ();
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, e->fd, &ev)) {
+                // Not pollable, fall back to polling the brightness
+                close (e->fd);
+                e->fd = -1;
+            }
+        }
+
+        // Reading brightness_hw_changed arms the notification
+        if (e->fd >= 0)
+            read_hw_changed (*e);
+        e->last_value = l.get_value (led::attr_brightness);
+        if (e->last_value < 0) {
+            if (e->fd >= 0)
+                close (e->fd);
+            return -1;
+        }
+
+        if (i != entries.end()) {
+            // Replace an entry removed during dispatching,
+            // keep the old one until the dispatching is done
+            graveyard.emplace_back (std::move(i->second));
+            i->second = std::move (e);
+        }else
+            entries.emplace (&l, std::move(e));
+        arm_timer ();
+        return 0;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led_watcher::remove (led& l)
+    {
+        auto i = entries.find (&l);
+        if (i == entries.end())
+            return;
+        entry& e = *i->second;
+        if (e.fd >= 0) {
+            epoll_ctl (epoll_fd, EPOLL_CTL_DEL, e.fd, nullptr);
+            close (e.fd);
+            e.fd = -1;
+        }
+        if (dispatching)
+            e.removed = true; // Erased when the dispatching is done
+        else
+            entries.erase (i);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    bool led_watcher::notified (led& l) const
+    {
+        auto i = entries.find (&l);
+        return i != entries.end()  &&  i->second->fd >= 0;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led_watcher::purge ()
+    {
+        graveyard.clear ();
+        for (auto i=entries.begin(); i!=entries.end();) {
+            if (i->second->removed)
+                i = entries.erase (i);
+            else
+                ++i;
+        }
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led_watcher::arm_timer ()
+    {
+        itimerspec its {};
+        bool armed = false;
+        clock::time_point deadline;
+        for (auto& [l, e] : entries) {
+            if (e->removed)
+                continue;
+            if (!armed  ||  e->deadline < deadline)
+                deadline = e->deadline;
+            armed = true;
+        }
+        if (armed) {
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds> (deadline.time_since_epoch());
+            its.it_value.tv_sec = ns.count() / 1000000000;
+            its.it_value.tv_nsec = ns.count() % 1000000000;
+            if (its.it_value.tv_sec == 0  &&  its.it_value.tv_nsec == 0)
+                its.it_value.tv_nsec = 1;
+        }
+        timerfd_settime (timer_fd, TFD_TIMER_ABSTIME, &its, nullptr);
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Poll the brightness of the LEDs. LEDs with change notification
+    // are polled too, since the kernel only notifies changes made by
+    // the hardware. The callbacks are called after the loop, since a
+    // callback adding a LED may rehash the entries.
+    //--------------------------------------------------------------------------
+    int led_watcher::poll_leds ()
+    {
+        int num_callbacks = 0;
+        auto now = clock::now ();
+        fired.clear ();
+        for (auto& [l, e] : entries) {
+            if (e->removed  ||  e->deadline > now)
+                continue;
+            int value = l->get_value (led::attr_brightness);
+            if (value != e->last_value) {
+                e->last_value = value;
+                l->brightness_changed (value);
+                e->interval = min_interval;
+                e->deadline = now + e->interval;
+                fired.emplace_back (e.get(), value);
+            }else{
+                e->interval *= 2;
+                if (e->interval > max_interval)
+                    e->interval = max_interval;
+                e->deadline = now + e->interval;
+            }
+        }
+        // Entries removed by a callback are kept until the
+        // dispatching is done, but must not be called
+        for (auto [e, value] : fired) {
+            if (e->removed)
+                continue;
+            e->cb (*e->target, value);
+            ++num_callbacks;
+        }
+        return num_callbacks;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led_watcher::run_once (int timeout)
+    {
+        epoll_event events[32];
+        int num = epoll_wait (epoll_fd, events, 32, timeout);
+        if (num < 0)
+            return errno==EINTR ? 0 : -1;
+
+        int num_callbacks = 0;
+        dispatching = true;
+        for (int i=0; i<num; ++i) {
+            if (events[i].data.ptr == &event_fd  ||  events[i].data.ptr == &timer_fd) {
+                uint64_t counter;
+                int fd = *static_cast<int*> (events[i].data.ptr);
+                [[maybe_unused]] auto result = read (fd, &counter, sizeof(counter));
+                if (fd == timer_fd)
+                    num_callbacks += poll_leds ();
+                continue;
+            }
+            auto e = static_cast<entry*> (events[i].data.ptr);
+            if (e->removed)
+                continue;
+            int value = read_hw_changed (*e);
+            if (value != e->last_value) {
+                e->last_value = value;
+                e->interval = min_interval;
+                e->deadline = clock::now() + e->interval;
+                e->target->brightness_changed (value);
+                e->cb (*e->target, value);
+                ++num_callbacks;
+            }
+        }
+        dispatching = false;
+        purge ();
+        arm_timer ();
+        return num_callbacks;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int led_watcher::run ()
+    {
+        while (!stopped) {
+            if (run_once(-1) < 0)
+                return -1;
+        }
+        stopped = false;
+        return 0;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void led_watcher::stop ()
+    {
+        stopped = true;
+        uint64_t one = 1;
+        [[maybe_unused]] auto result = write (event_fd, &one, sizeof(one));
+    }
+
+
+}
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEDPP_LED_WATCHER_HPP
+#define LEDPP_LED_WATCHER_HPP
+
+#include <led++.hpp>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+
+
+namespace ledpp {
+
+
+    /**
+     * Get notified when the brightness of LEDs change.
+     *
+     * The watcher polls the brightness of the LEDs. The poll interval
+     * of a LED starts at a minimum value, and is doubled each time no
+     * change is found, up to a maximum value. When a change is found,
+     * the interval is reset to the minimum.
+     *
+     * LEDs that have the attribute <code>brightness_hw_changed</code>
+     * are also watched using kernel notifications (<code>POLLPRI</code>),
+     * all in one epoll instance, so changes made by the hardware are
+     * reported at once. The kernel doesn't notify changes made by
+     * software, like other processes or triggers, so these LEDs are
+     * polled as well.
+     *
+     * The watcher is driven by the application, either by calling
+     * run(), or by adding the file descriptor returned by fd() to
+     * an external event loop and calling run_once() when it is
+     * readable. Callbacks are called from the thread running the
+     * watcher. Except for stop(), methods must not be called
+     * concurrently from different threads.
+     */
+    class led_watcher {
+    public:
+        /**
+         * Clock used for poll intervals.
+         */
+        using clock = std::chrono::steady_clock;
+
+        /**
+         * Function called when the brightness of a LED has changed.
+         * The arguments are the LED and the new brightness value.
+         */
+        using callback = std::function<void(led&, int)>;
+
+        /**
+         * Create a watcher.
+         * @param min_interval The shortest poll interval.
+         * @param max_interval The longest poll interval.
+         * @throw std::system_error If the watcher can't be created.
+         */
+        led_watcher (std::chrono::milliseconds min_interval = std::chrono::milliseconds(50),
+                     std::chrono::milliseconds max_interval = std::chrono::milliseconds(2000));
+
+        /**
+         * Destructor.
+         */
+        ~led_watcher ();
+
+        led_watcher (const led_watcher&) = delete;
+        led_watcher& operator= (const led_watcher&) = delete;
+
+        /**
+         * Start watching a LED.
+         * If the LED is already watched, its callback is replaced.
+         * This may be called from a callback.
+         * @param l The LED. The object must remain valid for as
+         *          long as it is watched.
+         * @param cb A function called when the brightness changes.
+         * @return 0 on success, -1 on error and
+         *         <code>errno</code> is set.
+         */
+        int add (led& l, callback cb);
+
+        /**
+         * Stop watching a LED.
+         * This may be called from a callback.
+         * @param l The LED.
+         */
+        void remove (led& l);
+
+        /**
+         * Check if a LED is watched using kernel notifications
+         * in addition to polling.
+         * @param l The LED.
+         * @return <code>true</code> if the kernel notifies brightness
+         *         changes made by the hardware for the LED. Other
+         *         changes are found by polling.
+         */
+        bool notified (led& l) const;
+
+        /**
+         * Return the number of watched LEDs.
+         */
+        size_t size () const {
+            return entries.size ();
+        }
+
+        /**
+         * Return a file descriptor that becomes readable
+         * when run_once() has work to do.
+         */
+        int fd () const {
+            return epoll_fd;
+        }
+
+        /**
+         * Wait for changes and call callbacks.
+         * @param timeout The maximum time in milliseconds to wait,
+         *                or -1 to wait until something happens.
+         * @return The number of callbacks called,
+         *         or -1 on error and <code>errno</code> is set.
+         */
+        int run_once (int timeout=-1);
+
+        /**
+         * Wait for changes and call callbacks until stop() is called.
+         * @return 0 when stopped, or -1 on error and
+         *         <code>errno</code> is set.
+         */
+        int run ();
+
+        /**
+         * Make run() return.
+         * This may be called from any thread, or from a callback.
+         */
+        void stop ();
+
+
+    private:
+        struct entry {
+            led* target;
+            callback cb;
+            int fd;
+            int last_value;
+            bool removed;
+            clock::duration interval;
+            clock::time_point deadline;
+        };
+
+        std::chrono::milliseconds min_interval;
+        std::chrono::milliseconds max_interval;
+        int epoll_fd;
+        int timer_fd;
+        int event_fd;
+        std::atomic<bool> stopped;
+        bool dispatching;
+        std::unordered_map<led*, std::unique_ptr<entry>> entries;
+        std::vector<std::unique_ptr<entry>> graveyard;
+        std::vector<std::pair<entry*, int>> fired;
+
+        int read_hw_changed (entry& e);
+        int poll_leds ();
+        void arm_timer ();
+        void purge ();
+    };
+
+
+}
+#endif
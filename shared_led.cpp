@@ -0,0 +1,339 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <shared_led.hpp>
+#include <map>
+#include <algorithm>
+#include <system_error>
+#include <cerrno>
+#include <fcntl.h>
+
+
+namespace ledpp {
+
+
+    // Handles returned by shared_led::open(), by path and flags
+    static std::mutex handles_mutex;
+    static std::map<std::string, std::weak_ptr<shared_led>> handles;
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    shared_led::shared_led (const std::string& name, unsigned flags)
+        : shared_led (name, led::leds_dir(), flags)
+    {
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Open all files and read everything the led object would otherwise
+    // load on first use, so the object is never changed after this.
+    //--------------------------------------------------------------------------
+    shared_led::shared_led (const std::string& name,
+                            const std::filesystem::path& dir,
+                            unsigned flags)
+        : l (name, dir, led::keep_open),
+          shadow (flags & led::shadow_state),
+          max_value (-1),
+          state (0)
+    {
+        std::fill_n (open_errno, led::attr_count, 0);
+
+        max_value = l.get_value (led::attr_max_brightness);
+        if (max_value < 0) {
+            int errnum = errno;
+            throw std::system_error (errnum, std::generic_category());
+        }
+        l.color_names ();
+
+        for (auto attr : {led::attr_brightness, led::attr_multi_intensity, led::attr_trigger}) {
+            if (l.attr_fd(attr, O_RDONLY) < 0)
+                open_errno[attr] = errno;
+        }
+        if (open_errno[led::attr_brightness])
+            throw std::system_error (open_errno[led::attr_brightness], std::generic_category());
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    std::shared_ptr<shared_led> shared_led::open (const std::string& name, unsigned flags)
+    {
+        return open (name, led::leds_dir(), flags);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    std::shared_ptr<shared_led> shared_led::open (const std::string& name,
+                                                  const std::filesystem::path& dir,
+                                                  unsigned flags)
+    {
+        flags &= led::shadow_state;
+        auto key = (dir / name).lexically_normal().string ();
+        key.push_back ('\0');
+        key.push_back (flags ? 's' : '-');
+
+        std::lock_guard<std::mutex> lock (handles_mutex);
+        std::erase_if (handles, [](auto& entry) { return entry.second.expired(); });
+
+        auto i = handles.find (key);
+        if (i != handles.end()) {
+            auto handle = i->second.lock ();
+            if (handle)
+                return handle;
+        }
+        auto handle = std::make_shared<shared_led> (name, dir, flags);
+        handles[key] = handle;
+        return handle;
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Check that an attribute file was opened by the constructor, so
+    // the led object never opens it, and is never changed, later on.
+    //--------------------------------------------------------------------------
+    bool shared_led::usable (led::attr_t attr, bool write) const
+    {
+        if (l.attr_fds[attr] < 0) {
+            errno = open_errno[attr];
+            return false;
+        }
+        if (write  &&  l.attr_modes[attr] != O_RDWR) {
+            errno = EACCES;
+            return false;
+        }
+        return true;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int shared_led::brightness ()
+    {
+        if (!shadow)
+            return read_brightness ();
+
+        auto s = state.load (std::memory_order_acquire);
+        if (s & known_brightness)
+            return s & value_mask;
+
+        // Fill in the state while no other thread writes the LED
+        std::lock_guard<std::mutex> lock (write_mutex);
+        s = state.load (std::memory_order_relaxed);
+        if (s & known_brightness)
+            return s & value_mask;
+        int value = read_brightness ();
+        if (value >= 0)
+            state.store (s | known_brightness | (unsigned)value, std::memory_order_release);
+        return value;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int shared_led::brightness (unsigned value)
+    {
+        if (shadow) {
+            auto s = state.load (std::memory_order_acquire);
+            if ((s & known_brightness)  &&  (s & value_mask) == value)
+                return 0;
+        }
+        std::lock_guard<std::mutex> lock (write_mutex);
+        return write_brightness (value);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int shared_led::read_color_intensity (std::span<unsigned> values)
+    {
+        if (!usable(led::attr_multi_intensity, false))
+            return -1;
+        char buf[led::intensity_buf_size];
+        ssize_t len = l.read_attr (led::attr_multi_intensity, buf, sizeof(buf));
+        if (len < 0)
+            return -1;
+        return led::parse_values (buf, len, values);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int shared_led::color_intensity (std::span<const unsigned> values)
+    {
+        std::lock_guard<std::mutex> lock (write_mutex);
+        return write_intensity (values);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int shared_led::set (unsigned value, std::span<const unsigned> values)
+    {
+        std::lock_guard<std::mutex> lock (write_mutex);
+        if (write_intensity(values))
+            return -1;
+        if (shadow) {
+            auto s = state.load (std::memory_order_relaxed);
+            if ((s & known_brightness)  &&  (s & value_mask) == value)
+                return 0;
+        }
+        return write_brightness (value);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int shared_led::active_trigger ()
+    {
+        if (!shadow)
+            return read_active_trigger ();
+
+        auto s = state.load (std::memory_order_acquire);
+        if (s & known_trigger)
+            return (s & trigger_mask) >> trigger_shift;
+
+        std::lock_guard<std::mutex> lock (write_mutex);
+        s = state.load (std::memory_order_relaxed);
+        if (s & known_trigger)
+            return (s & trigger_mask) >> trigger_shift;
+        int id = read_active_trigger ();
+        if (id >= 0  &&  ((uint64_t)id << trigger_shift) <= trigger_mask)
+            state.store (s | known_trigger | ((uint64_t)id << trigger_shift),
+                         std::memory_order_release);
+        return id;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    std::string shared_led::trigger ()
+    {
+        int id = active_trigger ();
+        if (id < 0)
+            return {};
+        return std::string (trigger_registry::name(id));
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int shared_led::trigger (std::string_view name)
+    {
+        uint64_t id = trigger_registry::intern (name);
+        if (shadow) {
+            auto s = state.load (std::memory_order_acquire);
+            if ((s & known_trigger)  &&  (s & trigger_mask) == (id << trigger_shift))
+                return 0;
+        }
+
+        std::lock_guard<std::mutex> lock (write_mutex);
+        if (!usable(led::attr_trigger, true))
+            return -1;
+        int result = l.write_trigger (name);
+        if (shadow) {
+            // Setting a trigger may change the brightness
+            uint64_t s = 0;
+            if (result == 0  &&  (id << trigger_shift) <= trigger_mask)
+                s = known_trigger | (id << trigger_shift);
+            state.store (s, std::memory_order_release);
+        }
+        return result;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void shared_led::invalidate ()
+    {
+        std::lock_guard<std::mutex> lock (write_mutex);
+        state.store (0, std::memory_order_release);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int shared_led::read_brightness ()
+    {
+        if (!usable(led::attr_brightness, false))
+            return -1;
+        return l.get_value (led::attr_brightness);
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Read and parse the trigger file into a buffer of the calling
+    // thread, since the buffer of the led object can't be shared.
+    //--------------------------------------------------------------------------
+    int shared_led::read_active_trigger ()
+    {
+        thread_local std::string buf;
+        if (!usable(led::attr_trigger, false))
+            return -1;
+        ssize_t len = l.read_trigger_file (buf);
+        if (len < 0)
+            return -1;
+        auto name = led::parse_active_trigger (std::string_view(buf.data(), len));
+        if (name.empty()) {
+            errno = ENOENT;
+            return -1;
+        }
+        return trigger_registry::intern (name);
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Called with write_mutex locked.
+    //--------------------------------------------------------------------------
+    int shared_led::write_brightness (unsigned value)
+    {
+        if (!usable(led::attr_brightness, true))
+            return -1;
+        int result = l.set_value (led::attr_brightness, value);
+        if (shadow) {
+            auto s = state.load (std::memory_order_relaxed);
+            s &= ~(known_brightness | value_mask);
+            if (result == 0)
+                s |= known_brightness | value;
+            // Turning off a LED removes its trigger, and a failed
+            // write may have done that too
+            if (value == 0  ||  result != 0)
+                s &= ~(known_trigger | trigger_mask);
+            state.store (s, std::memory_order_release);
+        }
+        return result;
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Called with write_mutex locked.
+    //--------------------------------------------------------------------------
+    int shared_led::write_intensity (std::span<const unsigned> values)
+    {
+        if (!usable(led::attr_multi_intensity, true))
+            return -1;
+        char buf[led::intensity_buf_size];
+        int len = led::format_values (buf, sizeof(buf), values);
+        if (len < 0)
+            return -1;
+        return l.write_attr (led::attr_multi_intensity, buf, len);
+    }
+
+
+}
@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEDPP_SHARED_LED_HPP
+#define LEDPP_SHARED_LED_HPP
+
+#include <led++.hpp>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <span>
+#include <cstdint>
+
+
+namespace ledpp {
+
+
+    /**
+     * A LED handle that can be used by several threads at once.
+     *
+     * All attribute files of the LED are opened, and the max
+     * brightness and color names are read, when the object is
+     * created. After that, no method changes anything but the
+     * state described below, and the guarantees are:
+     *
+     * - All methods may be called concurrently from any number
+     *   of threads.
+     * - Reads are never serialized. Each read is a single
+     *   <code>pread</code> on a shared file descriptor, or, with
+     *   flag <code>led::shadow_state</code>, a load of an atomic
+     *   state word, and takes no lock.
+     * - Writes to the same LED are serialized by a lock owned by
+     *   the LED, so a brightness and color intensity written by
+     *   set() are never interleaved with writes of another thread.
+     *   Writes to different LEDs never wait for each other.
+     * - With flag <code>led::shadow_state</code>, the last written or
+     *   read brightness and trigger are kept in one atomic state word.
+     *   A read that returns a remembered value always returns the value
+     *   of the last completed write from any thread, and writes of the
+     *   remembered value are skipped without taking the lock. Reading
+     *   a value that isn't remembered takes the lock once to fill in the
+     *   state. Color intensity is always read from the LED.
+     * - Changes made by other processes, or by the kernel, are not
+     *   seen in remembered values until invalidate() is called.
+     *
+     * Flags other than <code>led::shadow_state</code> are ignored, the
+     * files are always kept open, and writes are never deferred.
+     * Use open() to get one handle per LED that is shared by all
+     * users in the process.
+     */
+    class shared_led {
+    public:
+        /**
+         * Create a handle to a LED in the directory
+         * returned by led::leds_dir().
+         * @param name The name of the LED.
+         * @param flags <code>led::shadow_state</code> or 0.
+         * @throw std::system_error If the LED doesn't exist,
+         *        or its brightness can't be read.
+         */
+        shared_led (const std::string& name, unsigned flags=0);
+
+        /**
+         * Create a handle to a LED in a specific directory.
+         * @param name The name of the LED.
+         * @param dir The directory where the LED is found.
+         * @param flags <code>led::shadow_state</code> or 0.
+         * @throw std::system_error If the LED doesn't exist,
+         *        or its brightness can't be read.
+         */
+        shared_led (const std::string& name,
+                    const std::filesystem::path& dir,
+                    unsigned flags=0);
+
+        shared_led (const shared_led&) = delete;
+        shared_led& operator= (const shared_led&) = delete;
+
+        /**
+         * Return the handle of a LED in the directory returned by
+         * led::leds_dir(), creating it if no other handle of the LED
+         * with the same flags is in use. This method is thread-safe.
+         * @param name The name of the LED.
+         * @param flags <code>led::shadow_state</code> or 0.
+         * @return The shared handle.
+         * @throw std::system_error If the handle can't be created.
+         */
+        static std::shared_ptr<shared_led> open (const std::string& name,
+                                                 unsigned flags=0);
+
+        /**
+         * Return the handle of a LED in a specific directory,
+         * creating it if no other handle of the LED with the
+         * same flags is in use. This method is thread-safe.
+         * @param name The name of the LED.
+         * @param dir The directory where the LED is found.
+         * @param flags <code>led::shadow_state</code> or 0.
+         * @return The shared handle.
+         * @throw std::system_error If the handle can't be created.
+         */
+        static std::shared_ptr<shared_led> open (const std::string& name,
+                                                 const std::filesystem::path& dir,
+                                                 unsigned flags=0);
+
+        /**
+         * Return the name of the LED.
+         */
+        const std::string& name () const {
+            return l.name ();
+        }
+
+        /**
+         * Return the maximum brightness of the LED, read
+         * when the object was created.
+         */
+        int max_brightness () const {
+            return max_value;
+        }
+
+        /**
+         * Check if this is a multicolor LED.
+         */
+        bool is_multicolor () const {
+            return !l.color_names().empty();
+        }
+
+        /**
+         * Return the color names of a multicolor LED, read
+         * when the object was created.
+         */
+        const std::vector<std::string>& color_names () const {
+            return l.color_names ();
+        }
+
+        /**
+         * Get the current brightness of the LED.
+         * @return The brightness, or -1 on error and
+         *         <code>errno</code> is set.
+         */
+        int brightness ();
+
+        /**
+         * Set the brightness of the LED.
+         * @param value The new brightness.
+         * @return 0 on success, -1 on error and
+         *         <code>errno</code> is set.
+         */
+        int brightness (unsigned value);
+
+        /**
+         * Read the intensity of each color of a multicolor LED.
+         * This method doesn't allocate any memory.
+         * @param values Buffer where the intensity values are stored.
+         * @return The number of values read, or -1 on error
+         *         and <code>errno</code> is set.
+         */
+        int read_color_intensity (std::span<unsigned> values);
+
+        /**
+         * Set the intensity of each color of a multicolor LED.
+         * This method doesn't allocate any memory.
+         * @param values One intensity value for each color.
+         * @return 0 on success, -1 on error and
+         *         <code>errno</code> is set.
+         */
+        int color_intensity (std::span<const unsigned> values);
+
+        /**
+         * Set the color intensity and the brightness of the LED,
+         * without writes of other threads in between.
+         * @param value The new brightness.
+         * @param values One intensity value for each color.
+         * @return 0 on success, -1 on error and
+         *         <code>errno</code> is set.
+         */
+        int set (unsigned value, std::span<const unsigned> values);
+
+        /**
+         * Return the id of the current trigger of the LED.
+         * @return A trigger id, or -1 on error.
+         * @see trigger_registry
+         */
+        int active_trigger ();
+
+        /**
+         * Return the name of the current trigger of the LED.
+         * @return A trigger name, or an empty string on error.
+         */
+        std::string trigger ();
+
+        /**
+         * Set a trigger for the LED.
+         * Setting a trigger may change the brightness.
+         * @param name The name of the trigger.
+         * @return 0 on success, -1 on error and
+         *         <code>errno</code> is set.
+         */
+        int trigger (std::string_view name);
+
+        /**
+         * Forget the remembered brightness and trigger, so they are
+         * read from the LED the next time. This is only useful for
+         * objects created with flag <code>led::shadow_state</code>.
+         */
+        void invalidate ();
+
+
+    private:
+        // Bits of the state word
+        static constexpr uint64_t known_brightness = 1ull << 63;
+        static constexpr uint64_t known_trigger    = 1ull << 62;
+        static constexpr uint64_t value_mask       = 0xffffffffull;
+        static constexpr unsigned trigger_shift    = 32;
+        static constexpr uint64_t trigger_mask     = 0x3fffffffull << trigger_shift;
+
+        led l;
+        bool shadow;
+        int max_value;
+        int open_errno[led::attr_count];
+        std::mutex write_mutex;
+        std::atomic<uint64_t> state;
+
+        bool usable (led::attr_t attr, bool write) const;
+        int read_brightness ();
+        int read_active_trigger ();
+        int write_brightness (unsigned value);
+        int write_intensity (std::span<const unsigned> values);
+    };
+
+
+}
+#endif
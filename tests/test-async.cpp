@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <async_writer.hpp>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include "fake-sysfs.hpp"
+#include "test-util.hpp"
+
+using namespace ledpp;
+
+static constexpr int num_leds = 64;
+
+
+//------------------------------------------------------------------------------
+// Cancel a LED while another thread posts changes to LEDs
+// the writer hasn't seen before, which grows its table.
+//------------------------------------------------------------------------------
+static void test_cancel_while_posting (const fake_sysfs& sysfs)
+{
+    for (int round=0; round<50; ++round) {
+        async_writer writer;
+        std::vector<std::unique_ptr<led>> leds;
+        for (int i=0; i<num_leds; ++i)
+            leds.emplace_back (std::make_unique<led>("test:green:" + std::to_string(i), sysfs.path()));
+
+        writer.brightness (*leds[0], round + 1);
+        std::thread poster ([&writer, &leds](){
+            for (int i=1; i<num_leds; ++i)
+                writer.brightness (*leds[i], 1);
+        });
+        writer.cancel (*leds[0]);
+        poster.join ();
+        writer.wait ();
+        CHECK (writer.pending() == 0);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// cancel() must not return while the completion callback for the
+// LED is running, since the caller may destroy the LED right after.
+//------------------------------------------------------------------------------
+static void test_cancel_during_callback (const fake_sysfs& sysfs)
+{
+    async_writer writer;
+    auto l = std::make_unique<led> ("test:green:0", sysfs.path());
+    std::atomic<bool> started (false);
+    std::atomic<bool> done (false);
+    std::string name;
+
+    writer.on_complete ([&](led& target, int) {
+        started = true;
+        std::this_thread::sleep_for (std::chrono::milliseconds(50));
+        name = target.name ();
+        done = true;
+    });
+    writer.brightness (*l, 1);
+    while (!started)
+        std::this_thread::yield ();
+    writer.cancel (*l);
+    CHECK (done);
+    l.reset ();
+    CHECK (name == "test:green:0");
+}
+
+
+//------------------------------------------------------------------------------
+// wait() must not return before the completion callbacks have run.
+//------------------------------------------------------------------------------
+static void test_wait_for_callback (const fake_sysfs& sysfs)
+{
+    async_writer writer;
+    led l ("test:green:1", sysfs.path());
+    std::atomic<int> calls (0);
+
+    writer.on_complete ([&calls](led&, int) {
+        std::this_thread::sleep_for (std::chrono::milliseconds(20));
+        ++calls;
+    });
+    writer.brightness (l, 1);
+    writer.wait ();
+    CHECK (calls == 1);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int main ()
+{
+    fake_sysfs sysfs;
+    for (int i=0; i<num_leds; ++i)
+        sysfs.add_led ("test:green:" + std::to_string(i), 255);
+
+    test_cancel_while_posting (sysfs);
+    test_cancel_during_callback (sysfs);
+    test_wait_for_callback (sysfs);
+    return test_result ();
+}
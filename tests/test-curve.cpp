@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <led_curve.hpp>
+#include "test-util.hpp"
+
+using namespace ledpp;
+
+using curve_type = brightness_curve<linear_curve>;
+
+// Normalized levels of any arithmetic type, and fixed point levels,
+// must be unambiguous calls.
+static_assert (requires (const curve_type& c) { c.level (0.5); });
+static_assert (requires (const curve_type& c) { c.level (0.5f); });
+static_assert (requires (const curve_type& c) { c.level (1); });
+static_assert (requires (const curve_type& c) { c.level_fixed (1); });
+static_assert (requires (const curve_type& c) { c.level_fixed (curve_type::full_level); });
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static void test_levels ()
+{
+    curve_type curve (255);
+
+    CHECK (curve.level(0) == 0);
+    CHECK (curve.level(1) == 255);
+    CHECK (curve.level(0.5) == 128);
+    CHECK (curve.level(-1.0) == 0);
+    CHECK (curve.level(2.0) == 255);
+    CHECK (curve.level_fixed(0) == 0);
+    CHECK (curve.level_fixed(curve_type::full_level) == 255);
+    CHECK (curve.level_fixed(curve_type::full_level / 2) == 127);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int main ()
+{
+    test_levels ();
+    return test_result ();
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <effect_engine.hpp>
+#include <thread>
+#include <chrono>
+#include "fake-sysfs.hpp"
+#include "test-util.hpp"
+
+using namespace ledpp;
+
+
+//------------------------------------------------------------------------------
+// wait() must not return before the error callback of
+// a failed effect has returned.
+//------------------------------------------------------------------------------
+static void test_wait_for_error_callback (const fake_sysfs& sysfs)
+{
+    const std::string name = "test:green:broken";
+    led l (name, sysfs.path());
+
+    // Make the brightness impossible to write
+    std::filesystem::remove (sysfs.path() / name / "brightness");
+    std::filesystem::create_directory (sysfs.path() / name / "brightness");
+
+    effect_engine engine;
+    int errnum = 0;
+    engine.on_error ([&errnum](led&, int e) {
+        std::this_thread::sleep_for (std::chrono::milliseconds(50));
+        errnum = e;
+    });
+    engine.ramp (l, 0, 255, std::chrono::milliseconds(100));
+    engine.wait ();
+    CHECK (errnum != 0);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int main ()
+{
+    fake_sysfs sysfs;
+    sysfs.add_led ("test:green:broken", 255);
+
+    test_wait_for_error_callback (sysfs);
+    return test_result ();
+}
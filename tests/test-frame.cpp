@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <led_frame.hpp>
+#include <memory>
+#include <vector>
+#include "fake-sysfs.hpp"
+#include "test-util.hpp"
+
+using namespace ledpp;
+
+static constexpr int num_leds = 16;
+
+
+//------------------------------------------------------------------------------
+// A LED added more than once keeps its first index.
+//------------------------------------------------------------------------------
+static void test_add_twice (const fake_sysfs& sysfs)
+{
+    std::vector<std::unique_ptr<led>> leds;
+    std::vector<led*> ptrs;
+    for (int i=0; i<num_leds; ++i) {
+        leds.emplace_back (std::make_unique<led>("test:green:" + std::to_string(i), sysfs.path()));
+        ptrs.emplace_back (leds.back().get());
+    }
+    ptrs.emplace_back (leds[3].get());
+
+    led_frame frame (ptrs);
+    CHECK (frame.size() == num_leds);
+    for (int i=0; i<num_leds; ++i) {
+        CHECK (frame.add(*leds[i]) == (size_t)i);
+        CHECK (&frame.at(i) == leds[i].get());
+    }
+    CHECK (frame.size() == num_leds);
+
+    frame.brightness (frame.add(*leds[5]), 9);
+    CHECK (frame.commit() == 0);
+    CHECK (read_line(sysfs.path() / "test:green:5" / "brightness") == "9");
+}
+
+
+//------------------------------------------------------------------------------
+// A trigger change rewrites the brightness, but not if it is 0,
+// since writing brightness 0 would remove the new trigger.
+//------------------------------------------------------------------------------
+static void test_trigger_change (const fake_sysfs& sysfs)
+{
+    led off ("test:green:0", sysfs.path());
+    led on ("test:green:1", sysfs.path());
+    led_frame frame;
+    auto i_off = frame.add (off);
+    auto i_on = frame.add (on);
+
+    frame.brightness (i_off, 0);
+    frame.brightness (i_on, 7);
+    CHECK (frame.commit() == 0);
+
+    // Mark the brightness files to see if they are written again
+    write_file (sysfs.path() / "test:green:0" / "brightness", "100\n");
+    write_file (sysfs.path() / "test:green:1" / "brightness", "100\n");
+
+    frame.trigger (i_off, "timer");
+    frame.trigger (i_on, "timer");
+    CHECK (frame.commit() == 0);
+    CHECK (read_line(sysfs.path() / "test:green:0" / "trigger").starts_with("timer"));
+    CHECK (read_line(sysfs.path() / "test:green:0" / "brightness") == "100");
+    CHECK (read_line(sysfs.path() / "test:green:1" / "trigger").starts_with("timer"));
+    CHECK (read_line(sysfs.path() / "test:green:1" / "brightness") == "7");
+}
+
+
+//------------------------------------------------------------------------------
+// Brightness 0 isn't written together with a new trigger, not on
+// the first commit, after invalidate(), or when the brightness
+// changes to 0 in the same commit, and later commits don't write
+// it either.
+//------------------------------------------------------------------------------
+static void test_trigger_with_brightness_0 (const fake_sysfs& sysfs)
+{
+    const auto dir = sysfs.path() / "test:green:2";
+    led l ("test:green:2", sysfs.path());
+    led_frame frame;
+    auto i = frame.add (l);
+
+    // First commit
+    write_file (dir / "brightness", "100\n");
+    frame.trigger (i, "timer");
+    frame.brightness (i, 0);
+    CHECK (frame.commit() == 0);
+    CHECK (read_line(dir / "trigger").starts_with("timer"));
+    CHECK (read_line(dir / "brightness") == "100");
+
+    auto writes = frame.commit_stats().writes;
+    CHECK (frame.commit() == 0);
+    CHECK (frame.commit_stats().writes == writes);
+    CHECK (read_line(dir / "brightness") == "100");
+
+    // After invalidate()
+    write_file (dir / "trigger", "[none] timer\n");
+    frame.invalidate ();
+    CHECK (frame.commit() == 0);
+    CHECK (read_line(dir / "trigger").starts_with("timer"));
+    CHECK (read_line(dir / "brightness") == "100");
+
+    // Brightness changed to 0 together with the trigger
+    frame.trigger (i, "none");
+    frame.brightness (i, 5);
+    CHECK (frame.commit() == 0);
+    CHECK (read_line(dir / "brightness") == "5");
+    frame.trigger (i, "heartbeat");
+    frame.brightness (i, 0);
+    CHECK (frame.commit() == 0);
+    CHECK (read_line(dir / "trigger").starts_with("heartbeat"));
+    CHECK (read_line(dir / "brightness") == "5");
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int main ()
+{
+    fake_sysfs sysfs;
+    for (int i=0; i<num_leds; ++i)
+        sysfs.add_led ("test:green:" + std::to_string(i), 255);
+
+    test_add_twice (sysfs);
+    test_trigger_change (sysfs);
+    test_trigger_with_brightness_0 (sysfs);
+    return test_result ();
+}
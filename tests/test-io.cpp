@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <led++.hpp>
+#include <led_batch.hpp>
+#include <new>
+#include <array>
+#include <cstdlib>
+#include "fake-sysfs.hpp"
+#include "test-util.hpp"
+
+using namespace ledpp;
+
+
+// Count heap allocations, to check that the
+// allocation-free methods really don't allocate.
+static size_t num_allocs = 0;
+
+void* operator new (size_t size)
+{
+    ++num_allocs;
+    void* ptr = malloc (size ? size : 1);
+    if (!ptr)
+        throw std::bad_alloc ();
+    return ptr;
+}
+
+void operator delete (void* ptr) noexcept
+{
+    free (ptr);
+}
+
+void operator delete (void* ptr, size_t) noexcept
+{
+    free (ptr);
+}
+
+
+//------------------------------------------------------------------------------
+// Read the color intensity using a separate led object.
+//------------------------------------------------------------------------------
+static std::vector<unsigned> intensity_of (const fake_sysfs& sysfs)
+{
+    return led("test:multi:io", sysfs.path()).color_intensity ();
+}
+
+
+//------------------------------------------------------------------------------
+// Calls that compiled before the span and string_view
+// overloads were added must still compile and work.
+//------------------------------------------------------------------------------
+static void test_overloads (const fake_sysfs& sysfs)
+{
+    led l ("test:multi:io", sysfs.path());
+    std::vector<unsigned> values {1, 2, 3};
+    std::string name ("timer");
+
+    CHECK (l.color_intensity({255, 0, 0}) == 0);
+    CHECK (intensity_of(sysfs) == (std::vector<unsigned>{255, 0, 0}));
+    CHECK (l.color_intensity(values) == 0);
+    CHECK (intensity_of(sysfs) == values);
+    CHECK (l.trigger(name) == 0);
+    CHECK (read_line(sysfs.path() / "test:multi:io" / "trigger") == "timer");
+    CHECK (l.trigger("none") == 0);
+    CHECK (l.trigger(std::string_view("none")) == 0);
+
+    led_batch batch;
+    batch.color_intensity (l, {4, 5, 6});
+    batch.trigger (l, name);
+    CHECK (batch.commit() == 0);
+    CHECK (intensity_of(sysfs) == (std::vector<unsigned>{4, 5, 6}));
+}
+
+
+//------------------------------------------------------------------------------
+// Once the files are open and the buffers have grown,
+// reads and writes don't allocate any memory.
+//------------------------------------------------------------------------------
+static void test_no_allocations (const fake_sysfs& sysfs)
+{
+    led l ("test:multi:io", sysfs.path(), led::keep_open);
+    write_file (sysfs.path() / "test:multi:io" / "trigger", "[none] timer heartbeat\n");
+    std::array<unsigned, 3> values {10, 20, 30};
+    std::array<unsigned, 3> read_back {};
+
+    // Open the files and grow the trigger buffer
+    CHECK (l.brightness(1) == 0);
+    CHECK (l.read_color_intensity(read_back) == 3);
+    CHECK (l.read_trigger() == "none");
+
+    size_t before = num_allocs;
+    for (int i=0; i<100; ++i) {
+        CHECK (l.brightness(i) == 0);
+        CHECK (l.brightness() == i);
+        CHECK (l.color_intensity(values) == 0);
+        CHECK (l.read_color_intensity(read_back) == 3);
+        CHECK (!l.read_trigger().empty());
+    }
+    CHECK (num_allocs == before);
+    CHECK (read_back == values);
+}
+
+
+//------------------------------------------------------------------------------
+// A color intensity that can be written using the led API
+// can also be written using a led_batch.
+//------------------------------------------------------------------------------
+static void test_wide_intensity (const fake_sysfs& sysfs)
+{
+    led l ("test:multi:wide", sysfs.path());
+    std::vector<unsigned> values (40, 1000000000);
+
+    CHECK (l.color_intensity(values) == 0);
+    CHECK (l.color_intensity() == values);
+
+    values.assign (values.size(), 2000000000);
+    led_batch batch;
+    batch.color_intensity (l, values);
+    CHECK (batch.commit() == 0);
+    CHECK (l.color_intensity() == values);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int main ()
+{
+    fake_sysfs sysfs;
+    sysfs.add_led ("test:multi:io", 255, {"red", "green", "blue"}, {"none", "timer"});
+    sysfs.add_led ("test:multi:wide", 255, std::vector<std::string>(40, "red"));
+
+    test_overloads (sysfs);
+    test_no_allocations (sysfs);
+    test_wide_intensity (sysfs);
+    return test_result ();
+}
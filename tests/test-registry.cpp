@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <led_registry.hpp>
+#include <string>
+#include <vector>
+#include "fake-sysfs.hpp"
+#include "test-util.hpp"
+
+using namespace ledpp;
+
+
+//------------------------------------------------------------------------------
+// Return the names of selected LEDs.
+//------------------------------------------------------------------------------
+static std::vector<std::string> names_of (const led_registry& registry,
+                                          const led_registry::query& q)
+{
+    std::vector<std::string> names;
+    for (auto e : registry.select(q))
+        names.emplace_back (e->name);
+    return names;
+}
+
+
+//------------------------------------------------------------------------------
+// Check how a LED name is split.
+//------------------------------------------------------------------------------
+static void check_name (const led_registry& registry,
+                        const std::string& name,
+                        std::string_view device,
+                        std::string_view color,
+                        std::string_view function,
+                        bool multicolor)
+{
+    auto e = registry.find (name);
+    CHECK (e != nullptr);
+    if (!e)
+        return;
+    CHECK (e->device == device);
+    CHECK (e->color == color);
+    CHECK (e->function == function);
+    CHECK (e->multicolor == multicolor);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static void test_names (const led_registry& registry)
+{
+    check_name (registry, "pci:0000:00:1f.0:green:disk", "pci:0000:00:1f.0", "green", "disk", false);
+    check_name (registry, "input3::capslock", "input3", "", "capslock", false);
+    check_name (registry, "green:heartbeat", "", "green", "heartbeat", false);
+    check_name (registry, "ACT", "", "", "ACT", false);
+    check_name (registry, "platform:multicolor:status", "platform", "multicolor", "status", true);
+    check_name (registry, "platform:rgb:indicator", "platform", "rgb", "indicator", true);
+    CHECK (registry.find("no:such:led") == nullptr);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static void test_select (const led_registry& registry)
+{
+    using names = std::vector<std::string>;
+
+    CHECK (names_of(registry, {}).size() == registry.size());
+    CHECK (names_of(registry, {.device = "platform"}) ==
+           (names{"platform:green:status", "platform:multicolor:status", "platform:rgb:indicator"}));
+    CHECK (names_of(registry, {.color = "green"}) ==
+           (names{"green:heartbeat", "pci:0000:00:1f.0:green:disk", "platform:green:status"}));
+    CHECK (names_of(registry, {.function = "ACT"}) == (names{"ACT"}));
+    CHECK (names_of(registry, {.multicolor = 1}) ==
+           (names{"platform:multicolor:status", "platform:rgb:indicator"}));
+
+    // Combined filters
+    CHECK (names_of(registry, {.device = "platform", .function = "status"}) ==
+           (names{"platform:green:status", "platform:multicolor:status"}));
+    CHECK (names_of(registry, {.device = "platform", .function = "status", .multicolor = 0}) ==
+           (names{"platform:green:status"}));
+    CHECK (names_of(registry, {.device = "platform", .color = "rgb", .multicolor = 1}) ==
+           (names{"platform:rgb:indicator"}));
+    CHECK (names_of(registry, {.color = "green", .multicolor = 1}).empty());
+    CHECK (names_of(registry, {.device = "none"}).empty());
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static void test_rescan (fake_sysfs& sysfs, led_registry& registry)
+{
+    int added = 0;
+    int removed = 0;
+    registry.subscribe ([&](const led_registry::entry&, led_registry::event ev) {
+        if (ev == led_registry::event::added)
+            ++added;
+        else
+            ++removed;
+    });
+
+    auto size = registry.size ();
+    sysfs.add_led ("usb:blue:power", 1);
+    std::filesystem::remove_all (sysfs.path() / "ACT");
+
+    CHECK (registry.rescan() == 2);
+    CHECK (added == 1);
+    CHECK (removed == 1);
+    CHECK (registry.size() == size);
+    CHECK (registry.find("ACT") == nullptr);
+    check_name (registry, "usb:blue:power", "usb", "blue", "power", false);
+    CHECK (names_of(registry, {.function = "ACT"}).empty());
+    CHECK (names_of(registry, {.color = "blue"}) == (std::vector<std::string>{"usb:blue:power"}));
+
+    // Nothing more has changed
+    CHECK (registry.rescan() == 0);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int main ()
+{
+    fake_sysfs sysfs;
+    sysfs.add_led ("pci:0000:00:1f.0:green:disk", 1);
+    sysfs.add_led ("input3::capslock", 1);
+    sysfs.add_led ("green:heartbeat", 1);
+    sysfs.add_led ("ACT", 1);
+    sysfs.add_led ("platform:green:status", 1);
+    sysfs.add_led ("platform:multicolor:status", 255, {"red", "green", "blue"});
+    sysfs.add_led ("platform:rgb:indicator", 255, {"red", "green", "blue"});
+
+    led_registry registry (sysfs.path());
+    CHECK (registry.size() == 7);
+
+    test_names (registry);
+    test_select (registry);
+    test_rescan (sysfs, registry);
+    return test_result ();
+}
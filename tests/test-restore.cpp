@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <led++.hpp>
+#include <vector>
+#include <string>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include "fake-sysfs.hpp"
+#include "test-util.hpp"
+
+using namespace ledpp;
+
+
+//------------------------------------------------------------------------------
+// Return the names of the files modified in a directory
+// watched by inotify, in the order they were written.
+//------------------------------------------------------------------------------
+static std::vector<std::string> modified_files (int fd)
+{
+    std::vector<std::string> names;
+    alignas(inotify_event) char buf[4096];
+    ssize_t len;
+    while ((len = read(fd, buf, sizeof(buf))) > 0) {
+        for (char* pos=buf; pos<buf+len; ) {
+            auto ev = reinterpret_cast<inotify_event*> (pos);
+            if (ev->len  &&  (names.empty() || names.back() != ev->name))
+                names.emplace_back (ev->name);
+            pos += sizeof(inotify_event) + ev->len;
+        }
+    }
+    return names;
+}
+
+
+//------------------------------------------------------------------------------
+// Save, change, restore, and restore again. LEDs that already
+// have the saved state cost no writes, the trigger is written
+// before the brightness, and the brightness of a LED with a
+// trigger other than none isn't restored.
+//------------------------------------------------------------------------------
+static void test_restore (const fake_sysfs& sysfs)
+{
+    const auto green = sysfs.path() / "test:green:0";
+    const auto multi = sysfs.path() / "test:multi:0";
+    const auto timer = sysfs.path() / "test:green:1";
+    std::vector<std::string> names {"test:green:0", "test:multi:0", "test:green:1"};
+
+    write_file (green / "brightness", "7\n");
+    write_file (multi / "brightness", "3\n");
+    write_file (timer / "trigger", "none [timer]\n");
+    write_file (timer / "brightness", "1\n");
+    led::snapshot(names, sysfs.path()).save (sysfs.path() / "state");
+    auto state = led_snapshot::load (sysfs.path() / "state");
+
+    // Nothing has changed
+    size_t num_writes = 1;
+    CHECK (led::restore(state, sysfs.path(), &num_writes) == 0);
+    CHECK (num_writes == 0);
+
+    // Change the LEDs
+    write_file (green / "brightness", "0\n");
+    write_file (green / "trigger", "none [timer]\n");
+    write_file (multi / "multi_intensity", "1 2 3\n");
+    write_file (timer / "brightness", "9\n");
+
+    int fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+    CHECK (fd >= 0);
+    inotify_add_watch (fd, green.c_str(), IN_MODIFY);
+
+    CHECK (led::restore(state, sysfs.path(), &num_writes) == 0);
+    CHECK (num_writes == 3);
+    CHECK (modified_files(fd) == (std::vector<std::string>{"trigger", "brightness"}));
+    close (fd);
+
+    CHECK (read_line(green / "brightness") == "7");
+    CHECK (led("test:multi:0", sysfs.path()).color_intensity() == (std::vector<unsigned>{255, 255, 255}));
+    CHECK (read_line(multi / "brightness") == "3");
+    CHECK (read_line(timer / "brightness") == "9");
+
+    // The kernel marks the written trigger as active
+    write_file (green / "trigger", "[none] timer\n");
+
+    // Everything is restored
+    CHECK (led::restore(state, sysfs.path(), &num_writes) == 0);
+    CHECK (num_writes == 0);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int main ()
+{
+    fake_sysfs sysfs;
+    sysfs.add_led ("test:green:0", 255, {}, {"none", "timer"});
+    sysfs.add_led ("test:multi:0", 255, {"red", "green", "blue"}, {"none", "timer"});
+    sysfs.add_led ("test:green:1", 255, {}, {"none", "timer"});
+
+    test_restore (sysfs);
+    return test_result ();
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <led++.hpp>
+#include <led_batch.hpp>
+#include "fake-sysfs.hpp"
+#include "test-util.hpp"
+
+using namespace ledpp;
+
+
+//------------------------------------------------------------------------------
+// The fake tree doesn't turn the LED off when the trigger changes,
+// so the tests do it themselves, the way the kernel would.
+//------------------------------------------------------------------------------
+static void kernel_turns_off (const fake_sysfs& sysfs, const std::string& name)
+{
+    write_file (sysfs.path() / name / "brightness", "0\n");
+}
+
+
+//------------------------------------------------------------------------------
+// A trigger and the same brightness as before in one batch.
+//------------------------------------------------------------------------------
+static void test_batch_trigger_brightness (const fake_sysfs& sysfs)
+{
+    const std::string name = "test:green:batch";
+    led l (name, sysfs.path(), led::shadow_state);
+    CHECK (l.brightness(5) == 0);
+
+    led_batch batch;
+    batch.trigger (l, "timer");
+    batch.brightness (l, 5);
+    kernel_turns_off (sysfs, name);
+    CHECK (batch.commit() == 0);
+    CHECK (read_line(sysfs.path() / name / "brightness") == "5");
+}
+
+
+//------------------------------------------------------------------------------
+// A deferred trigger and the same brightness as before in one flush.
+//------------------------------------------------------------------------------
+static void test_flush_trigger_brightness (const fake_sysfs& sysfs)
+{
+    const std::string name = "test:green:flush";
+    led l (name, sysfs.path(), led::defer_writes);
+    CHECK (l.brightness(7) == 0);
+    CHECK (l.flush() == 0);
+
+    CHECK (l.trigger("timer") == 0);
+    CHECK (l.brightness(7) == 0);
+    kernel_turns_off (sysfs, name);
+    CHECK (l.flush() == 0);
+    CHECK (read_line(sysfs.path() / name / "brightness") == "7");
+}
+
+
+//------------------------------------------------------------------------------
+// A deferred trigger change alone restores the known brightness,
+// unless it is 0, which would remove the new trigger.
+//------------------------------------------------------------------------------
+static void test_flush_trigger_only (const fake_sysfs& sysfs)
+{
+    const std::string name = "test:green:trigger";
+    led l (name, sysfs.path(), led::defer_writes);
+    CHECK (l.brightness(3) == 0);
+    CHECK (l.flush() == 0);
+
+    CHECK (l.trigger("timer") == 0);
+    kernel_turns_off (sysfs, name);
+    CHECK (l.flush() == 0);
+    CHECK (read_line(sysfs.path() / name / "brightness") == "3");
+
+    CHECK (l.brightness(0) == 0);
+    CHECK (l.flush() == 0);
+    CHECK (l.trigger("none") == 0);
+    write_file (sysfs.path() / name / "brightness", "9\n");
+    CHECK (l.flush() == 0);
+    CHECK (read_line(sysfs.path() / name / "brightness") == "9");
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int main ()
+{
+    fake_sysfs sysfs;
+    for (auto name : {"test:green:batch", "test:green:flush", "test:green:trigger"})
+        sysfs.add_led (name, 255, {}, {"none", "timer"});
+
+    test_batch_trigger_brightness (sysfs);
+    test_flush_trigger_brightness (sysfs);
+    test_flush_trigger_only (sysfs);
+    return test_result ();
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <shared_led.hpp>
+#include "fake-sysfs.hpp"
+#include "test-util.hpp"
+
+using namespace ledpp;
+
+
+//------------------------------------------------------------------------------
+// Brightness 0 removes the trigger, so setting the same
+// trigger again must not be skipped.
+//------------------------------------------------------------------------------
+static void test_off_removes_trigger (const fake_sysfs& sysfs)
+{
+    const std::string name = "test:green:shared";
+    auto trigger_file = sysfs.path() / name / "trigger";
+    shared_led l (name, sysfs.path(), led::shadow_state);
+
+    CHECK (l.trigger("timer") == 0);
+    CHECK (read_line(trigger_file) == "timer");
+    CHECK (l.brightness(0) == 0);
+
+    // The kernel removes the trigger
+    write_file (trigger_file, "[none] timer\n");
+    CHECK (l.trigger("timer") == 0);
+    CHECK (read_line(trigger_file) == "timer");
+    CHECK (l.trigger() == "timer");
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int main ()
+{
+    fake_sysfs sysfs;
+    sysfs.add_led ("test:green:shared", 255, {}, {"none", "timer"});
+
+    test_off_removes_trigger (sysfs);
+    return test_result ();
+}
@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <led_timeline.hpp>
+#include <sstream>
+#include <cstddef>
+#include <cstring>
+#include <cerrno>
+#include "fake-sysfs.hpp"
+#include "test-util.hpp"
+
+using namespace ledpp;
+using std::chrono::milliseconds;
+
+static const char* timeline_text =
+    "# Test timeline\n"
+    "interval 20\n"
+    "led test:green:0\n"
+    "0   0    step\n"
+    "100 200           # linear\n"
+    "200 100  in\n"
+    "300 0    out\n"
+    "400 50%  in-out\n"
+    "500 100%\n"
+    "led test:green:1\n"
+    "0   10\n";
+
+// Offsets in the binary file of the timeline above
+static constexpr size_t tracks_pos = sizeof (led_timeline::header);
+static constexpr size_t frames_pos = tracks_pos + 2 * sizeof(led_timeline::track);
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static std::string convert (const std::string& text)
+{
+    std::istringstream in (text);
+    std::ostringstream out;
+    led_timeline::convert (in, out);
+    return out.str ();
+}
+
+
+//------------------------------------------------------------------------------
+// Return true if a converted timeline is rejected with EINVAL.
+//------------------------------------------------------------------------------
+static bool rejected (const fake_sysfs& sysfs, const std::string& data)
+{
+    auto file = sysfs.path() / "invalid.tl";
+    write_file (file, data);
+    try {
+        led_timeline tl (file);
+    }
+    catch (std::system_error& e) {
+        return e.code().value() == EINVAL;
+    }
+    return false;
+}
+
+
+//------------------------------------------------------------------------------
+// Convert the text to a file and load it.
+//------------------------------------------------------------------------------
+static void test_round_trip (const fake_sysfs& sysfs)
+{
+    auto file = sysfs.path() / "test.tl";
+    write_file (file, convert(timeline_text));
+
+    led_timeline tl (file);
+    CHECK (tl.size() == 2);
+    CHECK (tl.led_name(0) == "test:green:0");
+    CHECK (tl.led_name(1) == "test:green:1");
+    CHECK (tl.keyframes(0).size() == 6);
+    CHECK (tl.keyframes(1).size() == 1);
+    CHECK (tl.duration() == milliseconds(500));
+    CHECK (tl.frame_interval() == std::chrono::microseconds(20000));
+
+    auto k = tl.keyframes (0);
+    CHECK (k[0].mode == (uint8_t)led_timeline::interpolation::step);
+    CHECK (k[1].mode == (uint8_t)led_timeline::interpolation::linear);
+    CHECK (k[3].mode == (uint8_t)led_timeline::interpolation::ease_out);
+    CHECK (k[4].value == 32768  &&  (k[4].flags & led_timeline::relative));
+    CHECK (k[2].value == 100  &&  !(k[2].flags & led_timeline::relative));
+}
+
+
+//------------------------------------------------------------------------------
+// Invalid text is rejected by convert().
+//------------------------------------------------------------------------------
+static void test_invalid_text ()
+{
+    for (auto text : {"0 10\n",
+                      "led a\n100 10\n50 10\n",
+                      "led a\n0 10 wobble\n",
+                      "led a\n0 101%\n",
+                      "led a\n0 65536\n",
+                      "led a\n",
+                      "interval 0\nled a\n0 1\n"})
+    {
+        bool thrown = false;
+        try {
+            convert (text);
+        }
+        catch (std::invalid_argument&) {
+            thrown = true;
+        }
+        CHECK (thrown);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Broken files are rejected when loaded.
+//------------------------------------------------------------------------------
+static void test_invalid_file (const fake_sysfs& sysfs)
+{
+    const auto data = convert (timeline_text);
+    std::string broken;
+
+    // Truncated
+    CHECK (rejected(sysfs, data.substr(0, data.size()-1)));
+    CHECK (rejected(sysfs, data.substr(0, sizeof(led_timeline::header)-1)));
+
+    // Bad magic
+    broken = data;
+    broken[0] = 'X';
+    CHECK (rejected(sysfs, broken));
+
+    // Keyframe index out of range
+    broken = data;
+    uint32_t first = 7;
+    memcpy (broken.data() + tracks_pos + sizeof(led_timeline::track) + offsetof(led_timeline::track, first_keyframe),
+            &first, sizeof(first));
+    CHECK (rejected(sysfs, broken));
+
+    // Keyframes out of order
+    broken = data;
+    uint32_t time_ms = 50;
+    memcpy (broken.data() + frames_pos + 2*sizeof(led_timeline::keyframe) + offsetof(led_timeline::keyframe, time_ms),
+            &time_ms, sizeof(time_ms));
+    CHECK (rejected(sysfs, broken));
+
+    // The unchanged file is valid
+    CHECK (!rejected(sysfs, data));
+}
+
+
+//------------------------------------------------------------------------------
+// Interpolated values at fixed times.
+//------------------------------------------------------------------------------
+static void test_values (const fake_sysfs& sysfs)
+{
+    auto file = sysfs.path() / "test.tl";
+    write_file (file, convert(timeline_text));
+    led_timeline tl (file);
+    auto k = tl.keyframes (0);
+    size_t cursor = 0;
+
+    auto value = [&](int ms, unsigned max_brightness=255) {
+        return led_timeline::value_at (k, milliseconds(ms), max_brightness, cursor);
+    };
+
+    CHECK (value(0) == 0);
+    CHECK (value(50) == 0);       // step
+    CHECK (value(100) == 200);
+    CHECK (value(150) == 150);    // linear 200 -> 100
+    CHECK (value(250) == 75);     // ease in 100 -> 0
+    CHECK (value(350) == 96);     // ease out 0 -> 50% of 255
+    CHECK (value(400) == 128);
+    CHECK (value(450) == 192);    // ease in-out 128 -> 255
+    CHECK (value(500) == 255);
+    CHECK (value(600) == 255);
+
+    // Moving back in time restarts the search
+    CHECK (value(150) == 150);
+    CHECK (cursor == 1);
+
+    // Relative values are scaled, absolute values are limited
+    CHECK (value(500, 1000) == 1000);
+    CHECK (value(400, 1000) == 500);
+    CHECK (value(100, 100) == 100);
+
+    size_t other = 0;
+    CHECK (led_timeline::value_at(tl.keyframes(1), milliseconds(300), 255, other) == 10);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int main ()
+{
+    fake_sysfs sysfs;
+
+    test_round_trip (sysfs);
+    test_invalid_text ();
+    test_invalid_file (sysfs);
+    test_values (sysfs);
+    return test_result ();
+}
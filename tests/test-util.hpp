@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEDPP_TEST_UTIL_HPP
+#define LEDPP_TEST_UTIL_HPP
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <filesystem>
+
+
+/**
+ * Number of failed checks in the test program.
+ */
+inline unsigned test_failures = 0;
+
+
+/**
+ * Check a condition, and print the location and the
+ * condition if it is false. The test continues.
+ */
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::cerr << __FILE__ << ':' << __LINE__ << ": CHECK failed: " #cond << std::endl; \
+            ++test_failures; \
+        } \
+    } while (0)
+
+
+/**
+ * Return the exit code of the test program.
+ */
+inline int test_result ()
+{
+    if (test_failures)
+        std::cerr << test_failures << " check(s) failed" << std::endl;
+    return test_failures ? 1 : 0;
+}
+
+
+/**
+ * Read a file written by the library, up to the first newline.
+ */
+inline std::string read_line (const std::filesystem::path& file)
+{
+    std::ifstream in (file);
+    std::string line;
+    std::getline (in, line);
+    return line;
+}
+
+
+/**
+ * Replace the contents of a file, like the kernel changing an attribute.
+ */
+inline void write_file (const std::filesystem::path& file, const std::string& content)
+{
+    std::ofstream out (file, std::ios::trunc);
+    out << content;
+}
+
+
+#endif
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <led_watcher.hpp>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "fake-sysfs.hpp"
+#include "test-util.hpp"
+
+using namespace ledpp;
+
+static constexpr int num_leds = 64;
+
+
+//------------------------------------------------------------------------------
+// Callbacks of polled LEDs that add and remove LEDs.
+//------------------------------------------------------------------------------
+static void test_add_from_callback (const fake_sysfs& sysfs)
+{
+    std::vector<std::unique_ptr<led>> leds;
+    for (int i=0; i<num_leds; ++i)
+        leds.emplace_back (std::make_unique<led>("test:green:" + std::to_string(i), sysfs.path()));
+
+    led_watcher watcher (std::chrono::milliseconds(1), std::chrono::milliseconds(1));
+    int changes = 0;
+    auto count = [&changes](led&, int) { ++changes; };
+
+    // Each of the first LEDs adds all the others
+    int first_calls = 0;
+    for (int i=0; i<2; ++i) {
+        CHECK (watcher.add(*leds[i], [&](led&, int) {
+            ++first_calls;
+            for (int j=2; j<num_leds; ++j)
+                watcher.add (*leds[j], count);
+        }) == 0);
+    }
+    CHECK (watcher.notified(*leds[0]) == false);
+
+    // Both changes are found in the same poll
+    write_file (sysfs.path() / "test:green:0" / "brightness", "1\n");
+    write_file (sysfs.path() / "test:green:1" / "brightness", "1\n");
+    std::this_thread::sleep_for (std::chrono::milliseconds(10));
+    int num = 0;
+    for (int i=0; i<100  &&  num == 0; ++i)
+        num = watcher.run_once (100);
+    CHECK (num == 2);
+    CHECK (first_calls == 2);
+    CHECK (watcher.size() == num_leds);
+
+    // All added LEDs are polled
+    for (int j=2; j<num_leds; ++j)
+        write_file (sysfs.path() / ("test:green:" + std::to_string(j)) / "brightness", "1\n");
+    for (int i=0; i<100  &&  changes < num_leds-2; ++i)
+        CHECK (watcher.run_once(100) >= 0);
+    CHECK (changes == num_leds - 2);
+}
+
+
+//------------------------------------------------------------------------------
+// The kernel only notifies brightness changes made by the hardware,
+// so changes made by software must still be found for LEDs with
+// change notification.
+//------------------------------------------------------------------------------
+static void test_software_change_of_notified_led (const fake_sysfs& sysfs)
+{
+    // A pollable brightness_hw_changed. It is opened for writing
+    // first, so the watcher can open it without blocking.
+    const auto dir = sysfs.path() / "test:green:hw";
+    CHECK (mkfifo((dir / "brightness_hw_changed").c_str(), 0600) == 0);
+    int fifo = open ((dir / "brightness_hw_changed").c_str(), O_RDWR | O_CLOEXEC);
+    CHECK (fifo >= 0);
+
+    led l ("test:green:hw", sysfs.path());
+    led_watcher watcher (std::chrono::milliseconds(1), std::chrono::milliseconds(1));
+    int value = -1;
+    CHECK (watcher.add(l, [&value](led&, int v) { value = v; }) == 0);
+    CHECK (watcher.notified(l));
+
+    write_file (dir / "brightness", "5\n");
+    for (int i=0; i<100  &&  value < 0; ++i)
+        CHECK (watcher.run_once(100) >= 0);
+    CHECK (value == 5);
+
+    watcher.remove (l);
+    close (fifo);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int main ()
+{
+    fake_sysfs sysfs;
+    for (int i=0; i<num_leds; ++i)
+        sysfs.add_led ("test:green:" + std::to_string(i), 255);
+    sysfs.add_led ("test:green:hw", 255);
+
+    test_add_from_callback (sysfs);
+    test_software_change_of_notified_led (sysfs);
+    return test_result ();
+}
@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <uring.hpp>
+#include <system_error>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+
+namespace ledpp {
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    static int sys_io_uring_setup (unsigned entries, io_uring_params* p)
+    {
+        return syscall (__NR_io_uring_setup, entries, p);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    static int sys_io_uring_enter (int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+    {
+        return syscall (__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    static int sys_io_uring_register (int fd, unsigned opcode, void* arg, unsigned nr_args)
+    {
+        return syscall (__NR_io_uring_register, fd, opcode, arg, nr_args);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    uring::uring (unsigned entries)
+        : ring_fd (-1),
+          to_submit (0),
+          sq_ring (MAP_FAILED),
+          sq_ring_size (0),
+          cq_ring (MAP_FAILED),
+          cq_ring_size (0),
+          sqes (static_cast<io_uring_sqe*>(MAP_FAILED)),
+          sqes_size (0)
+    {
+        io_uring_params p;
+        memset (&p, 0, sizeof(p));
+        memset (supported_ops, 0, sizeof(supported_ops));
+
+        ring_fd = sys_io_uring_setup (entries, &p);
+        if (ring_fd < 0)
+            throw std::system_error (errno, std::generic_category());
+
+        sq_entries = p.sq_entries;
+        sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            if (cq_ring_size > sq_ring_size)
+                sq_ring_size = cq_ring_size;
+            cq_ring_size = sq_ring_size;
+        }
+
+        sq_ring = mmap (nullptr, sq_ring_size, PROT_READ|PROT_WRITE,
+                        MAP_SHARED|MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+        if (sq_ring == MAP_FAILED) {
+            int errnum = errno;
+            cleanup ();
+            throw std::system_error (errnum, std::generic_category());
+        }
+        if (single_mmap) {
+            cq_ring = sq_ring;
+        }else{
+            cq_ring = mmap (nullptr, cq_ring_size, PROT_READ|PROT_WRITE,
+                            MAP_SHARED|MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+            if (cq_ring == MAP_FAILED) {
+                int errnum = errno;
+                cleanup ();
+                throw std::system_error (errnum, std::generic_category());
+            }
+        }
+        sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*> (mmap(nullptr, sqes_size, PROT_READ|PROT_WRITE,
+                                                MAP_SHARED|MAP_POPULATE, ring_fd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED) {
+            int errnum = errno;
+            cleanup ();
+            throw std::system_error (errnum, std::generic_category());
+        }
+
+        auto sq_base = static_cast<char*> (sq_ring);
+        auto cq_base = static_cast<char*> (cq_ring);
+        sq_head  = reinterpret_cast<unsigned*> (sq_base + p.sq_off.head);
+        sq_tail  = reinterpret_cast<unsigned*> (sq_base + p.sq_off.tail);
+        sq_mask  = reinterpret_cast<unsigned*> (sq_base + p.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*> (sq_base + p.sq_off.array);
+        cq_head  = reinterpret_cast<unsigned*> (cq_base + p.cq_off.head);
+        cq_tail  = reinterpret_cast<unsigned*> (cq_base + p.cq_off.tail);
+        cq_mask  = reinterpret_cast<unsigned*> (cq_base + p.cq_off.ring_mask);
+        cqes     = reinterpret_cast<io_uring_cqe*> (cq_base + p.cq_off.cqes);
+        sqe_tail = *sq_tail;
+
+        // Find out which operations the kernel supports
+        size_t probe_size = sizeof(io_uring_probe) + IORING_OP_LAST * sizeof(io_uring_probe_op);
+        auto probe = static_cast<io_uring_probe*> (calloc(1, probe_size));
+        if (probe) {
+            if (sys_io_uring_register(ring_fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) == 0) {
+                for (unsigned i=0; i<probe->ops_len && i<IORING_OP_LAST; ++i) {
+                    if (probe->ops[i].flags & IO_URING_OP_SUPPORTED)
+                        supported_ops[probe->ops[i].op] = 1;
+                }
+            }
+            free (probe);
+        }
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    uring::~uring ()
+    {
+        cleanup ();
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    void uring::cleanup ()
+    {
+        if (sqes != MAP_FAILED)
+            munmap (sqes, sqes_size);
+        if (cq_ring != MAP_FAILED  &&  cq_ring != sq_ring)
+            munmap (cq_ring, cq_ring_size);
+        if (sq_ring != MAP_FAILED)
+            munmap (sq_ring, sq_ring_size);
+        if (ring_fd >= 0)
+            close (ring_fd);
+        sqes = static_cast<io_uring_sqe*> (MAP_FAILED);
+        cq_ring = sq_ring = MAP_FAILED;
+        ring_fd = -1;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    bool uring::supports (unsigned opcode) const
+    {
+        return opcode < IORING_OP_LAST  &&  supported_ops[opcode];
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    unsigned uring::sq_space () const
+    {
+        unsigned head = __atomic_load_n (sq_head, __ATOMIC_ACQUIRE);
+        return sq_entries - (sqe_tail - head);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    io_uring_sqe* uring::get_sqe ()
+    {
+        if (sq_space() == 0)
+            return nullptr;
+        unsigned index = sqe_tail & *sq_mask;
+        io_uring_sqe* sqe = &sqes[index];
+        memset (sqe, 0, sizeof(*sqe));
+        sq_array[index] = index;
+        ++sqe_tail;
+        ++to_submit;
+        return sqe;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    int uring::submit (unsigned wait_nr)
+    {
+        __atomic_store_n (sq_tail, sqe_tail, __ATOMIC_RELEASE);
+
+        unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+        int result;
+        do {
+            result = sys_io_uring_enter (ring_fd, to_submit, wait_nr, flags);
+        } while (result < 0  &&  errno == EINTR);
+        if (result >= 0)
+            to_submit -= result;
+        return result;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    bool uring::get_cqe (io_uring_cqe& cqe)
+    {
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n (cq_tail, __ATOMIC_ACQUIRE);
+        if (head == tail)
+            return false;
+        cqe = cqes[head & *cq_mask];
+        __atomic_store_n (cq_head, head+1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+
+}
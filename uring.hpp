@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEDPP_URING_HPP
+#define LEDPP_URING_HPP
+
+#include <cstddef>
+#include <linux/io_uring.h>
+
+
+namespace ledpp {
+
+
+    /**
+     * Minimal io_uring instance using the raw system call interface.
+     * This is an internal helper class and not part of the public API.
+     */
+    class uring {
+    public:
+        /**
+         * Set up an io_uring instance.
+         * @param entries The minimum number of submission queue entries.
+         * @throw std::system_error If io_uring isn't available.
+         */
+        uring (unsigned entries);
+        ~uring ();
+
+        uring (const uring&) = delete;
+        uring& operator= (const uring&) = delete;
+
+        /**
+         * Return the io_uring file descriptor.
+         */
+        int fd () const {
+            return ring_fd;
+        }
+
+        /**
+         * Check if an opcode is supported by the kernel.
+         */
+        bool supports (unsigned opcode) const;
+
+        /**
+         * Return the number of free submission queue entries.
+         */
+        unsigned sq_space () const;
+
+        /**
+         * Get a cleared submission queue entry.
+         * @return A submission queue entry,
+         *         or <code>nullptr</code> if the queue is full.
+         */
+        io_uring_sqe* get_sqe ();
+
+        /**
+         * Submit queued entries and wait for completions.
+         * @param wait_nr The number of completions to wait for.
+         * @return The number of submitted entries, or -1 on error
+         *         and <code>errno</code> is set.
+         */
+        int submit (unsigned wait_nr=0);
+
+        /**
+         * Fetch a completion queue entry if one is available.
+         * @param cqe The completion is copied to this object.
+         * @return <code>true</code> if a completion was fetched.
+         */
+        bool get_cqe (io_uring_cqe& cqe);
+
+
+    private:
+        int ring_fd;
+        unsigned sq_entries;
+        unsigned to_submit;
+        unsigned sqe_tail;
+
+        void*  sq_ring;
+        size_t sq_ring_size;
+        void*  cq_ring;
+        size_t cq_ring_size;
+        io_uring_sqe* sqes;
+        size_t sqes_size;
+
+        unsigned* sq_head;
+        unsigned* sq_tail;
+        unsigned* sq_mask;
+        unsigned* sq_array;
+        unsigned* cq_head;
+        unsigned* cq_tail;
+        unsigned* cq_mask;
+        io_uring_cqe* cqes;
+
+        unsigned char supported_ops[IORING_OP_LAST];
+
+        void cleanup ();
+    };
+
+
+}
+#endif
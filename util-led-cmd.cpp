@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <util-led-cmd.hpp>
+#include <vector>
+#include <charconv>
+#include <system_error>
+#include <stdexcept>
+#include <cerrno>
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static void split (std::string_view line, std::vector<std::string_view>& tokens)
+{
+    tokens.clear ();
+    size_t pos = 0;
+    while (pos < line.size()) {
+        pos = line.find_first_not_of (" \t\r", pos);
+        if (pos == std::string_view::npos)
+            break;
+        size_t end = line.find_first_of (" \t\r", pos);
+        if (end == std::string_view::npos)
+            end = line.size ();
+        tokens.emplace_back (line.substr(pos, end-pos));
+        pos = end;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static unsigned parse_value (std::string_view str)
+{
+    unsigned value;
+    auto [ptr, ec] = std::from_chars (str.data(), str.data()+str.size(), value);
+    if (ec != std::errc()  ||  ptr != str.data()+str.size())
+        throw std::invalid_argument ("Invalid value: " + std::string(str));
+    return value;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static void throw_errno ()
+{
+    int errnum = errno;
+    throw std::system_error (errnum, std::generic_category());
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void format_status (ledpp::led& l, std::string& output)
+{
+    int br = l.brightness ();
+    int max_br = l.max_brightness ();
+    if (br < 0  ||  max_br < 0)
+        throw_errno ();
+    output = std::to_string (br);
+    output.push_back ('/');
+    output.append (std::to_string(max_br));
+
+    if (l.is_multicolor()) {
+        auto& names = l.color_names ();
+        unsigned values[64];
+        int num = l.read_color_intensity (values);
+        if (num < 0)
+            throw_errno ();
+        output.push_back ('\t');
+        for (int i=0; i<num && i<(int)names.size(); ++i) {
+            if (i)
+                output.push_back (',');
+            output.append (names[i]);
+            output.push_back (':');
+            output.append (std::to_string(values[i]));
+        }
+    }
+
+    auto t = l.read_trigger ();
+    if (!t.empty()  &&  t != "none") {
+        output.append ("\ttrigger:");
+        output.append (t);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void command_interpreter::open_all ()
+{
+    for (auto& name : ledpp::led::led_names()) {
+        try {
+            get_led (name);
+        }
+        catch (...) {
+            // Ignore, retried when used
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+ledpp::led& command_interpreter::get_led (std::string_view name)
+{
+    auto i = leds.find (name);
+    if (i != leds.end())
+        return i->second;
+    auto [j, inserted] = leds.emplace (std::piecewise_construct,
+                                       std::forward_as_tuple(name),
+                                       std::forward_as_tuple(std::string(name), ledpp::led::keep_open));
+    return j->second;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void command_interpreter::drop_led (std::string_view name)
+{
+    auto i = leds.find (name);
+    if (i != leds.end())
+        leds.erase (i);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+command_interpreter::status command_interpreter::execute (std::string_view line,
+                                                         std::string& output)
+{
+    split (line, args);
+    output.clear ();
+    if (args.empty()  ||  args[0][0] == '#')
+        return status::empty;
+
+    const auto cmd = args[0];
+    const size_t argc = args.size ();
+    try {
+        if (cmd == "get"  &&  argc == 2) {
+            format_status (get_led(args[1]), output);
+        }
+        else if ((cmd == "set" || cmd == "colors")  &&  argc >= 3) {
+            values.clear ();
+            for (size_t i=2; i<argc; ++i)
+                values.emplace_back (parse_value(args[i]));
+            auto& l = get_led (args[1]);
+            std::span<const unsigned> colors (values);
+            if (cmd == "set")
+                colors = colors.subspan (1);
+            if (!colors.empty()) {
+                if (colors.size() != l.color_names().size())
+                    throw std::invalid_argument ("Invalid number of color values");
+                if (l.color_intensity(colors))
+                    throw_errno ();
+            }
+            if (cmd == "set"  &&  l.brightness(values[0]))
+                throw_errno ();
+        }
+        else if (cmd == "trigger"  &&  argc == 3) {
+            if (get_led(args[1]).trigger(args[2]))
+                throw_errno ();
+        }
+        else if (cmd == "list"  &&  argc == 1) {
+            for (auto& name : ledpp::led::led_names()) {
+                if (!output.empty())
+                    output.push_back (' ');
+                output.append (name);
+            }
+        }
+        else {
+            throw std::invalid_argument ("Invalid command: " + std::string(line));
+        }
+    }
+    catch (std::system_error& e) {
+        // The LED may have been removed, look it up again next time
+        if (argc > 1  &&  (e.code().value() == ENODEV  ||  e.code().value() == ENOENT))
+            drop_led (args[1]);
+        output = e.what ();
+        return status::error;
+    }
+    catch (std::exception& e) {
+        output = e.what ();
+        return status::error;
+    }
+    return status::ok;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+command_interpreter::status command_interpreter::execute_reply (std::string_view line,
+                                                               std::string& replies)
+{
+    auto result = execute (line, output);
+    switch (result) {
+    case status::ok:
+        replies.append ("ok");
+        if (!output.empty()) {
+            replies.push_back (' ');
+            replies.append (output);
+        }
+        replies.push_back ('\n');
+        break;
+    case status::error:
+        replies.append ("error ");
+        replies.append (output);
+        replies.push_back ('\n');
+        break;
+    default:
+        break;
+    }
+    return result;
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef UTIL_LED_CMD_HPP
+#define UTIL_LED_CMD_HPP
+
+#include <led++.hpp>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+
+
+/**
+ * Format the brightness, color intensity, and trigger of a LED
+ * the same way as command "get" and the led utility show them.
+ * @throw std::system_error If the LED can't be read.
+ */
+void format_status (ledpp::led& l, std::string& output);
+
+
+/**
+ * Interpreter for the line based LED command language used
+ * by the led daemon and the led batch mode.
+ *
+ * Commands:
+ *   get NAME                       Reply: BRIGHTNESS/MAX [COLOR:VALUE,...] [trigger:TRIGGER]
+ *   set NAME BRIGHTNESS [COLOR...] Set color intensity values and brightness.
+ *   colors NAME COLOR...           Set color intensity values.
+ *   trigger NAME TRIGGER           Set the trigger.
+ *   list                           Reply: the names of all LEDs.
+ *
+ * Empty lines and lines starting with '#' are ignored.
+ * LED objects are created on first use and kept with their
+ * attribute files open.
+ */
+class command_interpreter {
+public:
+    /**
+     * The outcome of one command.
+     */
+    enum class status {
+        ok,     /**< Success, reply text in the output. */
+        error,  /**< Failure, error message in the output. */
+        empty,  /**< Empty line or comment, no reply. */
+    };
+
+    /**
+     * Open all LEDs currently in the system.
+     */
+    void open_all ();
+
+    /**
+     * Execute one command line.
+     * @param line The command, without line terminator.
+     * @param output Set to the reply text or error message.
+     */
+    status execute (std::string_view line, std::string& output);
+
+    /**
+     * Execute one command line and append the reply line to a buffer.
+     * The reply is "ok" followed by a space and the result of the
+     * command if there is one, or "error" followed by a space and an
+     * error message. Nothing is appended for empty lines and comments.
+     * @param line The command, without line terminator.
+     * @param replies The reply line, including the line
+     *                terminator, is appended to this.
+     */
+    status execute_reply (std::string_view line, std::string& replies);
+
+
+private:
+    std::map<std::string, ledpp::led, std::less<>> leds;
+    std::vector<std::string_view> args;
+    std::vector<unsigned> values;
+    std::string output;
+
+    ledpp::led& get_led (std::string_view name);
+    void drop_led (std::string_view name);
+};
+
+
+#endif
@@ -0,0 +1,366 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <util-led-daemon.hpp>
+#include <map>
+#include <system_error>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+
+
+// Clients sending longer lines than this are disconnected
+static constexpr size_t max_line_length = 4096;
+
+// Clients not reading more replies than this are disconnected
+static constexpr size_t max_output_length = 1024 * 1024;
+
+
+namespace {
+    struct client_t {
+        int fd;
+        bool want_output;
+        std::string in;
+        std::string out;
+    };
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static void throw_errno ()
+{
+    int errnum = errno;
+    throw std::system_error (errnum, std::generic_category());
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+std::string daemon_socket_path ()
+{
+    const char* path = getenv (socket_path_env);
+    if (path && *path)
+        return path;
+    return default_socket_path;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static bool make_address (const std::string& path, sockaddr_un& addr)
+{
+    memset (&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    memcpy (addr.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Return a connected socket, or -1 if no daemon is running.
+//------------------------------------------------------------------------------
+static int connect_daemon (const std::string& path)
+{
+    sockaddr_un addr;
+    if (!make_address(path, addr))
+        return -1;
+    int fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr))) {
+        close (fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static int create_socket (const std::string& path)
+{
+    sockaddr_un addr;
+    if (!make_address(path, addr))
+        throw_errno ();
+
+    int fd = connect_daemon (path);
+    if (fd >= 0) {
+        close (fd);
+        throw std::system_error (EADDRINUSE, std::generic_category(),
+                                 "A daemon is already running on " + path);
+    }
+    unlink (path.c_str()); // Remove a stale socket
+
+    fd = socket (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        throw_errno ();
+
+    // Let bind() create the socket file with the final mode, so
+    // no other user can connect before a chmod() restricts it
+    auto old_mask = umask (~socket_mode & 0777);
+    int result = bind (fd, (sockaddr*)&addr, sizeof(addr));
+    umask (old_mask);
+    if (result  ||  listen(fd, SOMAXCONN)) {
+        int errnum = errno;
+        close (fd);
+        throw std::system_error (errnum, std::generic_category(), path);
+    }
+    return fd;
+}
+
+
+//------------------------------------------------------------------------------
+// Execute all complete command lines received from a client. Empty
+// lines and comments get an "ok" reply too, since clients expect one
+// reply line per line sent.
+// Returns false if the client should be disconnected.
+//------------------------------------------------------------------------------
+static bool handle_input (command_interpreter& interpreter, client_t& client)
+{
+    size_t pos = 0;
+    while (true) {
+        auto end = client.in.find ('\n', pos);
+        if (end == std::string::npos)
+            break;
+        std::string_view line (client.in.data()+pos, end-pos);
+        if (interpreter.execute_reply(line, client.out) == command_interpreter::status::empty)
+            client.out.append ("ok\n");
+        pos = end + 1;
+    }
+    client.in.erase (0, pos);
+    return client.in.size() <= max_line_length;
+}
+
+
+//------------------------------------------------------------------------------
+// Send queued replies to a client. Returns false on error, or
+// if the client doesn't read its replies.
+//------------------------------------------------------------------------------
+static bool handle_output (client_t& client)
+{
+    size_t pos = 0;
+    while (pos < client.out.size()) {
+        ssize_t len = send (client.fd, client.out.data()+pos, client.out.size()-pos,
+                            MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN  ||  errno == EWOULDBLOCK)
+                break;
+            return false;
+        }
+        pos += len;
+    }
+    client.out.erase (0, pos);
+    return client.out.size() <= max_output_length;
+}
+
+
+//------------------------------------------------------------------------------
+// Wait for output space only while there are replies left to send.
+//------------------------------------------------------------------------------
+static void update_events (int epoll_fd, client_t& client)
+{
+    bool want_output = !client.out.empty ();
+    if (want_output == client.want_output)
+        return;
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    if (want_output)
+        ev.events |= EPOLLOUT;
+    ev.data.fd = client.fd;
+    epoll_ctl (epoll_fd, EPOLL_CTL_MOD, client.fd, &ev);
+    client.want_output = want_output;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void run_daemon (const std::string& path)
+{
+    command_interpreter interpreter;
+    interpreter.open_all ();
+
+    // Handle SIGINT and SIGTERM in the event loop
+    sigset_t sigmask;
+    sigemptyset (&sigmask);
+    sigaddset (&sigmask, SIGINT);
+    sigaddset (&sigmask, SIGTERM);
+    sigprocmask (SIG_BLOCK, &sigmask, nullptr);
+    int signal_fd = signalfd (-1, &sigmask, SFD_CLOEXEC);
+    if (signal_fd < 0)
+        throw_errno ();
+
+    int epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        int errnum = errno;
+        close (signal_fd);
+        throw std::system_error (errnum, std::generic_category());
+    }
+
+    int listen_fd;
+    try {
+        listen_fd = create_socket (path);
+    }
+    catch (...) {
+        close (epoll_fd);
+        close (signal_fd);
+        throw;
+    }
+
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = listen_fd;
+    epoll_ctl (epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+    ev.data.fd = signal_fd;
+    epoll_ctl (epoll_fd, EPOLL_CTL_ADD, signal_fd, &ev);
+
+    std::map<int, client_t> clients;
+    auto disconnect = [&](int fd) {
+        epoll_ctl (epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        close (fd);
+        clients.erase (fd);
+    };
+
+    bool quit = false;
+    while (!quit) {
+        epoll_event events[16];
+        int num = epoll_wait (epoll_fd, events, 16, -1);
+        if (num < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        for (int i=0; i<num; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == signal_fd) {
+                quit = true;
+                break;
+            }
+            if (fd == listen_fd) {
+                int client_fd = accept4 (listen_fd, nullptr, nullptr,
+                                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (client_fd < 0)
+                    continue;
+                auto& client = clients[client_fd];
+                client.fd = client_fd;
+                client.want_output = false;
+                ev.events = EPOLLIN;
+                ev.data.fd = client_fd;
+                epoll_ctl (epoll_fd, EPOLL_CTL_ADD, client_fd, &ev);
+                continue;
+            }
+
+            auto c = clients.find (fd);
+            if (c == clients.end())
+                continue;
+            auto& client = c->second;
+            bool ok = true;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                char buf[4096];
+                ssize_t len = recv (fd, buf, sizeof(buf), MSG_DONTWAIT);
+                if (len > 0) {
+                    client.in.append (buf, len);
+                    ok = handle_input (interpreter, client);
+                }else if (len == 0  ||  (errno != EAGAIN  &&  errno != EINTR)) {
+                    ok = false;
+                }
+            }
+            if (ok)
+                ok = handle_output (client);
+            if (ok)
+                update_events (epoll_fd, client);
+            else
+                disconnect (fd);
+        }
+    }
+
+    while (!clients.empty())
+        disconnect (clients.begin()->first);
+    close (listen_fd);
+    unlink (path.c_str());
+    close (epoll_fd);
+    close (signal_fd);
+    sigprocmask (SIG_UNBLOCK, &sigmask, nullptr);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool daemon_request (const std::string& path,
+                     const std::vector<std::string>& commands,
+                     std::vector<std::string>& replies)
+{
+    int fd = connect_daemon (path);
+    if (fd < 0)
+        return false;
+
+    std::string buf;
+    for (auto& cmd : commands) {
+        buf.append (cmd);
+        buf.push_back ('\n');
+    }
+
+    replies.clear ();
+    size_t pos = 0;
+    while (pos < buf.size()) {
+        ssize_t len = send (fd, buf.data()+pos, buf.size()-pos, MSG_NOSIGNAL);
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            int errnum = errno;
+            close (fd);
+            throw std::system_error (errnum, std::generic_category());
+        }
+        pos += len;
+    }
+
+    buf.clear ();
+    while (replies.size() < commands.size()) {
+        auto end = buf.find ('\n');
+        if (end != std::string::npos) {
+            replies.emplace_back (buf, 0, end);
+            buf.erase (0, end+1);
+            continue;
+        }
+        char tmp[4096];
+        ssize_t len = recv (fd, tmp, sizeof(tmp), 0);
+        if (len < 0  &&  errno == EINTR)
+            continue;
+        if (len <= 0) {
+            int errnum = len < 0 ? errno : ECONNRESET;
+            close (fd);
+            throw std::system_error (errnum, std::generic_category());
+        }
+        buf.append (tmp, len);
+    }
+    close (fd);
+    return true;
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef UTIL_LED_DAEMON_HPP
+#define UTIL_LED_DAEMON_HPP
+
+#include <util-led-cmd.hpp>
+#include <string>
+#include <vector>
+
+
+/**
+ * Default path of the led daemon socket.
+ */
+constexpr const char* default_socket_path = "/run/led.sock";
+
+/**
+ * File mode of the led daemon socket. Only the owner and the
+ * group of the daemon may connect to it.
+ */
+constexpr unsigned socket_mode = 0660;
+
+/**
+ * Name of the environment variable that, if set,
+ * overrides the default led daemon socket path.
+ */
+constexpr const char* socket_path_env = "LEDPP_SOCKET";
+
+/**
+ * Return the path of the led daemon socket.
+ */
+std::string daemon_socket_path ();
+
+/**
+ * Run the led daemon until it receives SIGINT or SIGTERM.
+ *
+ * Clients connect to a UNIX stream socket and send command lines
+ * as understood by class command_interpreter. Any number of
+ * commands can be sent at once. Each line, including empty lines
+ * and comments, gets a reply line in the same order, either "ok"
+ * followed by a space and the result of the command if there is
+ * one, or "error" followed by a space and an error message.
+ *
+ * The socket file gets mode socket_mode, so only the
+ * owner and the group of the daemon can use it.
+ *
+ * @param path The path of the socket.
+ * @throw std::system_error If the socket can't be created,
+ *                          or another daemon is running.
+ */
+void run_daemon (const std::string& path);
+
+/**
+ * Send commands to a running led daemon and wait for the replies.
+ * @param path The path of the daemon socket.
+ * @param commands The command lines.
+ * @param replies The reply of each command. Each reply starts
+ *                with "ok" or "error".
+ * @return <code>false</code> if no daemon is running,
+ *         otherwise <code>true</code>.
+ * @throw std::system_error If the communication with the daemon fails.
+ */
+bool daemon_request (const std::string& path,
+                     const std::vector<std::string>& commands,
+                     std::vector<std::string>& replies);
+
+
+#endif
@@ -0,0 +1,507 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <util-led-watch.hpp>
+#include <led_watcher.hpp>
+#include <iostream>
+#include <map>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <system_error>
+#include <cstdio>
+#include <cerrno>
+#include <csignal>
+#include <ctime>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+
+
+namespace {
+
+    enum column_t {
+        col_name = 0,
+        col_brightness,
+        col_trigger,
+        col_colors,
+        num_columns
+    };
+
+    struct row_t {
+        std::shared_ptr<ledpp::led> l;
+        int brightness;
+        int max_brightness;
+        std::string trigger;
+        std::vector<unsigned> intensity;
+        int num_colors;
+        std::string text[num_columns];
+        bool changed;
+    };
+
+    class monitor {
+    public:
+        monitor (const ledpp::led_registry::query& q, bool json);
+        void run (std::chrono::milliseconds interval);
+
+    private:
+        const ledpp::led_registry::query& q;
+        bool json;
+        bool redraw;
+        ledpp::led_registry registry;
+        ledpp::led_watcher watcher;
+        std::map<std::string, row_t, std::less<>> rows;
+        size_t widths[num_columns];
+        bool has_colors;
+        size_t drawn_lines;
+        bool full_redraw;
+        std::string out;
+        std::vector<unsigned> values;
+
+        bool selected (const ledpp::led_registry::entry& e) const;
+        void add (const std::string& name);
+        void remove (const std::string& name);
+        bool refresh (row_t& row);
+        void format (row_t& row);
+        void append_line (const std::string (&text)[num_columns]);
+        void append_json (const std::string& name, const row_t* row);
+        void draw ();
+    };
+}
+
+
+static const std::string header[num_columns] = {
+    "NAME", "CUR/MAX", "TRIGGER", "COLOR:VALUE[,COLOR:VALUE...]"
+};
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static void throw_errno ()
+{
+    int errnum = errno;
+    throw std::system_error (errnum, std::generic_category());
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static void append_json_string (std::string& out, std::string_view str)
+{
+    out.push_back ('"');
+    for (char c : str) {
+        if (c == '"'  ||  c == '\\') {
+            out.push_back ('\\');
+            out.push_back (c);
+        }
+        else if ((unsigned char)c < 0x20) {
+            char buf[8];
+            snprintf (buf, sizeof(buf), "\\u%04x", (unsigned)c);
+            out.append (buf);
+        }else{
+            out.push_back (c);
+        }
+    }
+    out.push_back ('"');
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+monitor::monitor (const ledpp::led_registry::query& q_arg, bool json_arg)
+    : q (q_arg),
+      json (json_arg),
+      redraw (!json_arg && isatty(fileno(stdout))),
+      registry (ledpp::led::keep_open),
+      has_colors (false),
+      drawn_lines (0),
+      full_redraw (true)
+{
+    std::fill (widths, widths+num_columns, 0);
+    for (auto e : registry.select(q))
+        add (e->name);
+
+    registry.subscribe ([this](const ledpp::led_registry::entry& e,
+                               ledpp::led_registry::event ev)
+        {
+            if (!selected(e))
+                return;
+            if (ev == ledpp::led_registry::event::added)
+                add (e.name);
+            else
+                remove (e.name);
+        });
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool monitor::selected (const ledpp::led_registry::entry& e) const
+{
+    return (q.device.empty()    ||  e.device == q.device)  &&
+           (q.color.empty()     ||  e.color == q.color)  &&
+           (q.function.empty()  ||  e.function == q.function);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void monitor::add (const std::string& name)
+{
+    auto l = registry.open (name);
+    if (!l)
+        return;
+    auto& row = rows[name];
+    row.l = l;
+    row.brightness = -2; // Not yet read
+    row.max_brightness = l->max_brightness ();
+    row.num_colors = -1;
+    row.intensity.resize (l->color_names().size());
+    row.text[col_name] = name;
+    row.changed = false;
+    refresh (row);
+
+    // Only use the watcher for LEDs with change notification,
+    // the others are read once per interval anyway
+    ledpp::led* target = l.get ();
+    if (watcher.add(*target, [this, name](ledpp::led&, int) {
+                auto r = rows.find (name);
+                if (r != rows.end())
+                    refresh (r->second);
+            }) == 0  &&  !watcher.notified(*target))
+    {
+        watcher.remove (*target);
+    }
+    full_redraw = true;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void monitor::remove (const std::string& name)
+{
+    auto r = rows.find (name);
+    if (r == rows.end())
+        return;
+    watcher.remove (*r->second.l);
+    rows.erase (r);
+    if (json)
+        append_json (name, nullptr);
+    full_redraw = true;
+}
+
+
+//------------------------------------------------------------------------------
+// Read the state of a LED. Returns true if it has changed.
+//------------------------------------------------------------------------------
+bool monitor::refresh (row_t& row)
+{
+    auto& l = *row.l;
+    bool changed = false;
+
+    if (row.max_brightness < 0  &&  (row.max_brightness = l.max_brightness()) >= 0)
+        changed = true;
+    int value = l.brightness ();
+    if (value != row.brightness) {
+        row.brightness = value;
+        changed = true;
+    }
+    auto trigger = l.read_trigger ();
+    if (trigger != row.trigger) {
+        row.trigger.assign (trigger);
+        changed = true;
+    }
+    if (!row.intensity.empty()) {
+        values.resize (row.intensity.size());
+        int num = l.read_color_intensity (values);
+        if (num != row.num_colors  ||
+            (num > 0  &&  !std::equal(values.begin(), values.begin()+num, row.intensity.begin())))
+        {
+            row.num_colors = num;
+            if (num > 0)
+                std::copy (values.begin(), values.begin()+num, row.intensity.begin());
+            changed = true;
+        }
+    }
+
+    if (changed) {
+        format (row);
+        row.changed = true;
+    }
+    return changed;
+}
+
+
+//------------------------------------------------------------------------------
+// Format the columns of a row the same way as lsled does.
+//------------------------------------------------------------------------------
+void monitor::format (row_t& row)
+{
+    auto& txt = row.text[col_brightness];
+    txt = row.brightness >= 0 ? std::to_string(row.brightness) : "-";
+    txt.push_back ('/');
+    txt.append (row.max_brightness >= 0 ? std::to_string(row.max_brightness) : "-");
+
+    row.text[col_trigger] = row.trigger.empty() ? "-" : row.trigger;
+
+    auto& colors = row.text[col_colors];
+    colors.clear ();
+    auto& names = row.l->color_names ();
+    for (size_t c=0; c<names.size(); ++c) {
+        if (c)
+            colors.push_back (',');
+        colors.append (names[c]);
+        colors.push_back (':');
+        if ((int)c < row.num_colors)
+            colors.append (std::to_string(row.intensity[c]));
+        else
+            colors.push_back ('-');
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void monitor::append_line (const std::string (&text)[num_columns])
+{
+    auto field = [this](const std::string& str, size_t width) {
+        out.append (str);
+        if (str.size() < width)
+            out.append (width - str.size(), ' ');
+    };
+    field (text[col_name], widths[col_name]);
+    out.push_back (' ');
+    if (text[col_colors].empty()  ||  !has_colors) {
+        out.append (text[col_brightness]);
+        if (!text[col_trigger].empty()) {
+            out.append (widths[col_brightness] - text[col_brightness].size() + 1, ' ');
+            out.append (text[col_trigger]);
+        }
+    }else{
+        field (text[col_brightness], widths[col_brightness]);
+        out.push_back (' ');
+        field (text[col_trigger], widths[col_trigger]);
+        out.push_back (' ');
+        out.append (text[col_colors]);
+    }
+    if (redraw)
+        out.append ("\033[K"); // Clear the rest of the old line
+    out.push_back ('\n');
+}
+
+
+//------------------------------------------------------------------------------
+// Print a LED as a JSON object, or that it was removed if row is null.
+//------------------------------------------------------------------------------
+void monitor::append_json (const std::string& name, const row_t* row)
+{
+    timespec ts;
+    clock_gettime (CLOCK_REALTIME, &ts);
+    char time_buf[32];
+    snprintf (time_buf, sizeof(time_buf), "%lld.%03ld", (long long)ts.tv_sec, ts.tv_nsec/1000000);
+
+    out.append ("{\"time\":");
+    out.append (time_buf);
+    out.append (",\"name\":");
+    append_json_string (out, name);
+    if (!row) {
+        out.append (",\"removed\":true}\n");
+        return;
+    }
+    out.append (",\"brightness\":");
+    out.append (row->brightness >= 0 ? std::to_string(row->brightness) : "null");
+    out.append (",\"max_brightness\":");
+    out.append (row->max_brightness >= 0 ? std::to_string(row->max_brightness) : "null");
+    out.append (",\"trigger\":");
+    if (row->trigger.empty())
+        out.append ("null");
+    else
+        append_json_string (out, row->trigger);
+    auto& names = row->l->color_names ();
+    if (!names.empty()) {
+        out.append (",\"colors\":{");
+        for (size_t c=0; c<names.size(); ++c) {
+            if (c)
+                out.push_back (',');
+            append_json_string (out, names[c]);
+            out.push_back (':');
+            out.append ((int)c < row->num_colors ? std::to_string(row->intensity[c]) : "null");
+        }
+        out.push_back ('}');
+    }
+    out.append ("}\n");
+}
+
+
+//------------------------------------------------------------------------------
+// Print the changed rows, or the whole table if the layout has changed.
+//------------------------------------------------------------------------------
+void monitor::draw ()
+{
+    if (json) {
+        for (auto& [name, row] : rows) {
+            if (row.changed)
+                append_json (name, &row);
+            row.changed = false;
+        }
+    }else{
+        // The table is redrawn if a column has to get wider or narrower
+        size_t new_widths[num_columns];
+        bool new_has_colors = false;
+        for (int c=0; c<num_columns; ++c)
+            new_widths[c] = header[c].size ();
+        for (auto& [name, row] : rows) {
+            for (int c=0; c<num_columns; ++c)
+                new_widths[c] = std::max (new_widths[c], row.text[c].size());
+            new_has_colors |= !row.text[col_colors].empty ();
+        }
+        if (new_has_colors != has_colors  ||  !std::equal(new_widths, new_widths+num_columns, widths))
+            full_redraw = true;
+        std::copy (new_widths, new_widths+num_columns, widths);
+        has_colors = new_has_colors;
+
+        if (full_redraw  ||  !redraw) {
+            if (redraw  &&  drawn_lines)
+                out.append ("\033[" + std::to_string(drawn_lines) + "A\r\033[J");
+            if (redraw  ||  drawn_lines == 0)
+                append_line (header);
+            for (auto& [name, row] : rows) {
+                if (row.changed  ||  redraw)
+                    append_line (row.text);
+                row.changed = false;
+            }
+            drawn_lines = rows.size () + 1;
+        }else{
+            // Move up to each changed row, and back down below the table
+            size_t line = 1;
+            for (auto& [name, row] : rows) {
+                if (row.changed) {
+                    auto up = std::to_string (drawn_lines - line);
+                    out.append ("\033[" + up + "A\r");
+                    append_line (row.text);
+                    // The newline moved the cursor down one line
+                    if (drawn_lines - line > 1)
+                        out.append ("\033[" + std::to_string(drawn_lines - line - 1) + "B");
+                    row.changed = false;
+                }
+                ++line;
+            }
+        }
+        full_redraw = false;
+    }
+
+    if (!out.empty()) {
+        std::cout.write (out.data(), out.size());
+        std::cout.flush ();
+        out.clear ();
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void monitor::run (std::chrono::milliseconds interval)
+{
+    // Handle SIGINT and SIGTERM in the event loop
+    sigset_t sigmask;
+    sigemptyset (&sigmask);
+    sigaddset (&sigmask, SIGINT);
+    sigaddset (&sigmask, SIGTERM);
+    sigprocmask (SIG_BLOCK, &sigmask, nullptr);
+
+    int signal_fd = signalfd (-1, &sigmask, SFD_CLOEXEC);
+    int timer_fd = timerfd_create (CLOCK_MONOTONIC, TFD_CLOEXEC);
+    int epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+    if (signal_fd < 0  ||  timer_fd < 0  ||  epoll_fd < 0) {
+        int errnum = errno;
+        for (int fd : {signal_fd, timer_fd, epoll_fd}) {
+            if (fd >= 0)
+                close (fd);
+        }
+        sigprocmask (SIG_UNBLOCK, &sigmask, nullptr);
+        errno = errnum;
+        throw_errno ();
+    }
+
+    itimerspec its;
+    its.it_value.tv_sec = interval.count() / 1000;
+    its.it_value.tv_nsec = (interval.count() % 1000) * 1000000;
+    its.it_interval = its.it_value;
+    timerfd_settime (timer_fd, 0, &its, nullptr);
+
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    for (int fd : {signal_fd, timer_fd, registry.fd(), watcher.fd()}) {
+        ev.data.fd = fd;
+        epoll_ctl (epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    if (redraw)
+        std::cout << "\033[?25l"; // Hide the cursor
+    draw ();
+
+    bool quit = false;
+    while (!quit) {
+        epoll_event events[4];
+        int num = epoll_wait (epoll_fd, events, 4, -1);
+        if (num < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        for (int i=0; i<num; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == signal_fd) {
+                quit = true;
+            }
+            else if (fd == timer_fd) {
+                uint64_t expirations;
+                [[maybe_unused]] auto result = read (timer_fd, &expirations, sizeof(expirations));
+                for (auto& [name, row] : rows)
+                    refresh (row);
+            }
+            else if (fd == registry.fd()) {
+                registry.run_once (0);
+            }
+            else if (fd == watcher.fd()) {
+                watcher.run_once (0);
+            }
+        }
+        if (!quit)
+            draw ();
+    }
+
+    if (redraw)
+        std::cout << "\033[?25h" << std::flush; // Show the cursor
+    close (epoll_fd);
+    close (timer_fd);
+    close (signal_fd);
+    sigprocmask (SIG_UNBLOCK, &sigmask, nullptr);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void watch_leds (const ledpp::led_registry::query& q,
+                 std::chrono::milliseconds interval,
+                 bool json)
+{
+    monitor m (q, json);
+    m.run (interval);
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2024,2025 Dan Arrhenius <dan@ultramarin.se>
+ *
+ * This file is part of led++.
+ *
+ * led++ is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef UTIL_LED_WATCH_HPP
+#define UTIL_LED_WATCH_HPP
+
+#include <led_registry.hpp>
+#include <chrono>
+
+
+/**
+ * Show the state of LEDs and update it as it changes,
+ * until SIGINT or SIGTERM is received.
+ *
+ * All LEDs are kept open. LEDs with brightness change notification
+ * are updated when notified, and all LEDs are read again once per
+ * interval. When standard output is a terminal, only the rows that
+ * changed are redrawn. Otherwise, a line is printed for each LED
+ * that changed. LEDs added or removed while watching are shown.
+ *
+ * @param q The LEDs to watch.
+ * @param interval The time between reads of all LEDs.
+ * @param json If <code>true</code>, print one JSON object per line
+ *             for each change instead of a table.
+ * @throw std::system_error If the LEDs can't be watched.
+ */
+void watch_leds (const ledpp::led_registry::query& q,
+                 std::chrono::milliseconds interval,
+                 bool json);
+
+
+#endif
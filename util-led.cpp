@@ -20,15 +20,26 @@
 #include <iomanip>
 #include <string>
 #include <sstream>
+#include <fstream>
 #include <vector>
 #include <map>
+#include <algorithm>
 #include <cstring>
 #include <cstdlib>
 #include <cstdint>
+#include <climits>
 #include <cerrno>
+#include <csignal>
 #include <unistd.h>
+#include <sched.h>
 #include <getopt.h>
 #include <led++.hpp>
+#include <led_stats.hpp>
+#include <led_registry.hpp>
+#include <effect_engine.hpp>
+#include <led_timeline.hpp>
+#include <util-led-daemon.hpp>
+#include <util-led-watch.hpp>
 
 using std::cin;
 using std::cout;
@@ -42,13 +53,34 @@ using std::endl;
 struct appargs_t {
     std::string led_name;
     std::string trigger;
+    std::string effect;
+    std::string batch_file;
+    std::string play_file;
+    std::string save_file;
+    std::string restore_file;
+    std::string convert_in;
+    std::string convert_out;
+    unsigned play_loops;
+    int play_fifo;
+    int play_cpu;
+    std::string filter_device;
+    std::string filter_color;
+    std::string filter_function;
     int brightness;
+    double watch_interval;
     std::vector<unsigned> colors;
     bool list;
     bool list_triggers;
     bool names_only;
     bool show_info;
     bool set_only_colors;
+    bool daemon;
+    bool batch;
+    bool stats;
+    bool list_stats;
+    bool convert;
+    bool watch;
+    bool json;
 
     appargs_t (int argc, char* argv[]);
     void print_usage ();
@@ -57,9 +89,21 @@ struct appargs_t {
     void parse_lsled_arguments (int argc, char* argv[]);
 };
 
+// Long options without a short option
+enum {
+    opt_loops = 256,
+    opt_fifo,
+    opt_cpu,
+    opt_save,
+    opt_restore,
+};
+
 static const char* fn_normal = "";
 static const char* fn_bold = "";
 
+// The player stopped by SIGINT and SIGTERM
+static ledpp::timeline_player* active_player = nullptr;
+
 
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
@@ -83,8 +127,57 @@ void appargs_t::print_usage ()
     cout << "  -i, --info             Print detailed information about the LED." << endl;
     cout << "  -c, --colors           Set only color values. This assumes all arguments after LED_NAME are color intensity values." << endl;
     cout << "  -t, --trigger=TRIGGER  Set a trigger for the LED." << endl;
+    cout << "  -e, --effect=EFFECT    Run a brightness effect on the LED until it has finished." << endl;
+    cout << "  -b, --batch            Read commands from standard input and write a reply line for" << endl;
+    cout << "                         each command to standard output. Failed commands don't stop" << endl;
+    cout << "                         the batch, but the exit status is 1 if any command failed." << endl;
+    cout << "  -f, --file=FILE        Like option --batch, but read the commands from FILE." << endl;
+    cout << "  -D, --daemon           Run as a daemon that keeps all LEDs open and executes commands" << endl;
+    cout << "                         received on a UNIX socket. When the daemon is running, the led" << endl;
+    cout << "                         utility forwards requests to read or set a LED to the daemon." << endl;
+    cout << "  -s, --stats            Collect I/O statistics of each LED and attribute, and print them" << endl;
+    cout << "                         to standard error before exiting. Percentiles are rounded up to" << endl;
+    cout << "                         a power of two nanoseconds. With --play, also print the frame" << endl;
+    cout << "                         lateness statistics." << endl;
+    cout << "  -p, --play=FILE        Play a binary timeline file on the LEDs named in it." << endl;
+    cout << "      --loops=COUNT      Play the timeline COUNT times, 0 means until interrupted. Default 1." << endl;
+    cout << "      --fifo=PRIORITY    Play using real-time scheduling policy SCHED_FIFO with PRIORITY 1-99." << endl;
+    cout << "      --cpu=CPU          Play on CPU number CPU only." << endl;
+    cout << "  -C, --convert          Convert a text timeline to a binary timeline file." << endl;
+    cout << "                         Arguments: TEXT_FILE BINARY_FILE" << endl;
+    cout << "      --save=FILE        Save the trigger, brightness, and color intensity of all LEDs to FILE." << endl;
+    cout << "      --restore=FILE     Restore the state saved by --save. Only values that differ from the" << endl;
+    cout << "                         current state are written. The brightness is only restored for LEDs" << endl;
+    cout << "                         with trigger none." << endl;
     cout << "  -h, --help             Print this help message." << endl;
     cout << endl;
+    cout << fn_bold << "Effects:" << fn_normal << endl;
+    cout << "  fade:TARGET:MS[:EASING]           Fade to brightness TARGET in MS milliseconds." << endl;
+    cout << "  ramp:FROM:TO:MS[:COUNT[:EASING]]  Ramp brightness from FROM to TO in MS milliseconds, COUNT times." << endl;
+    cout << "  breathe:LOW:HIGH:MS[:COUNT]       Pulse brightness between LOW and HIGH, MS milliseconds per cycle, COUNT times." << endl;
+    cout << "  blink:MS:DUTY[:COUNT]             Blink with a period of MS milliseconds, on for DUTY percent of the period, COUNT times." << endl;
+    cout << "  EASING is one of: linear, in, out, in-out. A COUNT of 0 means repeat until interrupted." << endl;
+    cout << "  Endless blink and breathe effects are run by the kernel if the LED has the timer or" << endl;
+    cout << "  pattern trigger. Then led exits at once, and the effect runs until another trigger is set." << endl;
+    cout << endl;
+    cout << fn_bold << "Batch and daemon commands:" << fn_normal << endl;
+    cout << "  get NAME                                  Reply with the brightness, color intensity, and trigger." << endl;
+    cout << "  set NAME BRIGHTNESS [COLOR_INTENSITY...]  Set the brightness, and optionally the color intensity." << endl;
+    cout << "  colors NAME COLOR_INTENSITY...            Set the color intensity." << endl;
+    cout << "  trigger NAME TRIGGER                      Set the trigger." << endl;
+    cout << "  list                                      Reply with the names of all LEDs." << endl;
+    cout << "  Each command line gets one reply line starting with \"ok\" or \"error\"." << endl;
+    cout << "  Empty lines and lines starting with '#' are ignored, the daemon replies \"ok\" to them." << endl;
+    cout << "  The socket is " << default_socket_path << " unless environment variable " << socket_path_env << " is set." << endl;
+    cout << endl;
+    cout << fn_bold << "Text timelines:" << fn_normal << endl;
+    cout << "  interval MS          Time between frames, default 10." << endl;
+    cout << "  led NAME             Start the keyframes of a LED." << endl;
+    cout << "  TIME VALUE [MODE]    A keyframe at TIME milliseconds. VALUE is a brightness, or a percentage" << endl;
+    cout << "                       of max brightness like 50%. MODE is how the brightness changes until" << endl;
+    cout << "                       the next keyframe: step, linear, in, out, or in-out. Default linear." << endl;
+    cout << "  Text after '#' is ignored." << endl;
+    cout << endl;
 }
 
 
@@ -96,11 +189,34 @@ void appargs_t::parse_arguments (int argc, char* argv[])
         { "list",    no_argument, 0, 'l'},
         { "info",    no_argument, 0, 'i'},
         { "colors",  no_argument, 0, 'c'},
-        { "trigger", no_argument, 0, 't'},
+        { "trigger", required_argument, 0, 't'},
+        { "effect",  required_argument, 0, 'e'},
+        { "batch",   no_argument, 0, 'b'},
+        { "file",    required_argument, 0, 'f'},
+        { "daemon",  no_argument, 0, 'D'},
+        { "stats",   no_argument, 0, 's'},
+        { "play",    required_argument, 0, 'p'},
+        { "loops",   required_argument, 0, opt_loops},
+        { "fifo",    required_argument, 0, opt_fifo},
+        { "cpu",     required_argument, 0, opt_cpu},
+        { "convert", no_argument, 0, 'C'},
+        { "save",    required_argument, 0, opt_save},
+        { "restore", required_argument, 0, opt_restore},
         { "help",    no_argument, 0, 'h'},
         { 0, 0, 0, 0}
     };
-    static const char* arg_format = "lict:h";
+    static const char* arg_format = "lict:e:bf:Dsp:Ch";
+
+    auto number = [](const char* arg, long min, long max) {
+        char* end;
+        errno = 0;
+        long value = strtol (arg, &end, 10);
+        if (errno  ||  end == arg  ||  *end != '\0'  ||  value < min  ||  value > max) {
+            cerr << "Error: Invalid argument: " << arg << endl;
+            exit (1);
+        }
+        return value;
+    };
 
     while (1) {
         int c = getopt_long (argc, argv, arg_format, long_options, NULL);
@@ -119,6 +235,43 @@ void appargs_t::parse_arguments (int argc, char* argv[])
         case 't':
             trigger = optarg;
             break;
+        case 'e':
+            effect = optarg;
+            break;
+        case 'b':
+            batch = true;
+            break;
+        case 'f':
+            batch = true;
+            batch_file = optarg;
+            break;
+        case 'D':
+            daemon = true;
+            break;
+        case 's':
+            stats = true;
+            break;
+        case 'p':
+            play_file = optarg;
+            break;
+        case opt_loops:
+            play_loops = number (optarg, 0, UINT_MAX);
+            break;
+        case opt_fifo:
+            play_fifo = number (optarg, 1, 99);
+            break;
+        case opt_cpu:
+            play_cpu = number (optarg, 0, CPU_SETSIZE-1);
+            break;
+        case 'C':
+            convert = true;
+            break;
+        case opt_save:
+            save_file = optarg;
+            break;
+        case opt_restore:
+            restore_file = optarg;
+            break;
         case 'h':
             print_usage ();
             exit (0);
@@ -129,7 +282,16 @@ void appargs_t::parse_arguments (int argc, char* argv[])
         }
     }
 
-    if (list) {
+    if (convert) {
+        if (argc - optind != 2) {
+            cerr << "Error: Expected arguments TEXT_FILE BINARY_FILE, use option -h for help." << endl;
+            exit (1);
+        }
+        convert_in = argv[optind++];
+        convert_out = argv[optind++];
+        return;
+    }
+    if (list || daemon || batch || !play_file.empty() || !save_file.empty() || !restore_file.empty()) {
         if (optind < argc) {
             cerr << "Error: Too many arguments, use option -h for help." << endl;
             exit (1);
@@ -143,7 +305,7 @@ void appargs_t::parse_arguments (int argc, char* argv[])
 
     led_name = argv[optind++];
 
-    if (show_info) {
+    if (show_info || !effect.empty()) {
         if (optind < argc) {
             cerr << "Error: Too many arguments, use option -h for help." << endl;
             exit (1);
@@ -186,9 +348,19 @@ void appargs_t::print_lsled_usage ()
     cout << "  List information about available LEDs." << endl;
     cout << endl;
     cout << fn_bold << "Options:" << fn_normal << endl;
-    cout << "  -n, --names     Print only the names of the available LEDs." << endl;
-    cout << "  -t, --triggers  List available triggers for the specified LED." << endl;
-    cout << "  -h, --help      Print this help message." << endl;
+    cout << "  -n, --names              Print only the names of the available LEDs." << endl;
+    cout << "  -t, --triggers           List available triggers for the specified LED." << endl;
+    cout << "  -s, --stats              Read all LEDs once and show the I/O statistics of each LED." << endl;
+    cout << "  -d, --device=DEVICE      Only list LEDs with this device name." << endl;
+    cout << "  -c, --color=COLOR        Only list LEDs with this color." << endl;
+    cout << "  -f, --function=FUNCTION  Only list LEDs with this function." << endl;
+    cout << "                           LED names are parsed as DEVICE:COLOR:FUNCTION." << endl;
+    cout << "  -w, --watch[=SECONDS]    Keep showing the LEDs, and update the rows that change." << endl;
+    cout << "                           All LEDs are read again every SECONDS, default 1." << endl;
+    cout << "                           LEDs added or removed while watching are shown." << endl;
+    cout << "  -j, --json               With --watch, print a JSON object per line for each LED" << endl;
+    cout << "                           when it is first seen, changes, or is removed." << endl;
+    cout << "  -h, --help               Print this help message." << endl;
     cout << endl;
 }
 
@@ -200,10 +372,16 @@ void appargs_t::parse_lsled_arguments (int argc, char* argv[])
     static struct option long_options[] = {
         { "names",    no_argument, 0, 'n'},
         { "triggers", no_argument, 0, 't'},
+        { "stats",    no_argument, 0, 's'},
+        { "device",   required_argument, 0, 'd'},
+        { "color",    required_argument, 0, 'c'},
+        { "function", required_argument, 0, 'f'},
+        { "watch",    optional_argument, 0, 'w'},
+        { "json",     no_argument, 0, 'j'},
         { "help",     no_argument, 0, 'h'},
         { 0, 0, 0, 0}
     };
-    static const char* arg_format = "nth";
+    static const char* arg_format = "ntsd:c:f:w::jh";
 
     while (1) {
         int c = getopt_long (argc, argv, arg_format, long_options, NULL);
@@ -216,6 +394,36 @@ void appargs_t::parse_lsled_arguments (int argc, char* argv[])
         case 't':
             list_triggers = true;
             break;
+        case 's':
+            list_stats = true;
+            break;
+        case 'd':
+            filter_device = optarg;
+            break;
+        case 'c':
+            filter_color = optarg;
+            break;
+        case 'f':
+            filter_function = optarg;
+            break;
+        case 'w':
+            watch = true;
+            if (optarg) {
+                try {
+                    watch_interval = std::stod (optarg);
+                }
+                catch (...) {
+                    watch_interval = 0;
+                }
+                if (!(watch_interval >= 0.01  &&  watch_interval <= 86400)) {
+                    cerr << "Error: Invalid interval." << endl;
+                    exit (1);
+                }
+            }
+            break;
+        case 'j':
+            json = true;
+            break;
         case 'h':
             print_lsled_usage ();
             exit (0);
@@ -233,6 +441,19 @@ void appargs_t::parse_lsled_arguments (int argc, char* argv[])
             exit (1);
         }
     }
+    if (json && !watch) {
+        cerr << "Error: Option --json requires option --watch." << endl;
+        exit (1);
+    }
+    if (watch && !list_triggers && optind < argc) {
+        // Also accept the interval as a separate argument
+        char* end;
+        watch_interval = strtod (argv[optind++], &end);
+        if (*end != '\0'  ||  !(watch_interval >= 0.01  &&  watch_interval <= 86400)) {
+            cerr << "Error: Invalid interval." << endl;
+            exit (1);
+        }
+    }
     if (optind < argc) {
         cerr << "Error: Too many arguments, use option -h for help." << endl;
         exit (1);
@@ -245,12 +466,23 @@ void appargs_t::parse_lsled_arguments (int argc, char* argv[])
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
 appargs_t::appargs_t (int argc, char* argv[])
-    : brightness (-1),
+    : play_loops (1),
+      play_fifo (0),
+      play_cpu (-1),
+      brightness (-1),
+      watch_interval (1.0),
       list (false),
       list_triggers (false),
       names_only (false),
       show_info (false),
-      set_only_colors (false)
+      set_only_colors (false),
+      daemon (false),
+      batch (false),
+      stats (false),
+      list_stats (false),
+      convert (false),
+      watch (false),
+      json (false)
 {
     if (std::string(program_invocation_short_name) == "lsled")
         parse_lsled_arguments (argc, argv);
@@ -284,9 +516,40 @@ static void show_field (const std::string& str, unsigned col_size, bool align_ri
 }
 
 
+//------------------------------------------------------------------------------
+// Return the LED selection of the lsled filter options.
+//------------------------------------------------------------------------------
+static ledpp::led_registry::query led_query (appargs_t& opt)
+{
+    ledpp::led_registry::query q;
+    q.device = opt.filter_device;
+    q.color = opt.filter_color;
+    q.function = opt.filter_function;
+    return q;
+}
+
+
+//------------------------------------------------------------------------------
+// Return the names of the LEDs selected by the lsled filter options.
+//------------------------------------------------------------------------------
+static std::vector<std::string> selected_leds (appargs_t& opt)
+{
+    if (opt.filter_device.empty() && opt.filter_color.empty() && opt.filter_function.empty()) {
+        auto names = ledpp::led::led_names ();
+        return std::vector<std::string> (names.begin(), names.end());
+    }
+
+    ledpp::led_registry registry;
+    std::vector<std::string> names;
+    for (auto e : registry.select(led_query(opt)))
+        names.emplace_back (e->name);
+    return names;
+}
+
+
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
-static void list_leds ()
+static void list_leds (std::vector<std::string> names)
 {
     std::vector<std::string> led_names;
     std::vector<std::string> br_txt;
@@ -305,23 +568,22 @@ static void list_leds ()
     add_field ("COLOR:VALUE[,COLOR:VALUE...]", len_colors, colors);
     ++num_lines;
 
-    auto leds = ledpp::led::led_names ();
-    for (auto& name : leds) {
-        ledpp::led led (name);
+    auto snapshot = ledpp::led::snapshot (std::move(names), ledpp::led::leds_dir());
+    for (size_t i=0; i<snapshot.size(); ++i) {
         std::string txt;
         int value;
 
         // Name
-        add_field (led.name(), len_led_name, led_names);
+        add_field (snapshot.names[i], len_led_name, led_names);
 
         // Brightness / Max brightness
-        value = led.brightness ();
+        value = snapshot.brightness[i];
         if (value >= 0)
             txt = std::to_string (value);
         else
             txt = "-";
         txt.push_back ('/');
-        value = led.max_brightness ();
+        value = snapshot.max_brightness[i];
         if (value >= 0)
             txt.append (std::to_string(value));
         else
@@ -329,31 +591,28 @@ static void list_leds ()
         add_field (txt, len_br_txt, br_txt);
 
         // Trigger
-        txt = led.trigger ();
-        if (txt.empty())
+        if (snapshot.trigger[i] < 0)
             add_field ("-", len_trigger_names, trigger_names);
         else
-            add_field (txt, len_trigger_names, trigger_names);
+            add_field (std::string(ledpp::trigger_registry::name(snapshot.trigger[i])),
+                       len_trigger_names, trigger_names);
 
         // Colors
-        auto c_names = led.color_names ();
-        auto c_values = led.color_intensity ();
         txt.clear ();
-        if (!c_names.empty() && c_names.size() == c_values.size()) {
+        if (snapshot.num_colors(i)) {
             has_colors = true;
-            for (unsigned c=0; c<c_names.size(); ++c) {
-                if (c)
+            for (unsigned c=snapshot.color_offset[i]; c<snapshot.color_offset[i+1]; ++c) {
+                if (c != snapshot.color_offset[i])
                     txt.push_back (',');
-                txt.append (c_names[c]);
+                txt.append (snapshot.color_names[c]);
                 txt.push_back (':');
-                txt.append (std::to_string(c_values[c]));
+                if (snapshot.color_intensity[c] >= 0)
+                    txt.append (std::to_string(snapshot.color_intensity[c]));
+                else
+                    txt.push_back ('-');
             }
-            add_field (txt, len_colors, colors);
-        }else{
-            if (c_names.size() != c_values.size())
-                ; // WTF !?!
-            add_field ("", len_colors, colors);
         }
+        add_field (txt, len_colors, colors);
 
         ++num_lines;
     }
@@ -383,6 +642,70 @@ static void list_leds ()
 }
 
 
+//------------------------------------------------------------------------------
+// Print the collected I/O statistics, either one line per LED,
+// or one line per LED and operation.
+//------------------------------------------------------------------------------
+static void print_stats (std::ostream& out, bool per_operation)
+{
+    auto stats = ledpp::io_stats::get ();
+    size_t name_len = 4;
+    for (auto& s : stats)
+        name_len = std::max (name_len, s.name.size());
+
+    out << std::left << std::setw(name_len) << "NAME";
+    if (per_operation)
+        out << std::setw(22) << " OPERATION";
+    out << std::right
+        << std::setw(8) << "COUNT"
+        << std::setw(8) << "BYTES"
+        << std::setw(7) << "ERRORS"
+        << std::setw(10) << "MEAN ns"
+        << std::setw(10) << "P50 ns"
+        << std::setw(10) << "P99 ns"
+        << std::setw(10) << "MAX ns"
+        << endl;
+
+    auto row = [&](const std::string& name, const std::string& what, const ledpp::io_counters& c) {
+        if (c.ops == 0)
+            return;
+        out << std::left << std::setw(name_len) << name;
+        if (per_operation)
+            out << ' ' << std::setw(21) << what;
+        out << std::right
+            << std::setw(8) << c.ops
+            << std::setw(8) << c.bytes
+            << std::setw(7) << c.errors
+            << std::setw(10) << c.mean_ns()
+            << std::setw(10) << c.percentile_ns(50)
+            << std::setw(10) << c.percentile_ns(99)
+            << std::setw(10) << c.max_ns
+            << endl;
+    };
+
+    for (auto& s : stats) {
+        if (!per_operation) {
+            row (s.name, "", s.total());
+            continue;
+        }
+        row (s.name, "open", s.open);
+        for (unsigned a=0; a<ledpp::led_io_stats::num_attributes; ++a) {
+            std::string attr = ledpp::led_io_stats::attribute_name ((ledpp::led_io_stats::attribute)a);
+            row (s.name, "read " + attr, s.read[a]);
+            row (s.name, "write " + attr, s.write[a]);
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static void print_stats_at_exit ()
+{
+    print_stats (cerr, true);
+}
+
+
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
 static void print_led_info (appargs_t& opt)
@@ -393,7 +716,7 @@ static void print_led_info (appargs_t& opt)
     unsigned w = max_br_str.size ();
 
     cout << "Name          : " << led.name() << endl;
-    cout << "Location      : " << "/sys/class/leds/" << led.name() << endl;
+    cout << "Location      : " << (ledpp::led::leds_dir() / led.name()).string() << endl;
     cout << "Brightness    : " << std::setw(w) << led.brightness() << endl;
     cout << "Max brightness: " << max_br_str << endl;
     cout << "Multicolor    : ";
@@ -418,8 +741,8 @@ static void print_led_info (appargs_t& opt)
 
     cout << "Triggers      : ";
     int i = 0;
-    auto active_trigger = led.trigger ();
-    for (auto& trigger : led.triggers()) {
+    auto active_trigger = ledpp::trigger_registry::name (led.active_trigger()); // Parses the trigger list once
+    for (auto& trigger : led.triggers()) { // Uses the cached trigger list
         if (i++)
             cout << ' ';
         if (trigger == active_trigger)
@@ -431,6 +754,238 @@ static void print_led_info (appargs_t& opt)
 }
 
 
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static ledpp::effect_engine::easing parse_easing (const std::string& name)
+{
+    if (name == "linear")
+        return ledpp::effect_engine::easing::linear;
+    else if (name == "in")
+        return ledpp::effect_engine::easing::ease_in;
+    else if (name == "out")
+        return ledpp::effect_engine::easing::ease_out;
+    else if (name == "in-out")
+        return ledpp::effect_engine::easing::ease_in_out;
+    throw std::invalid_argument ("Invalid easing: " + name);
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static void run_effect (appargs_t& opt)
+{
+    std::vector<std::string> args;
+    std::stringstream ss (opt.effect);
+    std::string arg;
+    while (std::getline(ss, arg, ':'))
+        args.emplace_back (arg);
+
+    auto num = [&args](size_t i, unsigned default_value) -> unsigned {
+        if (i >= args.size())
+            return default_value;
+        size_t pos;
+        unsigned long value = std::stoul (args[i], &pos);
+        if (pos != args[i].size())
+            throw std::invalid_argument ("Invalid effect argument: " + args[i]);
+        return value;
+    };
+    auto ms = [&num](size_t i) {
+        return std::chrono::milliseconds (num(i, 0));
+    };
+
+    ledpp::led led (opt.led_name, ledpp::led::keep_open);
+    ledpp::effect_engine engine;
+    int errnum = 0;
+    engine.on_error ([&errnum](ledpp::led&, int e){ errnum = e; });
+
+    const std::string type = args.empty() ? "" : args[0];
+    if (type == "fade"  &&  args.size() >= 3  &&  args.size() <= 4) {
+        auto curve = args.size() > 3 ? parse_easing(args[3]) : ledpp::effect_engine::easing::linear;
+        engine.fade_to (led, num(1, 0), ms(2), curve);
+    }
+    else if (type == "ramp"  &&  args.size() >= 4  &&  args.size() <= 6) {
+        auto curve = args.size() > 5 ? parse_easing(args[5]) : ledpp::effect_engine::easing::linear;
+        engine.ramp (led, num(1, 0), num(2, 0), ms(3), curve, num(4, 1));
+    }
+    else if (type == "breathe"  &&  args.size() >= 4  &&  args.size() <= 5) {
+        engine.breathe (led, num(1, 0), num(2, 0), ms(3), num(4, 0));
+    }
+    else if (type == "blink"  &&  args.size() >= 3  &&  args.size() <= 4) {
+        int max_br = led.max_brightness ();
+        if (max_br < 0) {
+            int errnum = errno;
+            throw std::system_error (errnum, std::generic_category());
+        }
+        engine.blink (led, ms(1), num(2, 0)/100.0, max_br, 0, num(3, 0));
+    }
+    else {
+        throw std::invalid_argument ("Invalid effect: " + opt.effect);
+    }
+
+    // Endless effects run by the kernel continue after we exit
+    if (engine.offloaded(led))
+        return;
+
+    engine.wait ();
+    if (errnum)
+        throw std::system_error (errnum, std::generic_category());
+}
+
+
+//------------------------------------------------------------------------------
+// Execute commands read from standard input or a file.
+// Returns the exit status.
+//------------------------------------------------------------------------------
+static int run_batch (appargs_t& opt)
+{
+    std::ifstream file;
+    std::istream* in = &cin;
+    if (!opt.batch_file.empty()  &&  opt.batch_file != "-") {
+        file.open (opt.batch_file);
+        if (!file) {
+            int errnum = errno;
+            throw std::system_error (errnum, std::generic_category(), opt.batch_file);
+        }
+        in = &file;
+    }
+    // Send each reply as soon as it is ready if commands come
+    // from another program, so it can wait for the reply.
+    bool flush = in == &cin;
+
+    command_interpreter interpreter;
+    std::string line;
+    std::string reply;
+    int exit_status = 0;
+    while (std::getline(*in, line)) {
+        reply.clear ();
+        if (interpreter.execute_reply(line, reply) == command_interpreter::status::error)
+            exit_status = 1;
+        cout << reply;
+        if (flush)
+            cout.flush ();
+    }
+    return exit_status;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static void convert_timeline (appargs_t& opt)
+{
+    std::ifstream in (opt.convert_in);
+    if (!in) {
+        int errnum = errno;
+        throw std::system_error (errnum, std::generic_category(), opt.convert_in);
+    }
+    std::ostringstream out;
+    ledpp::led_timeline::convert (in, out);
+
+    std::ofstream file (opt.convert_out, std::ios::binary | std::ios::trunc);
+    auto data = out.view ();
+    if (!file  ||  !file.write(data.data(), data.size())  ||  !file.flush()) {
+        int errnum = errno;
+        throw std::system_error (errnum, std::generic_category(), opt.convert_out);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static void stop_player (int)
+{
+    if (active_player)
+        active_player->stop ();
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static void play_timeline (appargs_t& opt)
+{
+    ledpp::led_timeline timeline (opt.play_file);
+    ledpp::timeline_player player (timeline);
+
+    ledpp::timeline_player::options play_opt;
+    play_opt.loops = opt.play_loops;
+    play_opt.fifo_priority = opt.play_fifo;
+    play_opt.cpu = opt.play_cpu;
+
+    // Stop after the current frame when interrupted
+    struct sigaction sa;
+    memset (&sa, 0, sizeof(sa));
+    sa.sa_handler = stop_player;
+    sigemptyset (&sa.sa_mask);
+    active_player = &player;
+    sigaction (SIGINT, &sa, nullptr);
+    sigaction (SIGTERM, &sa, nullptr);
+    int result = player.play (play_opt);
+    int errnum = errno;
+    signal (SIGINT, SIG_DFL);
+    signal (SIGTERM, SIG_DFL);
+    active_player = nullptr;
+    if (result)
+        throw std::system_error (errnum, std::generic_category());
+
+    if (opt.stats) {
+        auto& late = player.lateness ();
+        auto& commits = player.commit_stats ();
+        auto us = [](auto d) {
+            return std::chrono::duration_cast<std::chrono::microseconds>(d).count ();
+        };
+        cerr << "Frames: " << late.frames << ", skipped: " << late.skipped
+             << ", lateness mean/p50/p99/max us: " << us(late.mean())
+             << "/" << us(late.percentile(50))
+             << "/" << us(late.percentile(99))
+             << "/" << us(late.max) << endl;
+        cerr << "Commits: " << commits.commits << ", writes: " << commits.writes
+             << ", errors: " << commits.errors
+             << ", latency mean/max us: " << us(commits.mean())
+             << "/" << us(commits.max) << endl;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Let the led daemon read or set the LED if it is running.
+// Returns false if there is no daemon to forward the request to.
+//------------------------------------------------------------------------------
+static bool forward_to_daemon (appargs_t& opt)
+{
+    if (opt.led_name.find_first_of(" \t\n") != std::string::npos)
+        return false;
+
+    std::vector<std::string> commands;
+    if (opt.brightness<0 && opt.colors.empty() && opt.trigger.empty())
+        commands.emplace_back ("get " + opt.led_name);
+    if (!opt.trigger.empty())
+        commands.emplace_back ("trigger " + opt.led_name + " " + opt.trigger);
+    if (opt.brightness >= 0  ||  !opt.colors.empty()) {
+        std::string cmd;
+        if (opt.brightness >= 0)
+            cmd = "set " + opt.led_name + " " + std::to_string (opt.brightness);
+        else
+            cmd = "colors " + opt.led_name;
+        for (auto value : opt.colors)
+            cmd.append (" " + std::to_string(value));
+        commands.emplace_back (std::move(cmd));
+    }
+
+    std::vector<std::string> replies;
+    if (!daemon_request(daemon_socket_path(), commands, replies))
+        return false;
+
+    for (auto& reply : replies) {
+        if (reply.starts_with("error")) {
+            cerr << "Error: " << (reply.size() > 6 ? reply.substr(6) : "Daemon request failed") << endl;
+            exit (1);
+        }
+        if (reply.size() > 3)
+            cout << reply.substr(3) << endl;
+    }
+    return true;
+}
+
+
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
 int main (int argc, char* argv[])
@@ -443,6 +998,14 @@ int main (int argc, char* argv[])
     try {
         appargs_t opt (argc, argv);
 
+        if (opt.stats || opt.list_stats) {
+            if (!ledpp::io_stats::available())
+                throw std::runtime_error ("I/O statistics are not supported by this build");
+            ledpp::io_stats::enable ();
+            if (opt.stats)
+                std::atexit (print_stats_at_exit);
+        }
+
         if (opt.list_triggers) {
             ledpp::led led (opt.led_name);
             auto triggers = led.triggers ();
@@ -450,13 +1013,22 @@ int main (int argc, char* argv[])
                 cout << t << endl;
             return 0;
         }
+        else if (opt.watch) {
+            auto interval = std::chrono::milliseconds ((long)(opt.watch_interval * 1000));
+            watch_leds (led_query(opt), interval, opt.json);
+            return 0;
+        }
         else if (opt.list) {
-            if (opt.names_only) {
-                auto leds = ledpp::led::led_names ();
-                for (auto& name : leds)
+            auto names = selected_leds (opt);
+            if (opt.list_stats) {
+                ledpp::led::snapshot (std::move(names), ledpp::led::leds_dir());
+                print_stats (cout, false);
+            }
+            else if (opt.names_only) {
+                for (auto& name : names)
                     cout << name << endl;
             }else{
-                list_leds ();
+                list_leds (std::move(names));
             }
             return 0;
         }
@@ -464,6 +1036,39 @@ int main (int argc, char* argv[])
             print_led_info (opt);
             return 0;
         }
+        if (!opt.effect.empty()) {
+            run_effect (opt);
+            return 0;
+        }
+        if (opt.batch)
+            return run_batch (opt);
+        if (opt.convert) {
+            convert_timeline (opt);
+            return 0;
+        }
+        if (!opt.play_file.empty()) {
+            play_timeline (opt);
+            return 0;
+        }
+        if (!opt.save_file.empty()) {
+            ledpp::led::snapshot_all().save (opt.save_file);
+            return 0;
+        }
+        if (!opt.restore_file.empty()) {
+            auto state = ledpp::led_snapshot::load (opt.restore_file);
+            if (ledpp::led::restore(state)) {
+                int errnum = errno;
+                throw std::system_error (errnum, std::generic_category());
+            }
+            return 0;
+        }
+        if (opt.daemon) {
+            run_daemon (daemon_socket_path());
+            return 0;
+        }
+        // Statistics are only collected for the LEDs accessed by this process
+        if (!opt.stats  &&  forward_to_daemon(opt))
+            return 0;
 
         ledpp::led led (opt.led_name);
 
@@ -471,20 +1076,9 @@ int main (int argc, char* argv[])
             //
             // Show current LED status
             //
-            cout << led.brightness() << '/' << led.max_brightness();
-            if (led.is_multicolor()) {
-                cout << '\t';
-                auto cnames = led.color_names ();
-                auto cvalue = led.color_intensity ();
-                for (size_t i=0; i<cnames.size(); ++i) {
-                    if (i)
-                        cout << ',';
-                    cout << cnames[i] << ':' << cvalue[i];
-                }
-            }
-            auto t = led.trigger ();
-            if (t != "none")
-                cout << "\ttrigger:" << t;
+            std::string status;
+            format_status (led, status);
+            cout << status;
             cout << endl;
             return 0;
         }